@@ -0,0 +1,163 @@
+
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+
+#ifndef _WIN32
+# include <sys/mman.h>
+#endif
+
+#include "tools/logger/logger.hpp"
+#include "arena.hpp"
+#include "config.hpp"
+
+// the size chunks are rounded to (the size of a huge page on most systems)
+static constexpr size_t chunk_alignment = 2 * 1024 * 1024;
+
+neam::r::memory_footprint neam::r::get_memory_footprint()
+{
+  return internal::get_arena().get_footprint();
+}
+
+neam::r::internal::arena &neam::r::internal::get_arena()
+{
+  // never destroyed: the data and the thread callgraphs may be destructed after it
+  static arena *instance = new arena;
+  return *instance;
+}
+
+unsigned neam::r::internal::arena::get_class(size_t size)
+{
+  unsigned ret = 0;
+  while ((size_t(1) << (ret + min_class_bits)) < size)
+    ++ret;
+  return ret;
+}
+
+size_t neam::r::internal::arena::get_allocation_size(size_t size)
+{
+  if (size > (size_t(1) << max_class_bits))
+    return size;
+  return size_t(1) << (get_class(size) + min_class_bits);
+}
+
+void *neam::r::internal::arena::allocate(size_t size)
+{
+  if (size > (size_t(1) << max_class_bits))
+  {
+    void *ret = std::malloc(size);
+    if (!ret)
+      throw std::bad_alloc();
+    std::lock_guard<mutex_type> _u0(lock);
+    footprint.large += size;
+    return ret;
+  }
+
+  const unsigned cls = get_class(size);
+  const size_t class_size = size_t(1) << (cls + min_class_bits);
+
+  std::lock_guard<mutex_type> _u0(lock);
+  void *ret = free_lists[cls];
+  if (ret)
+    free_lists[cls] = *reinterpret_cast<void **>(ret);
+  else
+  {
+    if (size_t(end - current) < class_size)
+      add_chunk(class_size);
+    ret = current;
+    current += class_size;
+  }
+  footprint.used += class_size;
+  return ret;
+}
+
+void neam::r::internal::arena::deallocate(void *ptr, size_t size)
+{
+  if (!ptr)
+    return;
+  if (size > (size_t(1) << max_class_bits))
+  {
+    std::free(ptr);
+    std::lock_guard<mutex_type> _u0(lock);
+    footprint.large -= size;
+    return;
+  }
+
+  const unsigned cls = get_class(size);
+  std::lock_guard<mutex_type> _u0(lock);
+  *reinterpret_cast<void **>(ptr) = free_lists[cls];
+  free_lists[cls] = ptr;
+  footprint.used -= size_t(1) << (cls + min_class_bits);
+}
+
+void neam::r::internal::arena::reserve(size_t size)
+{
+  std::lock_guard<mutex_type> _u0(lock);
+  if (size_t(end - current) < size)
+    add_chunk(size);
+}
+
+neam::r::memory_footprint neam::r::internal::arena::get_footprint() const
+{
+  std::lock_guard<mutex_type> _u0(lock);
+  return footprint;
+}
+
+void neam::r::internal::arena::add_chunk(size_t size)
+{
+  size = std::max(size, conf::arena_chunk_size);
+  size = (size + chunk_alignment - 1) / chunk_alignment * chunk_alignment;
+
+  void *memory = nullptr;
+  bool huge = false;
+#ifndef _WIN32
+# ifdef MAP_HUGETLB
+  if (conf::arena_huge_pages)
+  {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+      static bool warned = false;
+      if (!warned)
+        neam::cr::out.warning() << LOGGER_INFO << "reflective: huge pages are not available, the arena will use normal pages" << std::endl;
+      warned = true;
+      memory = nullptr;
+    }
+    else
+      huge = true;
+  }
+# endif
+  if (!memory)
+  {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+      memory = nullptr;
+# ifdef MADV_HUGEPAGE
+    else if (conf::arena_huge_pages)
+      madvise(memory, size, MADV_HUGEPAGE); // transparent huge pages, if the system allows them
+# endif
+  }
+#endif
+  if (!memory)
+    memory = std::malloc(size);
+  if (!memory)
+    throw std::bad_alloc();
+
+  // don't waste what remains of the previous chunk: put it in the free lists (current is always aligned on the smallest class)
+  while (size_t(end - current) >= (size_t(1) << min_class_bits))
+  {
+    unsigned cls = class_count - 1;
+    while ((size_t(1) << (cls + min_class_bits)) > size_t(end - current))
+      --cls;
+    *reinterpret_cast<void **>(current) = free_lists[cls];
+    free_lists[cls] = current;
+    current += size_t(1) << (cls + min_class_bits);
+  }
+
+  current = static_cast<uint8_t *>(memory);
+  end = current + size;
+  footprint.reserved += size;
+  ++footprint.chunk_count;
+  if (huge)
+    ++footprint.huge_page_chunk_count;
+}
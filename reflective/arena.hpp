@@ -0,0 +1,127 @@
+//
+// file : arena.hpp
+// in : file:///home/tim/projects/reflective/reflective/arena.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 23:12:37
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_5933372299022897674_1545103501__ARENA_HPP__
+# define __N_5933372299022897674_1545103501__ARENA_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+#include "type.hpp"
+
+namespace neam
+{
+  namespace r
+  {
+    /// \brief The memory reflective uses for its callgraphs (see get_memory_footprint())
+    struct memory_footprint
+    {
+      size_t reserved = 0; ///< \brief The memory the arena has obtained from the system, in bytes
+      size_t used = 0; ///< \brief The part of reserved that is currently allocated, in bytes (allocations are rounded up to their size class)
+      size_t large = 0; ///< \brief The allocations too large for the arena (they are directly obtained from the system), in bytes
+      size_t chunk_count = 0; ///< \brief The number of chunks of the arena
+      size_t huge_page_chunk_count = 0; ///< \brief The number of chunks that are backed by huge pages
+    };
+
+    /// \brief Return the memory of the arena: the callgraph entries, their children arrays and their cold parts
+    /// \note The arena counts everything it hands out, but what the entries and the functions allocate outside of it is not counted:
+    ///       the buckets of the duration histograms (see duration_histogram) and the content of the cold parts (reasons, sequences, ...)
+    memory_footprint get_memory_footprint();
+
+    namespace internal
+    {
+      /// \brief The memory of the callgraphs: chunks obtained from the system (optionally backed by huge pages, see conf::arena_huge_pages)
+      /// that are split in power-of-two size classes. Freed blocks go in the free list of their class and are reused, chunks are never given back.
+      /// Allocations larger than the largest class are forwarded to the system (and counted in memory_footprint::large).
+      /// \note The arena is sized from the data loaded at startup (see reserve()), so that recording the same callgraph again does not
+      ///       ask the system for callgraph memory. The histogram buckets of each newly timed entry are still allocated outside of it (see duration_histogram)
+      class arena
+      {
+        public:
+          static constexpr unsigned min_class_bits = 4; // 16 bytes (also the alignment of every block)
+          static constexpr unsigned max_class_bits = 16; // 64KiB
+          static constexpr unsigned class_count = max_class_bits - min_class_bits + 1;
+
+        public:
+          void *allocate(size_t size);
+          void deallocate(void *ptr, size_t size);
+
+          /// \brief Make sure that size bytes can be allocated without asking the system for memory
+          void reserve(size_t size);
+
+          memory_footprint get_footprint() const;
+
+          /// \brief Return what an allocation of size bytes really takes in the arena (its size class)
+          static size_t get_allocation_size(size_t size);
+
+        private:
+          static unsigned get_class(size_t size);
+          void add_chunk(size_t size); // lock must be held
+
+        private:
+          mutable mutex_type lock;
+          uint8_t *current = nullptr; // the free part of the last chunk
+          uint8_t *end = nullptr;
+          void *free_lists[class_count] = {nullptr};
+          memory_footprint footprint;
+      };
+
+      /// \brief Return the arena (it's never destroyed, so it outlives every data)
+      arena &get_arena();
+
+      /// \brief A standard allocator that allocates in the arena
+      template<typename Type>
+      class arena_allocator
+      {
+        public:
+          using value_type = Type;
+
+          arena_allocator() = default;
+          template<typename Other>
+          arena_allocator(const arena_allocator<Other> &) {}
+
+          Type *allocate(size_t count)
+          {
+            return static_cast<Type *>(get_arena().allocate(count * sizeof(Type)));
+          }
+
+          void deallocate(Type *ptr, size_t count)
+          {
+            get_arena().deallocate(ptr, count * sizeof(Type));
+          }
+
+          template<typename Other>
+          bool operator == (const arena_allocator<Other> &) const { return true; }
+          template<typename Other>
+          bool operator != (const arena_allocator<Other> &) const { return false; }
+      };
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_5933372299022897674_1545103501__ARENA_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
@@ -0,0 +1,66 @@
+//
+// file : average.hpp
+// in : file:///home/tim/projects/reflective/reflective/average.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 14:32:10
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_14189154938208861744_548756574__AVERAGE_HPP__
+# define __N_14189154938208861744_548756574__AVERAGE_HPP__
+
+#include <cstdint>
+#include <algorithm>
+
+#include "config.hpp"
+
+namespace neam
+{
+  namespace r
+  {
+    namespace internal
+    {
+      /// \brief Merge a batch of samples (their sum and their count) into an average
+      /// \note When conf::sliding_average is true, the past value weight is capped to conf::past_average_weight
+      ///       (and so is the weight of the batch). With a batch of one sample, this is exactly the per-sample formula.
+      static inline void merge_average(double &average, uint64_t &count, double sum, uint64_t sample_count)
+      {
+        if (!sample_count)
+          return;
+
+        uint64_t mcount = count;
+        uint64_t bcount = sample_count;
+        if (conf::sliding_average)
+        {
+          mcount = std::min(mcount, uint64_t(conf::past_average_weight));
+          bcount = std::min(bcount, uint64_t(conf::past_average_weight) + 1);
+        }
+
+        const double batch_average = sum / double(sample_count);
+        average = (average * double(mcount) + batch_average * double(bcount)) / double(mcount + bcount);
+        count += sample_count;
+      }
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_14189154938208861744_548756574__AVERAGE_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
@@ -0,0 +1,815 @@
+
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "binary_format.hpp"
+#include "storage.hpp"
+
+namespace
+{
+  /// \brief Write the records and the details, and build the string table
+  class encoder
+  {
+    public:
+      encoder() { get_string_index(std::string()); }
+
+      /// \brief Reserve an 8-byte aligned array at the end of the buffer, return its offset
+      template<typename Type>
+      uint64_t reserve(size_t count)
+      {
+        align();
+        const uint64_t offset = buffer.size();
+        buffer.resize(buffer.size() + count * sizeof(Type), 0);
+        return offset;
+      }
+
+      template<typename Type>
+      void put(uint64_t offset, size_t index, const Type &value)
+      {
+        memcpy(&buffer[offset + index * sizeof(Type)], &value, sizeof(Type));
+      }
+
+      template<typename Type>
+      Type get(uint64_t offset, size_t index) const
+      {
+        Type value;
+        memcpy(&value, &buffer[offset + index * sizeof(Type)], sizeof(Type));
+        return value;
+      }
+
+      uint32_t get_string_index(const std::string &str)
+      {
+        auto it = string_indexes.find(str);
+        if (it != string_indexes.end())
+          return it->second;
+        const uint32_t index = strings.size();
+        strings.push_back(&string_indexes.emplace(str, index).first->first);
+        return index;
+      }
+
+      // details //
+
+      void write_varint(uint64_t value)
+      {
+        while (value >= 0x80)
+        {
+          details.push_back(char((value & 0x7F) | 0x80));
+          value >>= 7;
+        }
+        details.push_back(char(value));
+      }
+      void write_signed_varint(int64_t value) { write_varint((uint64_t(value) << 1) ^ uint64_t(value >> 63)); } // zigzag
+      void write_double(double value)
+      {
+        char tmp[sizeof(double)];
+        memcpy(tmp, &value, sizeof(double));
+        details.append(tmp, sizeof(double));
+      }
+      void write_string(const std::string &str) { write_varint(get_string_index(str)); }
+
+      void write_progression(const std::deque<neam::r::duration_progression> &progression)
+      {
+        write_varint(progression.size());
+        int64_t last_timestamp = 0;
+        for (const neam::r::duration_progression &it : progression)
+        {
+          write_signed_varint(it.timestamp - last_timestamp);
+          write_double(it.value);
+          last_timestamp = it.timestamp;
+        }
+      }
+
+      void write_histogram(const neam::r::duration_histogram &histogram)
+      {
+        // only the range that has been hit
+        size_t first = 0;
+        size_t last = histogram.buckets.size();
+        while (first < last && !histogram.buckets[first])
+          ++first;
+        while (last > first && !histogram.buckets[last - 1])
+          --last;
+
+        write_varint(histogram.count);
+        write_double(histogram.max);
+        write_varint(histogram.first_bucket + first);
+        write_varint(last - first);
+        for (size_t i = first; i < last; ++i)
+          write_varint(histogram.buckets[i]);
+      }
+
+      void write_reasons(const std::deque<neam::r::reason> &reasons)
+      {
+        write_varint(reasons.size());
+        for (const neam::r::reason &it : reasons)
+        {
+          write_string(it.type);
+          write_string(it.message);
+          write_string(it.file);
+          write_varint(it.line);
+          write_varint(it.hit);
+          write_signed_varint(it.initial_timestamp);
+          write_signed_varint(it.last_timestamp - it.initial_timestamp);
+        }
+      }
+
+      /// \brief Encode the variable-sized parts of a stack entry, and append them to the buffer
+      void write_details(const neam::r::internal::stack_entry &entry, uint64_t &offset, uint64_t &size)
+      {
+        details.clear();
+        const neam::r::internal::stack_entry_cold &cold = entry.cold.get();
+        write_progression(cold.self_time_progression);
+        write_progression(cold.global_time_progression);
+        write_reasons(cold.fails);
+
+        write_varint(cold.reports.size());
+        for (const auto &it : cold.reports)
+        {
+          write_string(it.first);
+          write_reasons(it.second);
+        }
+
+        write_varint(cold.sequences.size());
+        for (const auto &it : cold.sequences)
+        {
+          write_string(it.first);
+          write_varint(it.second.get_entries().size());
+          for (const neam::r::sequence::entry &seq_it : it.second.get_entries())
+          {
+            write_string(seq_it.file);
+            write_varint(seq_it.line);
+            write_string(seq_it.name);
+            write_string(seq_it.description);
+          }
+        }
+
+        write_varint(cold.measure_points.size());
+        for (const auto &it : cold.measure_points)
+        {
+          write_string(it.first);
+          write_varint(it.second.hit_count);
+          write_double(it.second.value);
+        }
+
+        write_histogram(entry.self_time_histogram);
+        write_histogram(entry.global_time_histogram);
+
+        write_varint(cold.exemplars.size());
+        for (const neam::r::exemplar &it : cold.exemplars)
+        {
+          write_signed_varint(it.timestamp);
+          write_double(it.duration);
+          write_varint(it.dropped_calls);
+          write_varint(it.calls.size());
+          for (const neam::r::exemplar_call &call : it.calls)
+          {
+            write_varint(call.call_structure_index);
+            write_varint(call.depth);
+            write_double(call.start);
+            write_double(call.duration);
+          }
+        }
+
+        append_details(offset, size);
+      }
+
+      /// \brief Encode the variable-sized parts of a call_info_struct, and append them to the buffer
+      void write_details(const neam::r::internal::call_info_struct &cis, uint64_t &offset, uint64_t &size)
+      {
+        details.clear();
+        write_histogram(cis.self_time_histogram);
+        write_histogram(cis.global_time_histogram);
+
+        append_details(offset, size);
+      }
+
+      void append_details(uint64_t &offset, uint64_t &size)
+      {
+        offset = buffer.size();
+        size = details.size();
+        buffer.append(details);
+      }
+
+      /// \brief Append the string table, return the offset of the string_record array
+      uint64_t write_string_table()
+      {
+        const uint64_t offset = reserve<neam::r::binary::string_record>(strings.size());
+        size_t index = 0;
+        for (const std::string *it : strings)
+        {
+          put(offset, index++, neam::r::binary::string_record{buffer.size(), it->size()});
+          buffer.append(it->c_str(), it->size() + 1);
+        }
+        return offset;
+      }
+
+      /// \brief Put the strings of a file at the same indexes in the string table, so the stashes of that file can be copied verbatim (see copy_data())
+      /// \note Must be called before any other string is added
+      bool import_string_table(const neam::r::binary::view &file)
+      {
+        const uint64_t count = file.get_header().string_count;
+        std::vector<std::pair<const char *, size_t>> file_strings(count);
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          if (!(file_strings[i].first = file.get_string(i, &file_strings[i].second)))
+            return false;
+        }
+        if (!count || file_strings[0].second || strings.size() != 1)
+          return false;
+        for (uint64_t i = 1; i < count; ++i)
+          strings.push_back(&string_indexes.emplace(std::string(file_strings[i].first, file_strings[i].second), uint32_t(i)).first->first);
+        return true;
+      }
+
+      /// \brief Copy the records, children and details of a stash of a file as they are (only the offsets are moved), without decoding it
+      /// \note The string table of the file must have been imported. Return false (and leave the buffer untouched) if the stash cannot be copied.
+      bool copy_data(const neam::r::binary::mapped_file &file, size_t index, neam::r::binary::data_record &drec)
+      {
+        const neam::r::binary::view view = file.get_view();
+        const neam::r::binary::data_record *src = view.get_data(index);
+        if (!src || view.get_header().version != neam::r::binary::version)
+          return false;
+        // a stash is contiguous: from its call_info_record array to the next stash (or the string table)
+        const neam::r::binary::data_record *next = view.get_data(index + 1);
+        const uint64_t begin = src->func_info_offset;
+        const uint64_t end = next ? next->func_info_offset : view.get_header().string_offset;
+        if (begin % 8 || begin > end || end > file.get_size())
+          return false;
+
+        align();
+        const uint64_t new_begin = buffer.size();
+        buffer.append(reinterpret_cast<const char *>(file.get_memory()) + begin, end - begin);
+        auto move = [begin, end, new_begin](uint64_t &offset, uint64_t count, size_t stride) -> bool
+        {
+          if (offset < begin || offset > end || count > (end - offset) / stride)
+            return false;
+          offset = offset - begin + new_begin;
+          return true;
+        };
+
+        drec = *src;
+        bool success = move(drec.func_info_offset, drec.func_info_count, sizeof(neam::r::binary::call_info_record))
+                       && move(drec.callgraph_offset, drec.callgraph_count, sizeof(neam::r::binary::stack_record));
+        for (size_t i = 0; success && i < drec.func_info_count; ++i)
+        {
+          neam::r::binary::call_info_record rec = get<neam::r::binary::call_info_record>(drec.func_info_offset, i);
+          success = move(rec.details_offset, rec.details_size, 1);
+          put(drec.func_info_offset, i, rec);
+        }
+        for (size_t i = 0; success && i < drec.callgraph_count; ++i)
+        {
+          neam::r::binary::stack_record srec = get<neam::r::binary::stack_record>(drec.callgraph_offset, i);
+          success = move(srec.entry_offset, srec.entry_count, sizeof(neam::r::binary::stack_entry_record));
+          put(drec.callgraph_offset, i, srec);
+          for (size_t j = 0; success && j < srec.entry_count; ++j)
+          {
+            neam::r::binary::stack_entry_record rec = get<neam::r::binary::stack_entry_record>(srec.entry_offset, j);
+            success = move(rec.children_offset, rec.children_count, sizeof(uint32_t)) && move(rec.details_offset, rec.details_size, 1);
+            put(srec.entry_offset, j, rec);
+          }
+        }
+
+        if (!success)
+          buffer.resize(new_begin);
+        return success;
+      }
+
+      void align()
+      {
+        buffer.resize((buffer.size() + 7) & ~size_t(7), 0);
+      }
+
+      std::string buffer;
+      std::string details;
+
+      std::unordered_map<std::string, uint32_t> string_indexes;
+      std::vector<const std::string *> strings; // pointers to the keys of string_indexes
+  };
+
+  /// \brief Read the varint-encoded details
+  class decoder
+  {
+    public:
+      decoder(const neam::r::binary::view &_file, const uint8_t *_it, const uint8_t *_end) : file(_file), it(_it), end(_end) {}
+
+      bool read_varint(uint64_t &value)
+      {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+          if (it == end)
+            return false;
+          const uint8_t byte = *it++;
+          value |= uint64_t(byte & 0x7F) << shift;
+          if (!(byte & 0x80))
+            return true;
+        }
+        return false;
+      }
+      bool read_signed_varint(int64_t &value)
+      {
+        uint64_t tmp;
+        if (!read_varint(tmp))
+          return false;
+        value = int64_t(tmp >> 1) ^ -int64_t(tmp & 1);
+        return true;
+      }
+      bool read_double(double &value)
+      {
+        if (end - it < (long)sizeof(double))
+          return false;
+        memcpy(&value, it, sizeof(double));
+        it += sizeof(double);
+        return true;
+      }
+      bool read_string(std::string &str)
+      {
+        uint64_t index;
+        size_t size;
+        const char *ptr;
+        if (!read_varint(index) || !(ptr = file.get_string(index, &size)))
+          return false;
+        str.assign(ptr, size);
+        return true;
+      }
+      bool read_count(uint64_t &count)
+      {
+        // each element takes at least a byte: this avoids huge allocations on corrupted files
+        return read_varint(count) && count <= uint64_t(end - it);
+      }
+
+      bool read_progression(std::deque<neam::r::duration_progression> &progression)
+      {
+        uint64_t count;
+        if (!read_count(count))
+          return false;
+        int64_t last_timestamp = 0;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          int64_t delta;
+          double value;
+          if (!read_signed_varint(delta) || !read_double(value))
+            return false;
+          last_timestamp += delta;
+          progression.push_back(neam::r::duration_progression{last_timestamp, value});
+        }
+        return true;
+      }
+
+      bool read_histogram(neam::r::duration_histogram &histogram)
+      {
+        uint64_t first_bucket;
+        uint64_t count;
+        if (!read_varint(histogram.count) || !read_double(histogram.max) || !read_varint(first_bucket) || !read_count(count)
+            || first_bucket > neam::r::duration_histogram::bucket_count || count > neam::r::duration_histogram::bucket_count - first_bucket)
+          return false;
+        histogram.first_bucket = first_bucket;
+        histogram.buckets.resize(count);
+        for (uint64_t &it : histogram.buckets)
+        {
+          if (!read_varint(it))
+            return false;
+        }
+        return true;
+      }
+
+      bool read_reasons(std::deque<neam::r::reason> &reasons)
+      {
+        uint64_t count;
+        if (!read_count(count))
+          return false;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          std::string type;
+          if (!read_string(type))
+            return false;
+          reasons.push_back(neam::r::reason{type});
+          neam::r::reason &rsn = reasons.back();
+          int64_t duration;
+          if (!read_string(rsn.message) || !read_string(rsn.file) || !read_varint(rsn.line) || !read_varint(rsn.hit)
+              || !read_signed_varint(rsn.initial_timestamp) || !read_signed_varint(duration))
+            return false;
+          rsn.last_timestamp = rsn.initial_timestamp + duration;
+        }
+        return true;
+      }
+
+      bool read_details(neam::r::internal::stack_entry &entry)
+      {
+        neam::r::internal::stack_entry_cold cold;
+        if (!read_progression(cold.self_time_progression) || !read_progression(cold.global_time_progression) || !read_reasons(cold.fails))
+          return false;
+
+        uint64_t count;
+        if (!read_count(count))
+          return false;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          std::string name;
+          if (!read_string(name) || !read_reasons(cold.reports[name]))
+            return false;
+        }
+
+        if (!read_count(count))
+          return false;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          std::string name;
+          uint64_t entry_count;
+          if (!read_string(name) || !read_count(entry_count))
+            return false;
+          neam::r::sequence &seq = cold.sequences[name];
+          for (uint64_t j = 0; j < entry_count; ++j)
+          {
+            neam::r::sequence::entry seq_entry;
+            if (!read_string(seq_entry.file) || !read_varint(seq_entry.line) || !read_string(seq_entry.name) || !read_string(seq_entry.description))
+              return false;
+            seq.add_entry(std::move(seq_entry));
+          }
+        }
+
+        if (!read_count(count))
+          return false;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+          std::string name;
+          neam::r::measure_point_entry mpe;
+          if (!read_string(name) || !read_varint(mpe.hit_count) || !read_double(mpe.value))
+            return false;
+          cold.measure_points[name] = mpe;
+        }
+
+        if (file.get_header().version >= 2)
+        {
+          if (!read_histogram(entry.self_time_histogram) || !read_histogram(entry.global_time_histogram))
+            return false;
+        }
+
+        if (file.get_header().version >= 3)
+        {
+          if (!read_count(count))
+            return false;
+          for (uint64_t i = 0; i < count; ++i)
+          {
+            neam::r::exemplar ex;
+            uint64_t call_count;
+            if (!read_signed_varint(ex.timestamp) || !read_double(ex.duration) || !read_varint(ex.dropped_calls) || !read_count(call_count))
+              return false;
+            ex.calls.reserve(call_count);
+            for (uint64_t j = 0; j < call_count; ++j)
+            {
+              neam::r::exemplar_call call;
+              uint64_t depth;
+              if (!read_varint(call.call_structure_index) || !read_varint(depth) || !read_double(call.start) || !read_double(call.duration))
+                return false;
+              call.depth = uint32_t(depth);
+              ex.calls.push_back(call);
+            }
+            cold.exemplars.push_back(std::move(ex));
+          }
+        }
+        if (!cold.empty())
+          entry.cold.get_or_create() = std::move(cold);
+        return it == end;
+      }
+
+      bool read_details(neam::r::internal::call_info_struct &cis)
+      {
+        if (!read_histogram(cis.self_time_histogram) || !read_histogram(cis.global_time_histogram))
+          return false;
+        return it == end;
+      }
+
+    private:
+      const neam::r::binary::view &file;
+      const uint8_t *it;
+      const uint8_t *end;
+  };
+} // namespace
+
+bool neam::r::binary::view::is_valid() const
+{
+  if (size < sizeof(file_header) || reinterpret_cast<uintptr_t>(memory) % alignof(file_header))
+    return false;
+  const file_header &header = get_header();
+  return header.magic == magic && header.version >= 1 && header.version <= version && header.file_size == size
+         && get_array<data_record>(header.data_offset, header.data_count, 0) && get_array<string_record>(header.string_offset, header.string_count, 0);
+}
+
+const char *neam::r::binary::view::get_string(uint64_t index, size_t *string_size) const
+{
+  const string_record *rec = get_array<string_record>(get_header().string_offset, get_header().string_count, index);
+  if (!rec || index >= get_header().string_count || rec->offset >= size || rec->size >= size - rec->offset || memory[rec->offset + rec->size] != 0)
+    return nullptr;
+  if (string_size)
+    *string_size = rec->size;
+  return reinterpret_cast<const char *>(memory + rec->offset);
+}
+
+bool neam::r::binary::view::decode_details(const stack_entry_record &se, internal::stack_entry &entry) const
+{
+  if (se.details_offset > size || se.details_size > size - se.details_offset)
+    return false;
+  decoder dec(*this, memory + se.details_offset, memory + se.details_offset + se.details_size);
+  return dec.read_details(entry);
+}
+
+bool neam::r::binary::view::decode_details(const call_info_record &cir, internal::call_info_struct &cis) const
+{
+  if (get_header().version < 2)
+    return true;
+  if (cir.details_offset > size || cir.details_size > size - cir.details_offset)
+    return false;
+  decoder dec(*this, memory + cir.details_offset, memory + cir.details_offset + cir.details_size);
+  return dec.read_details(cis);
+}
+
+std::string neam::r::binary::encode(const std::deque<internal::data> &root)
+{
+  encoder enc;
+
+  enc.reserve<file_header>(1);
+  const uint64_t data_offset = enc.reserve<data_record>(root.size());
+
+  // stashes that have not been decoded yet are copied from their file without being decoded (when the file has the current format)
+  const mapped_file *verbatim_source = nullptr;
+  for (const internal::data &root_it : root)
+  {
+    if (root_it.is_loaded())
+      continue;
+    if (root_it.lazy_source->get_view().get_header().version == version && enc.import_string_table(root_it.lazy_source->get_view()))
+      verbatim_source = root_it.lazy_source.get();
+    break;
+  }
+
+  size_t data_index = 0;
+  for (const internal::data &root_it : root)
+  {
+    data_record drec;
+    if (!root_it.is_loaded() && root_it.lazy_source.get() == verbatim_source && enc.copy_data(*verbatim_source, root_it.lazy_index, drec))
+    {
+      drec.launch_count = root_it.launch_count;
+      drec.timestamp = root_it.timestamp;
+      drec.name = enc.get_string_index(root_it.name);
+      enc.put(data_offset, data_index++, drec);
+      continue;
+    }
+
+    // the other ones are decoded in a temporary
+    internal::data lazy_data;
+    if (!root_it.is_loaded() && !decode_data(root_it.lazy_source->get_view(), root_it.lazy_index, lazy_data))
+    {
+      lazy_data.func_info.clear(); // corrupted: only keep its name
+      lazy_data.callgraph.clear();
+      lazy_data.launch_count = root_it.launch_count;
+      lazy_data.name = root_it.name;
+      lazy_data.timestamp = root_it.timestamp;
+    }
+    const internal::data &data_it = root_it.is_loaded() ? root_it : lazy_data;
+
+    drec.launch_count = data_it.launch_count;
+    drec.timestamp = data_it.timestamp;
+    drec.name = enc.get_string_index(data_it.name);
+
+    drec.func_info_count = data_it.func_info.size();
+    drec.func_info_offset = enc.reserve<call_info_record>(drec.func_info_count);
+    size_t index = 0;
+    for (const internal::call_info_struct &it : data_it.func_info)
+    {
+      call_info_record rec =
+      {
+        enc.get_string_index(it.descr.name), enc.get_string_index(it.descr.pretty_name),
+        enc.get_string_index(it.descr.file), enc.get_string_index(it.descr.key_name),
+        it.descr.line, it.descr.key_hash,
+        it.call_count, it.fail_count,
+        it.average_self_time, it.average_self_time_count,
+        it.average_global_time, it.average_global_time_count,
+        0, 0
+      };
+      enc.write_details(it, rec.details_offset, rec.details_size);
+      enc.put(drec.func_info_offset, index++, rec);
+    }
+
+    drec.callgraph_count = data_it.callgraph.size();
+    drec.callgraph_offset = enc.reserve<stack_record>(drec.callgraph_count);
+    size_t stack_index = 0;
+    for (const internal::stack_entry_list &graph_it : data_it.callgraph)
+    {
+      const stack_record srec = {graph_it.size(), enc.reserve<stack_entry_record>(graph_it.size())};
+      enc.put(drec.callgraph_offset, stack_index++, srec);
+
+      index = 0;
+      for (const internal::stack_entry &it : graph_it)
+      {
+        stack_entry_record rec =
+        {
+          it.call_structure_index, it.parent,
+          it.hit_count, it.fail_count,
+          it.average_self_time, it.average_self_time_count,
+          it.average_global_time, it.average_global_time_count,
+          it.children.size(), 0, 0, 0
+        };
+        rec.children_offset = enc.reserve<uint32_t>(it.children.size());
+        for (size_t i = 0; i < it.children.size(); ++i)
+          enc.put(rec.children_offset, i, uint32_t(it.children[i]));
+        enc.write_details(it, rec.details_offset, rec.details_size);
+
+        enc.put(srec.entry_offset, index++, rec);
+      }
+    }
+
+    enc.put(data_offset, data_index++, drec);
+  }
+
+  file_header header;
+  header.magic = magic;
+  header.version = version;
+  header.data_count = root.size();
+  header.data_offset = data_offset;
+  header.string_count = enc.strings.size();
+  header.string_offset = enc.write_string_table();
+  enc.align();
+  header.file_size = enc.buffer.size();
+  enc.put(0, 0, header);
+
+  return std::move(enc.buffer);
+}
+
+/// \brief Decode the header of a stash (launch count, timestamp, name)
+static bool _decode_data_header(const neam::r::binary::view &file, const neam::r::binary::data_record &drec, neam::r::internal::data &d)
+{
+  d.launch_count = drec.launch_count;
+  d.timestamp = drec.timestamp;
+  size_t size;
+  const char *name = file.get_string(drec.name, &size);
+  if (!name)
+    return false;
+  d.name.assign(name, size);
+  return true;
+}
+
+bool neam::r::binary::decode_data(const view &file, size_t index, internal::data &d)
+{
+  const data_record *drec = file.get_data(index);
+  if (!drec || !_decode_data_header(file, *drec, d))
+    return false;
+
+  d.func_info.clear();
+  d.callgraph.clear();
+  for (size_t j = 0; j < drec->func_info_count; ++j)
+  {
+    const call_info_record *rec = file.get_call_info(*drec, j);
+    const char *strs[4] = {nullptr, nullptr, nullptr, nullptr};
+    size_t sizes[4];
+    if (!rec || !(strs[0] = file.get_string(rec->name, &sizes[0])) || !(strs[1] = file.get_string(rec->pretty_name, &sizes[1]))
+        || !(strs[2] = file.get_string(rec->file, &sizes[2])) || !(strs[3] = file.get_string(rec->key_name, &sizes[3])))
+      return false;
+
+    d.func_info.emplace_back(internal::call_info_struct{func_descriptor
+    {
+      std::string(strs[0], sizes[0]), std::string(strs[1], sizes[1]),
+      std::string(strs[2], sizes[2]), rec->line,
+      std::string(strs[3], sizes[3]), decltype(func_descriptor::key_hash)(rec->key_hash)
+    }});
+    internal::call_info_struct &cis = d.func_info.back();
+    cis.call_count = rec->call_count;
+    cis.fail_count = rec->fail_count;
+    cis.average_self_time = rec->average_self_time;
+    cis.average_self_time_count = rec->average_self_time_count;
+    cis.average_global_time = rec->average_global_time;
+    cis.average_global_time_count = rec->average_global_time_count;
+    if (!file.decode_details(*rec, cis))
+      return false;
+  }
+
+  for (size_t j = 0; j < drec->callgraph_count; ++j)
+  {
+    const stack_record *srec = file.get_stack(*drec, j);
+    if (!srec)
+      return false;
+    d.callgraph.emplace_back();
+    internal::stack_entry_list &graph = d.callgraph.back();
+
+    for (size_t k = 0; k < srec->entry_count; ++k)
+    {
+      const stack_entry_record *rec = file.get_stack_entry(*srec, k);
+      const uint32_t *children = rec ? file.get_children(*rec) : nullptr;
+      if (!rec || !children)
+        return false;
+
+      graph.emplace_back(internal::stack_entry{uint64_t(k), uint64_t(j), rec->call_structure_index, rec->parent});
+      internal::stack_entry &entry = graph.back();
+      entry.hit_count = rec->hit_count;
+      entry.fail_count = rec->fail_count;
+      entry.average_self_time = rec->average_self_time;
+      entry.average_self_time_count = rec->average_self_time_count;
+      entry.average_global_time = rec->average_global_time;
+      entry.average_global_time_count = rec->average_global_time_count;
+      entry.children.assign(children, children + rec->children_count);
+
+      if (!file.decode_details(*rec, entry))
+        return false;
+    }
+  }
+  return true;
+}
+
+std::deque<neam::r::internal::data> *neam::r::binary::decode(const view &file, const std::shared_ptr<const mapped_file> &lazy_source)
+{
+  if (!file.is_valid())
+    return nullptr;
+
+  std::deque<internal::data> *root = new std::deque<internal::data>;
+
+  const file_header &header = file.get_header();
+  for (size_t i = 0; i < header.data_count; ++i)
+  {
+    root->emplace_back();
+    internal::data &d = root->back();
+
+    bool success;
+    if (lazy_source && i + 1 < header.data_count)
+    {
+      const data_record *drec = file.get_data(i);
+      success = drec && _decode_data_header(file, *drec, d);
+      d.lazy_source = lazy_source;
+      d.lazy_index = i;
+    }
+    else
+      success = decode_data(file, i, d);
+
+    if (!success)
+    {
+      delete root;
+      return nullptr;
+    }
+  }
+  return root;
+}
+
+std::shared_ptr<const neam::r::binary::mapped_file> neam::r::binary::mapped_file::open(const std::string &path)
+{
+  std::shared_ptr<mapped_file> ret(new mapped_file);
+
+#ifndef _WIN32
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    close(fd);
+    return nullptr;
+  }
+  void *mapping = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping != MAP_FAILED)
+  {
+    ret->memory = mapping;
+    ret->size = size_t(st.st_size);
+    ret->is_mapped = true;
+    return ret;
+  }
+#endif
+
+  // fallback: read the file
+  std::ifstream inf(path, std::ios_base::binary);
+  if (!inf)
+    return nullptr;
+  inf.seekg(0, std::ios_base::end);
+  const int64_t size = inf.tellg();
+  inf.seekg(0, std::ios_base::beg);
+  if (size <= 0)
+    return nullptr;
+
+  uint64_t *memory = new uint64_t[(size + 7) / 8]; // 8-byte aligned
+  inf.read(reinterpret_cast<char *>(memory), size);
+  ret->memory = memory;
+  ret->size = size_t(size);
+  ret->is_mapped = false;
+  if (!inf)
+    return nullptr;
+  return ret;
+}
+
+neam::r::binary::mapped_file::~mapped_file()
+{
+  if (!memory)
+    return;
+#ifndef _WIN32
+  if (is_mapped)
+  {
+    munmap(const_cast<void *>(memory), size);
+    return;
+  }
+#endif
+  delete [] reinterpret_cast<const uint64_t *>(memory);
+}
@@ -0,0 +1,246 @@
+//
+// file : binary_format.hpp
+// in : file:///home/tim/projects/reflective/reflective/binary_format.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 17:20:12
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_19069662631925001346_1795791897__BINARY_FORMAT_HPP__
+# define __N_19069662631925001346_1795791897__BINARY_FORMAT_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <memory>
+
+#include "stack_entry.hpp"
+
+namespace neam
+{
+  namespace r
+  {
+    namespace internal
+    {
+      class data;
+      struct call_info_struct;
+    } // namespace internal
+
+    /// \brief The binary on-disk format of reflective
+    /// The file is made of fixed-width, 8-byte aligned records that reference each other with offsets (from the start of the file),
+    /// so a tool can mmap() a file and walk it with a view without any parse step. Strings are deduplicated in a string table,
+    /// and only the variable-sized parts of a stack_entry (progressions, fails, reports, sequences, measure points)
+    /// are encoded with varints in a "details" blob.
+    ///
+    /// Layout: [file_header] [data_record x data_count] [for each data: call_info_record x N, stack_record x N, stack_entry_record x N, children, details]
+    ///         [string_record x string_count] [strings]
+    /// The data_record array (right after the header) is the index of the stashes: load_data_from_disk() only decodes the active stash,
+    /// the others are decoded on demand (see decode()).
+    /// \note Everything is little-endian
+    /// \note Version 2 added the duration histograms (the call_info_record grew, and they are at the end of the details).
+    ///       Version 3 added the exemplars (at the end of the details of the stack entries). Version 1 and 2 files can still be read.
+    namespace binary
+    {
+      static constexpr uint32_t magic = 0x42524E2E; // ".NRB"
+      static constexpr uint32_t version = 3;
+
+      /// \brief The header of the file
+      struct file_header
+      {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t file_size;
+        uint64_t data_count; ///< \brief Number of data (stashes)
+        uint64_t data_offset; ///< \brief Offset of the data_record array
+        uint64_t string_count; ///< \brief Number of strings (the string 0 is always the empty string)
+        uint64_t string_offset; ///< \brief Offset of the string_record array
+      };
+
+      /// \brief A string of the string table (strings are null-terminated)
+      struct string_record
+      {
+        uint64_t offset;
+        uint64_t size; ///< \brief Size without the null terminator
+      };
+
+      /// \brief A stash (an internal::data)
+      struct data_record
+      {
+        uint64_t launch_count;
+        int64_t timestamp;
+        uint64_t name; ///< \brief String index
+        uint64_t func_info_count;
+        uint64_t func_info_offset; ///< \brief Offset of the call_info_record array
+        uint64_t callgraph_count;
+        uint64_t callgraph_offset; ///< \brief Offset of the stack_record array
+      };
+
+      /// \brief A call_info_struct
+      struct call_info_record
+      {
+        uint32_t name; ///< \brief String index
+        uint32_t pretty_name; ///< \brief String index
+        uint32_t file; ///< \brief String index
+        uint32_t key_name; ///< \brief String index
+        uint64_t line;
+        uint64_t key_hash;
+
+        uint64_t call_count;
+        uint64_t fail_count;
+        double average_self_time;
+        uint64_t average_self_time_count;
+        double average_global_time;
+        uint64_t average_global_time_count;
+
+        // version 2 //
+        uint64_t details_size;
+        uint64_t details_offset; ///< \brief Offset of the varint-encoded histograms (see decode_details())
+      };
+      static constexpr size_t call_info_record_v1_size = 80; ///< \brief The size of a call_info_record in a version 1 file
+
+      /// \brief A root of the callgraph
+      struct stack_record
+      {
+        uint64_t entry_count;
+        uint64_t entry_offset; ///< \brief Offset of the stack_entry_record array
+      };
+
+      /// \brief A stack_entry (its self_index / stack_index are its position in the file)
+      struct stack_entry_record
+      {
+        uint64_t call_structure_index;
+        uint64_t parent;
+
+        uint64_t hit_count;
+        uint64_t fail_count;
+        double average_self_time;
+        uint64_t average_self_time_count;
+        double average_global_time;
+        uint64_t average_global_time_count;
+
+        uint64_t children_count;
+        uint64_t children_offset; ///< \brief Offset of an uint32_t array
+        uint64_t details_size;
+        uint64_t details_offset; ///< \brief Offset of the varint-encoded details (see decode_details())
+      };
+
+      static_assert(sizeof(file_header) == 48, "binary::file_header must have a fixed size");
+      static_assert(sizeof(data_record) == 56, "binary::data_record must have a fixed size");
+      static_assert(sizeof(call_info_record) == 96, "binary::call_info_record must have a fixed size");
+      static_assert(sizeof(stack_entry_record) == 96, "binary::stack_entry_record must have a fixed size");
+
+      /// \brief A read-only view on a binary file in memory (or mmap()-ed). Nothing is copied, nothing is parsed.
+      /// All the accessors check the offsets and return nullptr if the file is corrupted.
+      class view
+      {
+        public:
+          view(const void *_memory, size_t _size) : memory(reinterpret_cast<const uint8_t *>(_memory)), size(_size) {}
+
+          /// \brief Check the header (magic, version, size)
+          bool is_valid() const;
+
+          const file_header &get_header() const { return *reinterpret_cast<const file_header *>(memory); }
+
+          /// \brief Return the string at index (nullptr if out of range)
+          const char *get_string(uint64_t index, size_t *string_size = nullptr) const;
+
+          const data_record *get_data(size_t index) const { return get_array<data_record>(get_header().data_offset, get_header().data_count, index); }
+
+          /// \note With a version 1 file, only the first call_info_record_v1_size bytes of the record are valid
+          const call_info_record *get_call_info(const data_record &d, size_t index) const
+          {
+            if (get_header().version < 2)
+              return get_array<call_info_record>(d.func_info_offset, d.func_info_count, index, call_info_record_v1_size);
+            return get_array<call_info_record>(d.func_info_offset, d.func_info_count, index);
+          }
+          const stack_record *get_stack(const data_record &d, size_t index) const { return get_array<stack_record>(d.callgraph_offset, d.callgraph_count, index); }
+          const stack_entry_record *get_stack_entry(const stack_record &s, size_t index) const { return get_array<stack_entry_record>(s.entry_offset, s.entry_count, index); }
+
+          /// \brief Return the children array of a stack entry (children_count entries)
+          const uint32_t *get_children(const stack_entry_record &se) const { return get_array<uint32_t>(se.children_offset, se.children_count, 0); }
+
+          /// \brief Decode the variable-sized parts of a stack entry (progressions, fails, reports, sequences, measure points, histograms)
+          bool decode_details(const stack_entry_record &se, internal::stack_entry &entry) const;
+
+          /// \brief Decode the variable-sized parts of a call_info_struct (histograms). Does nothing for a version 1 file.
+          bool decode_details(const call_info_record &cir, internal::call_info_struct &cis) const;
+
+        private:
+          template<typename Type>
+          const Type *get_array(uint64_t offset, uint64_t count, size_t index, size_t stride = sizeof(Type)) const
+          {
+            if (offset % alignof(Type) || offset > size || count > (size - offset) / stride || (index >= count && count))
+              return nullptr;
+            if (!count)
+              return index ? nullptr : reinterpret_cast<const Type *>(memory + offset);
+            return reinterpret_cast<const Type *>(memory + offset + index * stride);
+          }
+
+        private:
+          const uint8_t *memory;
+          size_t size;
+      };
+
+      /// \brief A file mapped in memory (read-only, mmap()-ed when possible)
+      /// Stashes that have not been decoded yet keep their file alive (the file is always replaced by a rename(), never modified in place)
+      class mapped_file
+      {
+        public:
+          /// \brief Map a file. Return nullptr if the file cannot be read or is empty
+          static std::shared_ptr<const mapped_file> open(const std::string &path);
+
+          mapped_file(const mapped_file &) = delete;
+          mapped_file &operator = (const mapped_file &) = delete;
+          ~mapped_file();
+
+          const void *get_memory() const { return memory; }
+          size_t get_size() const { return size; }
+          view get_view() const { return view(memory, size); }
+
+        private:
+          mapped_file() = default;
+
+        private:
+          const void *memory = nullptr;
+          size_t size = 0;
+          bool is_mapped = false; // else, memory has been allocated with new []
+      };
+
+      /// \brief Encode a stash list
+      /// \note Stashes that have not been decoded yet are copied from their file as they are (only their offsets are moved, the strings of the file keep their indexes).
+      ///       If that is not possible (stashes from another file, or from a file with an older format), they are decoded in a temporary (they remain lazy).
+      std::string encode(const std::deque<internal::data> &root);
+
+      /// \brief Decode a whole file into a stash list
+      /// \param[in] lazy_source If not null (it must be the file of the view), only the last stash (the active one) is decoded.
+      ///                        The others only have their name, timestamp and launch count, and are decoded by internal::load_stash() when needed.
+      /// \return nullptr if the file is not valid
+      std::deque<internal::data> *decode(const view &file, const std::shared_ptr<const mapped_file> &lazy_source = nullptr);
+
+      /// \brief Decode the stash at index of a file
+      bool decode_data(const view &file, size_t index, internal::data &d);
+    } // namespace binary
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_19069662631925001346_1795791897__BINARY_FORMAT_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
@@ -31,6 +31,7 @@
 #include <map>
 
 #include "func_descriptor.hpp"
+#include "histogram.hpp"
 #include "type.hpp"
 
 namespace neam
@@ -56,6 +57,46 @@ namespace neam
         uint64_t average_self_time_count = 0; ///< \brief Number of time the self_time has been monitored
         double average_global_time = 0; ///< \brief The average time consumed by the whole function call (including all its children)
         uint64_t average_global_time_count = 0; ///< \brief Number of time the global_time has been monitored
+
+        duration_histogram self_time_histogram = duration_histogram(); ///< \brief The distribution of the self_time
+        duration_histogram global_time_histogram = duration_histogram(); ///< \brief The distribution of the global_time
+
+        double exemplar_threshold = 0; ///< \brief The duration over which a root call is kept as an exemplar (0: the p99 of global_time_histogram). Not saved.
+
+        bool hash_collision = false; ///< \brief Another function of the data has the same key_hash: the key names have to be compared. Not saved.
+        const char *verified_key_name = nullptr; ///< \brief The last static key name that has been compared equal to descr.key_name (it isn't compared again). Not saved.
+      };
+
+      /// \brief Per-thread counters for a call_info_struct that have not yet been merged into the global data
+      /// \see thread_local_data
+      struct call_info_accumulator
+      {
+        uint64_t call_count = 0; ///< \brief The number of call since the last merge
+        uint64_t fail_count = 0; ///< \brief The number of failures since the last merge
+
+        double self_time_sum = 0; ///< \brief The sum of the monitored self times since the last merge
+        uint64_t self_time_count = 0; ///< \brief Number of time the self_time has been monitored since the last merge
+        double global_time_sum = 0; ///< \brief The sum of the monitored global times since the last merge
+        uint64_t global_time_count = 0; ///< \brief Number of time the global_time has been monitored since the last merge
+
+        duration_histogram self_time_histogram = duration_histogram(); ///< \brief The distribution of the self_time since the last merge
+        duration_histogram global_time_histogram = duration_histogram(); ///< \brief The distribution of the global_time since the last merge
+
+        size_t sample_countdown = 0; ///< \brief The number of calls before the next timed one (when sampling, not reset by clear())
+        double exemplar_threshold = -1; ///< \brief The exemplar threshold of the call_info_struct at the last merge (-1 if none, not reset by clear())
+
+        /// \brief Reset the counters (the histograms keep their memory)
+        void clear()
+        {
+          call_count = 0;
+          fail_count = 0;
+          self_time_sum = 0;
+          self_time_count = 0;
+          global_time_sum = 0;
+          global_time_count = 0;
+          self_time_histogram.clear();
+          global_time_histogram.clear();
+        }
       };
     } // namespace internal
   } // namespace r
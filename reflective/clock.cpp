@@ -0,0 +1,88 @@
+
+#include <ctime>
+#include <chrono>
+
+#include "clock.hpp"
+
+#if N_R_HAS_TSC && !defined(_MSC_VER)
+# include <cpuid.h>
+#endif
+
+namespace
+{
+  static constexpr double calibration_duration = 0.01; // in seconds
+  static constexpr double coarse_time_period = 0.1; // in seconds
+
+  static bool _has_invariant_tsc()
+  {
+#if N_R_HAS_TSC
+# ifdef _MSC_VER
+    int regs[4] = {0};
+    __cpuid(regs, 0x80000000);
+    if (unsigned(regs[0]) < 0x80000007u)
+      return false;
+    __cpuid(regs, 0x80000007);
+    return (regs[3] & (1 << 8)) != 0;
+# else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007u)
+      return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1 << 8)) != 0;
+# endif
+#else
+    return false;
+#endif
+  }
+} // namespace
+
+uint64_t neam::r::internal::clock::get_fallback_ticks()
+{
+#if defined(CLOCK_MONOTONIC_RAW)
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+#else
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+neam::r::internal::clock::calibration neam::r::internal::clock::calibrate()
+{
+  calibration ret = {false, 1e-9};
+#if N_R_HAS_TSC
+  if (!_has_invariant_tsc())
+    return ret;
+
+  // spin against the fallback clock
+  const uint64_t ns_start = get_fallback_ticks();
+  const uint64_t tsc_start = __rdtsc();
+  uint64_t ns_end = ns_start;
+  uint64_t tsc_end = tsc_start;
+  while (double(ns_end - ns_start) * 1e-9 < calibration_duration)
+  {
+    ns_end = get_fallback_ticks();
+    tsc_end = __rdtsc();
+  }
+  if (tsc_end <= tsc_start)
+    return ret;
+
+  ret.use_tsc = true;
+  ret.seconds_per_tick = double(ns_end - ns_start) * 1e-9 / double(tsc_end - tsc_start);
+#endif
+  return ret;
+}
+
+int64_t neam::r::internal::clock::get_coarse_time()
+{
+  thread_local int64_t cached_time = 0;
+  thread_local uint64_t next_refresh = 0;
+
+  const uint64_t now = get_ticks();
+  if (!cached_time || now >= next_refresh)
+  {
+    cached_time = time(nullptr);
+    next_refresh = now + uint64_t(coarse_time_period / get_calibration().seconds_per_tick);
+  }
+  return cached_time;
+}
@@ -0,0 +1,147 @@
+//
+// file : clock.hpp
+// in : file:///home/tim/projects/reflective/reflective/clock.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 22:14:05
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_10087297454309550045_1893435308__CLOCK_HPP__
+# define __N_10087297454309550045_1893435308__CLOCK_HPP__
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# include <x86intrin.h>
+# define N_R_HAS_TSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <intrin.h>
+# define N_R_HAS_TSC 1
+#else
+# define N_R_HAS_TSC 0
+#endif
+
+namespace neam
+{
+  namespace r
+  {
+    namespace internal
+    {
+      /// \brief The clock used for all the timings of reflective
+      /// On x86 with an invariant TSC, ticks are read with rdtsc (a handful of cycles, no vDSO call).
+      /// Elsewhere (or with a TSC that is not invariant), ticks are nanoseconds of clock_gettime(CLOCK_MONOTONIC_RAW) (or of std::chrono::steady_clock).
+      /// Ticks are converted to seconds with a factor that is calibrated once, the first time the clock is used.
+      namespace clock
+      {
+        struct calibration
+        {
+          bool use_tsc; ///< \brief Whether the ticks are TSC ticks or nanoseconds
+          double seconds_per_tick;
+        };
+
+        /// \brief Calibrate the clock (this spins a few milliseconds when the TSC is used)
+        /// \note Do not call this directly, use get_calibration()
+        calibration calibrate();
+
+        /// \brief Return the calibration of the clock (calibrated on the first call)
+        inline const calibration &get_calibration()
+        {
+          static const calibration calib = calibrate();
+          return calib;
+        }
+
+        /// \brief Return the ticks of the fallback clock (nanoseconds)
+        uint64_t get_fallback_ticks();
+
+        /// \brief Return the current tick count
+        inline uint64_t get_ticks()
+        {
+#if N_R_HAS_TSC
+          if (get_calibration().use_tsc)
+            return __rdtsc();
+#endif
+          return get_fallback_ticks();
+        }
+
+        /// \brief Convert a tick count to seconds
+        inline double to_seconds(uint64_t ticks)
+        {
+          return double(ticks) * get_calibration().seconds_per_tick;
+        }
+
+        /// \brief Return a cached wall-clock time (seconds since the epoch), refreshed at most every ~100ms per thread.
+        /// This is what timestamps the progressions and the reasons.
+        int64_t get_coarse_time();
+      } // namespace clock
+
+      /// \brief A pausable chrono on the clock. Unlike cr::chrono it does not read the clock when constructed
+      struct tick_chrono
+      {
+        uint64_t start = 0;
+        uint64_t accumulated = 0;
+        bool paused = false;
+
+        /// \brief (Re)start the chrono
+        void reset()
+        {
+          accumulated = 0;
+          paused = false;
+          start = clock::get_ticks();
+        }
+
+        void pause()
+        {
+          if (!paused)
+          {
+            accumulated += clock::get_ticks() - start;
+            paused = true;
+          }
+        }
+
+        void resume()
+        {
+          if (paused)
+          {
+            start = clock::get_ticks();
+            paused = false;
+          }
+        }
+
+        /// \brief Return the accumulated time, in ticks
+        uint64_t get_accumulated_ticks() const
+        {
+          if (paused)
+            return accumulated;
+          return accumulated + (clock::get_ticks() - start);
+        }
+
+        /// \brief Return the accumulated time, in seconds
+        double get_accumulated_time() const
+        {
+          return clock::to_seconds(get_accumulated_ticks());
+        }
+      };
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_10087297454309550045_1893435308__CLOCK_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
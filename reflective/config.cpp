@@ -9,9 +9,12 @@ namespace neam
     {
       bool monitor_self_time = false;
       bool monitor_global_time = false;
+      size_t sampling_ratio = 1;
       const char *out_file = "./.out.nr";
       bool disable_auto_save = false;
       bool cleanup_on_crash = true;
+      bool safe_crash_dump = true;
+      size_t crash_dump_size = 256 * 1024;
 
       bool watch_uncaught_exceptions = true;
       bool integrate_with_n_debug = true;
@@ -24,6 +27,33 @@ namespace neam
       float progression_min_factor = 10.f;
       size_t max_progression_entries = 25;
 
+      bool async_load = false;
+
+      bool binary_format = true;
+
+      bool background_flush = false;
+      size_t flush_min_interval = 1000;
+      size_t flush_max_staleness = 10000;
+
+      bool use_journal = false;
+      size_t journal_max_size = 16 * 1024 * 1024;
+
+      const char *live_profile = nullptr;
+      size_t live_profile_interval = 100;
+      unsigned live_profile_mode = 0600;
+
+      const char *trace_file = nullptr;
+      size_t trace_buffer_size = 16384;
+      size_t trace_drain_interval = 100;
+
+      bool exemplars = false;
+      size_t exemplar_max_calls = 4096;
+      size_t max_exemplars = 8;
+      size_t exemplar_min_samples = 100;
+
+      bool arena_huge_pages = false;
+      size_t arena_chunk_size = 2 * 1024 * 1024;
+
       long max_stash_count = 5;
     } // namespace conf
   } // namespace r
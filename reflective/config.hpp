@@ -36,6 +36,8 @@ namespace neam
     {
       extern bool monitor_self_time/* = false*/;
       extern bool monitor_global_time/* = false*/;
+      extern size_t sampling_ratio; ///< \brief Only one call in sampling_ratio is timed (every call is still counted). Default is 1 (every call is timed).
+                                    /// \note This can be overridden per call site (see N_PRETTY_FUNCTION_INFO_SAMPLED())
       extern const char *out_file/* = "./.out.nr"*/;
       extern bool disable_auto_save/* = false*/; ///< \brief Whether or not the last function_call on the stack will trigger a save at its destruction
       extern bool cleanup_on_crash/* = true*/; ///< \brief Whether or not, when a signal is caught, reflective will cleanup its stack(s).
@@ -44,6 +46,11 @@ namespace neam
                                                /// \note This may result in multiple saves. If you have issues with spurious crashs / data corruption,
                                                ///       you may want to disable this feature.
 
+      extern bool safe_crash_dump; ///< \brief Whether or not, when a signal is caught, reflective only writes an async-signal-safe crash dump (out_file + ".crash")
+                                   ///         that is merged into the data on the next launch, instead of saving (and cleaning-up) with the heap in an unknown state.
+                                   ///         Default is true. cleanup_on_crash is only used when this is false.
+      extern size_t crash_dump_size; ///< \brief The size (in bytes) of the crash dump buffer, preallocated by prepare_crash_dump(). Default is 256KiB.
+
       extern bool watch_uncaught_exceptions; ///< \brief Whether or not the function_call destructor will watch for uncaught exception (default is true).
                                              /// \note uncaught exception are only reported in the first function that encounter them. The file/line of
                                              ///       the failure reason is the file/line where the function_call object is created for this function (if available)
@@ -54,10 +61,50 @@ namespace neam
 
       extern bool sliding_average; ///< \brief If the average will be a sliding average or a "true" average. The default is true (sliding average).
       extern size_t past_average_weight; ///< \brief The maximum weight for past value (only used when the sliding average is activated).
+                                         /// \note Per-thread counters are merged by batches. A batch weights at most past_average_weight + 1 samples.
 
       extern float progression_min_factor; ///< \brief The minimum variation factor in an average variable for it to be pushed in the progression vector. Default is x10.
       extern size_t max_progression_entries; ///< \brief The maximum entries in the progression vectors (default is somewhere between 25 and 50)
 
+      extern bool async_load; ///< \brief Whether or not the data of out_file is loaded by a background thread when reflective is initialized.
+                              ///         Recording starts right away in a fresh data, and the loaded data is merged into it (by function) once it is ready.
+                              ///         Default is false.
+                              /// \note The automatic sync (the end of a root function_call) is done by the loading thread when it happens before the load completes.
+                              ///       An explicit sync_data_to_disk() waits for the load to complete.
+
+      extern bool binary_format; ///< \brief Whether or not out_file is written with the binary format (see binary_format.hpp) instead of JSON. Default is true.
+                                 /// \note load_data_from_disk() reads both formats, and get_data_as_json() is always available to export the data.
+
+      extern bool background_flush; ///< \brief Whether or not the syncs triggered by the last function_call on the stack are done by a background thread.
+                                    ///         Instrumented threads then never block on file I/O or serialization. Default is false.
+      extern size_t flush_min_interval; ///< \brief The minimum time (in milliseconds) between two background flushes. Default is 1000.
+      extern size_t flush_max_staleness; ///< \brief The maximum time (in milliseconds) between two background flushes, even when no function_call has
+                                         ///         ended on the stack (a flush only writes if something has changed). 0 disables it. Default is 10000.
+
+      extern bool use_journal; ///< \brief Whether or not syncs only append what has changed to a journal (out_file + ".journal") instead of rewriting out_file.
+                               ///         The journal is compacted into out_file by a background thread. Default is false.
+      extern size_t journal_max_size; ///< \brief The size (in bytes) of the journal that triggers a compaction. Default is 16MiB.
+
+      extern const char *live_profile; ///< \brief The name of the shared memory segment of the live profile (see live_profile.hpp). nullptr or "" disables it. Default is nullptr.
+      extern size_t live_profile_interval; ///< \brief The time (in milliseconds) between two publications of the live profile. Default is 100.
+      extern unsigned live_profile_mode; ///< \brief The permissions of the shared memory segment of the live profile (it holds the function names, files and reasons).
+                                         ///         Default is 0600 (only the user running the program can read it).
+
+      extern const char *trace_file; ///< \brief The file where the timeline of the calls is written (see trace.hpp). nullptr or "" disables it. Default is nullptr.
+      extern size_t trace_buffer_size; ///< \brief The number of events of the per-thread ring buffers of the trace (rounded up to a power of 2). Default is 16384.
+      extern size_t trace_drain_interval; ///< \brief The time (in milliseconds) between two drains of the ring buffers in trace_file. Default is 100.
+
+      extern bool exemplars; ///< \brief Whether or not each thread records the call tree of its root calls, and keeps it (as an exemplar of the root stack_entry)
+                             ///         when the root call is slower than the exemplar threshold of its function: the one set with introspect::set_exemplar_threshold(),
+                             ///         or the p99 of its duration (this needs monitor_global_time). Fast root calls are simply discarded. Default is false.
+      extern size_t exemplar_max_calls; ///< \brief The maximum number of calls recorded for a root call (the others are only counted). Default is 4096.
+      extern size_t max_exemplars; ///< \brief The maximum number of exemplars kept per root stack_entry (the slowest ones are kept). Default is 8.
+      extern size_t exemplar_min_samples; ///< \brief The number of samples the duration of a function must have before its p99 is used as threshold. Default is 100.
+
+      extern bool arena_huge_pages; ///< \brief Whether or not the arena the callgraphs are allocated in (see arena.hpp) asks for huge pages (explicit ones if the system has some,
+                                    ///         transparent ones otherwise). Default is false.
+      extern size_t arena_chunk_size; ///< \brief The minimum size (in bytes) of the chunks the arena asks the system for (rounded up to 2MiB). Default is 2MiB.
+
       extern long max_stash_count; ///< \brief Default is somewhere around 5. It's the maximum number of stashes to keep. -1 mean no limit. Minimum is 2.
     } // namespace conf
   } // namespace r
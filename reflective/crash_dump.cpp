@@ -0,0 +1,427 @@
+
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <csignal>
+#include <cstdio>
+#include <cerrno>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/stat.h>
+#endif
+
+#include "tools/logger/logger.hpp"
+#include "crash_dump.hpp"
+#include "function_call.hpp"
+#include "storage.hpp"
+#include "config.hpp"
+
+// The crash dump is: [crash_header] [crash_frame + strings] x frame_count (top of the stack first) [crash_counter] x counter_count
+// Everything is 8-byte aligned.
+
+namespace
+{
+  static constexpr uint32_t crash_magic = 0x43524E2E; // ".NRC"
+  static constexpr uint32_t crash_version = 1;
+  static constexpr uint32_t max_string_size = 255; // strings are truncated to that size
+
+  struct crash_header
+  {
+    uint32_t magic;
+    uint32_t version;
+    int32_t signal;
+    uint32_t frame_count;
+    int64_t timestamp;
+    int64_t data_index; ///< \brief Index of the global data in the stash list (-1 if unknown)
+    uint64_t counter_count;
+    uint64_t size;
+  };
+
+  struct crash_frame
+  {
+    uint64_t call_info_index;
+    uint64_t key_hash;
+    uint64_t line;
+    uint32_t name_size;
+    uint32_t key_name_size;
+    uint32_t file_size;
+    uint32_t _padding;
+    // followed by the name, the key_name and the file (not null-terminated), padded to 8 bytes
+  };
+
+  /// \brief Absolute values of the call_info_struct counters at the time of the crash
+  struct crash_counter
+  {
+    uint64_t call_count;
+    uint64_t fail_count;
+  };
+
+  char *dump_buffer = nullptr;
+  size_t dump_buffer_size = 0;
+  char dump_path[4096] = {0};
+
+  // the call_info_structs whose counters are dumped (see publish_func_info()): the handler never reads data::func_info,
+  // as it may be in the middle of a push_back() on another thread
+  const neam::r::internal::call_info_struct **published_func_info = nullptr;
+  size_t published_func_info_capacity = 0;
+  std::atomic<const neam::r::internal::data *> published_owner(nullptr);
+  std::atomic<size_t> published_func_count(0);
+  std::mutex publish_lock; // never taken by the handler
+
+  static inline size_t align8(size_t sz) { return (sz + 7) & ~size_t(7); }
+  static inline uint32_t truncated_size(const std::string &str) { return uint32_t(std::min<size_t>(str.size(), max_string_size)); }
+
+  /// \brief Compare a string with one that may have been truncated to max_string_size by the crash handler
+  static inline bool truncated_equal(const std::string &str, const std::string &truncated)
+  {
+    if (truncated.size() < max_string_size)
+      return str == truncated;
+    return str.size() >= truncated.size() && !str.compare(0, truncated.size(), truncated);
+  }
+
+  /// \brief Like func_descriptor::operator ==, but the strings of the frame may be truncated (and it has no pretty name)
+  static bool frame_matches(const neam::r::func_descriptor &descr, const neam::r::func_descriptor &frame)
+  {
+    if (descr.key_hash && frame.key_hash && descr.key_hash != frame.key_hash)
+      return false;
+    if (!descr.key_name.empty() && !frame.key_name.empty())
+      return truncated_equal(descr.key_name, frame.key_name);
+    if (descr.key_hash && frame.key_hash)
+      return true;
+    if (!descr.file.empty() && !frame.file.empty() && descr.line && frame.line)
+      return descr.line == frame.line && truncated_equal(descr.file, frame.file);
+    if (!descr.name.empty() && !frame.name.empty())
+      return truncated_equal(descr.name, frame.name);
+    return false;
+  }
+
+  /// \brief Write the whole buffer (async-signal-safe)
+  static bool write_all(int fd, const char *buffer, size_t size)
+  {
+    while (size)
+    {
+#ifdef _WIN32
+      const int ret = _write(fd, buffer, (unsigned)size);
+#else
+      const ssize_t ret = write(fd, buffer, size);
+#endif
+      if (ret < 0 && errno == EINTR)
+        continue;
+      if (ret <= 0)
+        return false;
+      buffer += ret;
+      size -= ret;
+    }
+    return true;
+  }
+
+  static neam::r::reason get_signal_reason(int sig)
+  {
+    switch (sig)
+    {
+      case SIGSEGV: return neam::r::segfault_reason;
+      case SIGABRT: return neam::r::abort_reason;
+      case SIGFPE: return neam::r::floating_point_exception_reason;
+      case SIGILL: return neam::r::illegal_instruction_reason;
+      case SIGINT: return neam::r::keyboard_interrupt_reason;
+      default: return neam::r::unknown_signal_reason;
+    }
+  }
+} // namespace
+
+void neam::r::internal::prepare_crash_dump(const std::string &file)
+{
+  const std::string path = file + ".crash";
+  if (path.size() >= sizeof(dump_path))
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Path too long for the crash dump: '" << path << "'" << std::endl;
+    return;
+  }
+
+  if (dump_buffer_size != conf::crash_dump_size)
+  {
+    delete [] dump_buffer;
+    dump_buffer = nullptr;
+    dump_buffer_size = 0;
+    if (conf::crash_dump_size < sizeof(crash_header))
+      return;
+    dump_buffer = new char[conf::crash_dump_size];
+    dump_buffer_size = conf::crash_dump_size;
+    memset(dump_buffer, 0, dump_buffer_size); // make sure the pages are there
+
+    // there's no need to publish more counters than what fits in the buffer
+    std::lock_guard<std::mutex> _u0(publish_lock);
+    delete [] published_func_info;
+    published_func_info_capacity = (dump_buffer_size - sizeof(crash_header)) / sizeof(crash_counter);
+    published_func_info = new const call_info_struct *[published_func_info_capacity];
+    published_func_count.store(0, std::memory_order_release);
+    published_owner.store(nullptr, std::memory_order_release);
+  }
+  memcpy(dump_path, path.c_str(), path.size() + 1);
+}
+
+void neam::r::internal::publish_func_info(const data &d)
+{
+  std::lock_guard<std::mutex> _u0(publish_lock);
+  if (!published_func_info)
+    return;
+
+  size_t count = published_func_count.load(std::memory_order_relaxed);
+  if (published_owner.load(std::memory_order_relaxed) != &d)
+  {
+    published_func_count.store(0, std::memory_order_release);
+    published_owner.store(&d, std::memory_order_release);
+    count = 0;
+  }
+
+  const size_t target = std::min<size_t>(d.func_info.size(), published_func_info_capacity);
+  if (count >= target)
+    return;
+  for (; count < target; ++count)
+    published_func_info[count] = &d.func_info[count];
+  published_func_count.store(count, std::memory_order_release);
+}
+
+void neam::r::internal::forget_published_func_info()
+{
+  std::lock_guard<std::mutex> _u0(publish_lock);
+  published_func_count.store(0, std::memory_order_release);
+  published_owner.store(nullptr, std::memory_order_release);
+}
+
+bool neam::r::internal::write_crash_dump(int sig)
+{
+  if (!dump_buffer || !dump_path[0])
+    return false;
+
+  long data_index = -1;
+  data *global = peek_global_data(data_index);
+  thread_local_data *tl = peek_thread_data(); // nullptr if this thread never recorded anything
+
+  crash_header header;
+  header.magic = crash_magic;
+  header.version = crash_version;
+  header.signal = sig;
+  header.frame_count = 0;
+  header.timestamp = time(nullptr);
+  header.data_index = data_index;
+  header.counter_count = 0;
+
+  size_t offset = sizeof(crash_header);
+
+  // the active stack
+  for (basic_function_call *fc = tl ? tl->top : nullptr; fc && fc->global == global; fc = fc->prev)
+  {
+    const func_descriptor &descr = fc->call_info.descr;
+    crash_frame frame;
+    frame.call_info_index = fc->call_info_index;
+    frame.key_hash = descr.key_hash;
+    frame.line = descr.line;
+    frame.name_size = truncated_size(descr.name);
+    frame.key_name_size = truncated_size(descr.key_name);
+    frame.file_size = truncated_size(descr.file);
+    frame._padding = 0;
+
+    const size_t size = align8(sizeof(crash_frame) + frame.name_size + frame.key_name_size + frame.file_size);
+    if (offset + size > dump_buffer_size)
+      break;
+
+    char *it = dump_buffer + offset;
+    memcpy(it, &frame, sizeof(crash_frame));
+    it += sizeof(crash_frame);
+    memcpy(it, descr.name.data(), frame.name_size);
+    it += frame.name_size;
+    memcpy(it, descr.key_name.data(), frame.key_name_size);
+    it += frame.key_name_size;
+    memcpy(it, descr.file.data(), frame.file_size);
+
+    offset += size;
+    ++header.frame_count;
+  }
+
+  // the counters (the merged ones + the pending ones of this thread)
+  const size_t count = published_func_count.load(std::memory_order_acquire);
+  if (global && published_owner.load(std::memory_order_acquire) == global)
+  {
+    const bool has_accumulators = (tl && tl->owner == global);
+    for (size_t i = 0; i < count && offset + sizeof(crash_counter) <= dump_buffer_size; ++i)
+    {
+      crash_counter counter = {published_func_info[i]->call_count, published_func_info[i]->fail_count};
+      if (has_accumulators && i < tl->accumulators.size())
+      {
+        counter.call_count += tl->accumulators[i].call_count;
+        counter.fail_count += tl->accumulators[i].fail_count;
+      }
+      memcpy(dump_buffer + offset, &counter, sizeof(crash_counter));
+      offset += sizeof(crash_counter);
+      ++header.counter_count;
+    }
+  }
+
+  header.size = offset;
+  memcpy(dump_buffer, &header, sizeof(crash_header));
+
+#ifdef _WIN32
+  const int fd = _open(dump_path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+  const int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+#endif
+  if (fd < 0)
+    return false;
+#ifndef _WIN32
+  fchmod(fd, 0600); // an older dump may have been created with a wider mode (the stack may hold sensitive names)
+#endif
+  const bool ret = write_all(fd, dump_buffer, offset);
+#ifdef _WIN32
+  _close(fd);
+#else
+  close(fd);
+#endif
+  return ret;
+}
+
+bool neam::r::internal::apply_crash_dump(const std::string &file, std::deque<data> &root)
+{
+  const std::string path = file + ".crash";
+  std::ifstream inf(path, std::ios_base::binary);
+  if (!inf)
+    return false;
+
+  inf.seekg(0, std::ios_base::end);
+  const int64_t size = inf.tellg();
+  inf.seekg(0, std::ios_base::beg);
+  if (size < int64_t(sizeof(crash_header)))
+    return false;
+
+  std::vector<uint64_t> memory(align8(size) / sizeof(uint64_t)); // 8-byte aligned
+  const char *buffer = reinterpret_cast<const char *>(memory.data());
+  inf.read(reinterpret_cast<char *>(memory.data()), size);
+
+  crash_header header;
+  memcpy(&header, buffer, sizeof(crash_header));
+  if (!inf || header.magic != crash_magic || header.version != crash_version || header.size != uint64_t(size))
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Ignoring the crash dump '" << path << "': invalid or truncated file" << std::endl;
+    return false;
+  }
+
+  // read the frames (top of the stack first)
+  std::vector<std::pair<uint64_t, func_descriptor>> frames;
+  size_t offset = sizeof(crash_header);
+  for (uint32_t i = 0; i < header.frame_count; ++i)
+  {
+    crash_frame frame;
+    if (offset + sizeof(crash_frame) > uint64_t(size))
+      return false;
+    memcpy(&frame, buffer + offset, sizeof(crash_frame));
+    const size_t strings_size = size_t(frame.name_size) + frame.key_name_size + frame.file_size;
+    if (offset + sizeof(crash_frame) + strings_size > uint64_t(size))
+      return false;
+
+    const char *it = buffer + offset + sizeof(crash_frame);
+    const std::string name(it, frame.name_size);
+    const std::string key_name(it + frame.name_size, frame.key_name_size);
+    const std::string file_name(it + frame.name_size + frame.key_name_size, frame.file_size);
+    frames.emplace_back(frame.call_info_index, func_descriptor{name, std::string(), file_name, frame.line, key_name, decltype(func_descriptor::key_hash)(frame.key_hash)});
+    offset += align8(sizeof(crash_frame) + strings_size);
+  }
+  if (offset + header.counter_count * sizeof(crash_counter) > uint64_t(size))
+    return false;
+
+  if (root.empty())
+    root.emplace_back();
+  data &d = (header.data_index >= 0 && uint64_t(header.data_index) < root.size()) ? root[header.data_index] : root.back();
+  load_stash(d);
+
+  // the counters: those are absolute values, and the file is the last good sync of the same data
+  for (size_t i = 0; i < header.counter_count && i < d.func_info.size(); ++i)
+  {
+    crash_counter counter;
+    memcpy(&counter, buffer + offset + i * sizeof(crash_counter), sizeof(crash_counter));
+    d.func_info[i].call_count = std::max(d.func_info[i].call_count, counter.call_count);
+    d.func_info[i].fail_count = std::max(d.func_info[i].fail_count, counter.fail_count);
+  }
+
+  if (frames.empty())
+    return true;
+
+  // re-create the crashed stack (from the root)
+  auto resolve = [&d](const std::pair<uint64_t, func_descriptor> &frame) -> uint64_t
+  {
+    // the index published by the crashed process is almost always the right one (the file is the last good sync of the same data)
+    if (frame.first < d.func_info.size() && frame_matches(d.func_info[frame.first].descr, frame.second))
+      return frame.first;
+    for (size_t i = 0; i < d.func_info.size(); ++i)
+    {
+      if (frame_matches(d.func_info[i].descr, frame.second))
+        return i;
+    }
+    d.func_info.emplace_back(call_info_struct{frame.second});
+    d.func_info.back().call_count = 1;
+    return d.func_info.size() - 1;
+  };
+
+  stack_entry *entry = nullptr;
+  uint64_t func_index = 0;
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+  {
+    func_index = resolve(*it);
+    if (!entry)
+    {
+      uint64_t stack_index = 0;
+      while (stack_index < d.callgraph.size() && (d.callgraph[stack_index].empty() || d.callgraph[stack_index][0].call_structure_index != func_index))
+        ++stack_index;
+      if (stack_index == d.callgraph.size())
+      {
+        d.callgraph.emplace_back();
+        d.callgraph.back().emplace_back(stack_entry{0, stack_index, func_index, 0});
+      }
+      entry = &d.callgraph[stack_index][0];
+      continue;
+    }
+
+    stack_entry_list &graph = d.callgraph[entry->stack_index];
+    stack_entry *child = nullptr;
+    for (uint64_t child_index : entry->children)
+    {
+      if (graph[child_index].call_structure_index == func_index)
+      {
+        child = &graph[child_index];
+        break;
+      }
+    }
+    if (!child)
+    {
+      const uint64_t index = graph.size();
+      entry->children.push_back(index);
+      graph.emplace_back(stack_entry{index, entry->stack_index, func_index, entry->self_index});
+      child = &graph.back();
+    }
+    entry = child;
+  }
+
+  // and report the crash on its top
+  const reason rsn = get_signal_reason(header.signal);
+  entry->fail_count++;
+  d.func_info[func_index].fail_count++;
+  entry->cold.get_or_create().fails.push_back(reason{rsn.type, "the program crashed (recovered from the crash dump)", std::string(), 0, 1, header.timestamp, header.timestamp});
+
+  neam::cr::out.log() << LOGGER_INFO << "Applied the crash dump '" << path << "'" << std::endl;
+  return true;
+}
+
+void neam::r::internal::remove_crash_dump(const std::string &file)
+{
+  std::remove((file + ".crash").c_str());
+}
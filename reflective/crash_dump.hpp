@@ -0,0 +1,72 @@
+//
+// file : crash_dump.hpp
+// in : file:///home/tim/projects/reflective/reflective/crash_dump.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 18:41:27
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_14251560559444937093_1495289708__CRASH_DUMP_HPP__
+# define __N_14251560559444937093_1495289708__CRASH_DUMP_HPP__
+
+#include <string>
+#include <deque>
+
+namespace neam
+{
+  namespace r
+  {
+    namespace internal
+    {
+      class data;
+
+      /// \brief Allocate the crash dump buffer (conf::crash_dump_size bytes) and compute the crash dump file name (file + ".crash")
+      /// \note This is not async-signal-safe, this is done once, when installing the signal handlers
+      void prepare_crash_dump(const std::string &file);
+
+      /// \brief Publish the call_info_structs of d whose counters go in the crash dump (d.lock must be held)
+      /// Only the entries added since the last call are published, and publishing for another data starts over.
+      /// \note This is done when a function is registered and when a thread is merged
+      void publish_func_info(const data &d);
+
+      /// \brief Forget the published call_info_structs (before the global data changes, see publish_func_info())
+      void forget_published_func_info();
+
+      /// \brief Write a compact binary snapshot of the active stack of the current thread and of the counters
+      /// This is async-signal-safe: it does not lock, does not allocate and only uses open() / write() / close()
+      /// \note Only the published counters are written (see publish_func_info()): data::func_info is never read
+      /// \return false if the crash dump has not been prepared or could not be written
+      bool write_crash_dump(int sig);
+
+      /// \brief Apply the crash dump of file (file + ".crash"), if any, on a stash list (the last good sync of file)
+      /// The counters are restored, the crashed stack is re-created if needed and a fail is added to its top function.
+      /// \note The crash dump file is not removed (see remove_crash_dump())
+      /// \return true if a crash dump has been applied
+      bool apply_crash_dump(const std::string &file, std::deque<data> &root);
+
+      /// \brief Remove the crash dump of file (once it has been applied and its data written)
+      void remove_crash_dump(const std::string &file);
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_14251560559444937093_1495289708__CRASH_DUMP_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
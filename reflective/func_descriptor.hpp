@@ -30,6 +30,7 @@
 #include <cstdint>
 
 #include <cstring>
+#include <string>
 
 #include "id_gen.hpp"
 
@@ -37,12 +38,49 @@ namespace neam
 {
   namespace r
   {
+    /// \brief A non-owning string (a pointer and a size). It never allocates.
+    /// \note A nullptr string is an empty string
+    struct static_string
+    {
+      constexpr static_string() : str(nullptr), size(0) {}
+      constexpr static_string(const char *_str, size_t _size) : str(_str), size(_size) {}
+      /// \brief The size is computed at runtime, prefer the other constructor for string literals (see N__I__SSTR)
+      constexpr static_string(const char *_str) : str(_str), size(_strlen(_str)) {}
+
+      const char *str;
+      size_t size;
+
+      constexpr bool empty() const { return !size; }
+
+      /// \brief Copy the string (this allocates)
+      std::string to_string() const { return size ? std::string(str, size) : std::string(); }
+
+      bool operator == (const static_string &o) const { return size == o.size && (!size || !memcmp(str, o.str, size)); }
+      bool operator == (const std::string &o) const { return size == o.size() && (!size || !memcmp(str, o.data(), size)); }
+      template<typename Other> bool operator != (const Other &o) const { return !(*this == o); }
+
+      private:
+        static constexpr size_t _strlen(const char *s)
+        {
+          size_t i = 0;
+          if (s)
+          {
+            while (s[i])
+              ++i;
+          }
+          return i;
+        }
+    };
+
+    static inline bool operator == (const std::string &a, const static_string &b) { return b == a; }
+    static inline bool operator != (const std::string &a, const static_string &b) { return !(b == a); }
+
     /// \brief Describe a function
     /// This is used to store/retrieve information to/from the function DB
     struct func_descriptor
     {
 #ifdef _MSC_VER
-      func_descriptor(const std::string &_name, const std::string &_pretty_name = std::string(), const std::string &_file = std::string(), uint64_t _line = 0, const std::string &_key_name = std::string(), uint32_t _key_hash = 0)
+      func_descriptor(const std::string &_name, const std::string &_pretty_name = std::string(), const std::string &_file = std::string(), uint64_t _line = 0, const std::string &_key_name = std::string(), uint64_t _key_hash = 0)
         : name(_name), pretty_name(_pretty_name), file(_file), line(_line), key_name(_key_name), key_hash(_key_hash)
       {}
 #endif
@@ -53,19 +91,19 @@ namespace neam
       uint64_t line = 0; ///< \brief The line of the fiel
 
       std::string key_name = std::string(); ///< \brief Used as unique ID to compare
-      uint32_t key_hash = 0; ///< \brief Used to fast, compare the unique ID
+      uint64_t key_hash = 0; ///< \brief The 64bit hash of the unique ID (0 means none), used as the key of the function DB index
 
-      /// \brief Comparison function
-      bool operator == (const func_descriptor &other) const
+      /// \brief Comparison function (with a func_descriptor or a static_func_descriptor)
+      /// \note Different hashes are never the same function, but as two key names may share a hash, they are compared when both descriptors have one
+      template<typename Descriptor>
+      bool operator == (const Descriptor &other) const
       {
-        if (other.key_hash && this->key_hash && (this->key_hash & 0x1) == 0) // ultra fast hash/hash comparison
-          return other.key_hash == this->key_hash; // The hash guaranteed to be unique if the first bit is not set.
+        if (other.key_hash && this->key_hash && other.key_hash != this->key_hash) // ultra fast hash/hash comparison
+          return false;
         if (!other.key_name.empty() && !this->key_name.empty()) // key/key comparison
-        {
-          if (other.key_hash && this->key_hash && other.key_hash != this->key_hash) // hash mismatch -> not the same key_name
-            return false;
           return other.key_name == this->key_name;
-        }
+        if (other.key_hash && this->key_hash) // same hash, and nothing else to compare
+          return true;
 
         if (!other.file.empty() && !this->file.empty() && other.line && this->line)
           return other.line == this->line && other.file == this->file;
@@ -80,11 +118,35 @@ namespace neam
       }
 
       /// \brief Comparison operator
-      bool operator != (const func_descriptor &other) const
+      template<typename Descriptor>
+      bool operator != (const Descriptor &other) const
       {
         return !(*this == other);
       }
     };
+
+    /// \brief The allocation-free version of func_descriptor, made of static_strings (const char * + size).
+    /// This is what the N_*_INFO macros create: with string literals everything is known at compile-time
+    /// and nothing is copied: the strings are only copied into a func_descriptor when a new call_info_struct is registered.
+    struct static_func_descriptor
+    {
+      static_string name; ///< \brief User access name
+      static_string pretty_name; ///< \brief print name
+
+      static_string file; ///< \brief The zip code
+      uint64_t line; ///< \brief The line of the fiel
+
+      static_string key_name; ///< \brief Used as unique ID to compare
+      uint64_t key_hash; ///< \brief The 64bit hash of the unique ID (0 means none), used as the key of the function DB index
+
+      uint32_t sample_ratio; ///< \brief Only one call in sample_ratio is timed at this call site (0 means conf::sampling_ratio)
+
+      /// \brief Copy the strings into a func_descriptor (this allocates)
+      func_descriptor to_func_descriptor() const
+      {
+        return func_descriptor {name.to_string(), pretty_name.to_string(), file.to_string(), line, key_name.to_string(), key_hash};
+      }
+    };
   } // namespace r
 } // namespace neam
 
@@ -6,104 +6,102 @@
 #include "function_call.hpp"
 #include "introspect.hpp"
 
-void neam::r::function_call::common_init()
+void neam::r::basic_function_call::common_init(uint32_t sample_ratio)
 {
-  {
-    std::lock_guard<internal::mutex_type> _u0(global->lock);
-    ++call_info.call_count;
-  }
-
   prev = tl_data->top;
   se = nullptr;
-  if (prev)
+  depth = prev ? prev->depth + 1 : 0;
+  if (prev && prev->self_time_monitoring)
+    prev->self_chrono.pause(); // pause the previous self-chrono
+
   {
-    if (prev->self_time_monitoring)
-      prev->self_chrono.pause(); // pause the previous self-chrono
+    std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+    internal::call_info_accumulator &acc = tl_data->get_accumulator(global, call_info_index);
+    ++acc.call_count;
 
-    // stack_entry things
-    if (prev->se)
-      se = &prev->se->push_children_call_info(call_info_index);
+    // sampling: every call is counted, but only one in sample_ratio is timed
+    const size_t ratio = sample_ratio ? sample_ratio : conf::sampling_ratio;
+    if (ratio > 1 && timing_allowed)
+    {
+      if (acc.sample_countdown)
+      {
+        --acc.sample_countdown;
+        timing_allowed = false;
+      }
+      else
+        acc.sample_countdown = ratio - 1;
+    }
+    if (!timing_allowed)
+    {
+      self_time_monitoring = false;
+      global_time_monitoring = false;
+    }
+
+    // stack_entry things (in the thread callgraph)
+    if (prev)
+    {
+      if (prev->se)
+        se = &prev->se->push_children_call_info(call_info_index);
+    }
+    else
+      se = &internal::stack_entry::initial_get_stack_entry(call_info_index);
   }
-  else
-    se = &internal::stack_entry::initial_get_stack_entry(call_info_index);
 
   if (conf::watch_uncaught_exceptions && std::uncaught_exception())
     has_exception = true;
 
   tl_data->top = this;
+
+  // start timing now (the bookkeeping above is not accounted)
+  if (self_time_monitoring)
+    self_chrono.reset();
+  if (global_time_monitoring)
+    global_chrono.reset();
+  if (internal::trace::is_enabled() || conf::exemplars)
+    start_ticks = internal::clock::get_ticks();
 }
 
-neam::r::function_call::~function_call()
+neam::r::basic_function_call::~basic_function_call()
 {
   if (tl_data->top != this)
     return;
 
-  int64_t ts = std::time(nullptr);
-
-  // Save the time monitoring (global & self)
-  // TODO: thread safety
-  if (self_time_monitoring)
+  const double self_delta = self_time_monitoring ? self_chrono.get_accumulated_time() : 0.;
+  const double global_delta = global_time_monitoring ? global_chrono.get_accumulated_time() : 0.;
+  const uint64_t end_ticks = start_ticks ? internal::clock::get_ticks() : 0;
+  if (start_ticks && internal::trace::is_enabled())
+    internal::trace::record(start_ticks, end_ticks - start_ticks, call_info.descr.key_hash, internal::trace::event_type::call);
+  if (conf::exemplars || !prev)
+    record_exemplar_call(end_ticks);
+
+  // Save the time monitoring (global & self) in the per-thread accumulator and the thread callgraph
+  // (the averages are true averages since the last merge, the sliding average is done when merging)
+  if (self_time_monitoring || global_time_monitoring)
   {
-    const double delta = self_chrono.get_accumulated_time();
+    std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+    internal::call_info_accumulator &acc = tl_data->get_accumulator(global, call_info_index);
+    if (self_time_monitoring)
     {
-      std::lock_guard<internal::mutex_type> _u0(global->lock);
-      size_t mcount = call_info.average_self_time_count;
-      if (conf::sliding_average)
-        mcount = std::min(mcount, conf::past_average_weight);
-
-      call_info.average_self_time = (call_info.average_self_time * mcount + delta) / (mcount + 1.);
-      ++call_info.average_self_time_count;
-    }
-    if (se)
-    {
-      size_t mcount = se->average_self_time_count;
-      if (conf::sliding_average)
-        mcount = std::min(mcount, conf::past_average_weight);
-
-      se->average_self_time = (se->average_self_time * mcount + delta) / (mcount + 1.);
-      ++se->average_self_time_count;
-
-      if (se->self_time_progression.empty())
-        se->self_time_progression.push_back(duration_progression{ts, se->average_self_time});
-      else if ((se->self_time_progression.back().value < se->average_global_time && se->self_time_progression.back().value * conf::progression_min_factor < se->average_self_time)
-               || (se->self_time_progression.back().value > se->average_global_time && se->self_time_progression.back().value > se->average_self_time * conf::progression_min_factor))
-        se->self_time_progression.push_back(duration_progression{ts, se->average_self_time});
-      if (se->self_time_progression.size() > conf::max_progression_entries)
+      acc.self_time_sum += self_delta;
+      ++acc.self_time_count;
+      acc.self_time_histogram.add(self_delta);
+      if (se)
       {
-        size_t diff = se->self_time_progression.size() - conf::max_progression_entries;
-        se->self_time_progression.erase(se->self_time_progression.begin(), se->self_time_progression.begin() + diff);
+        se->average_self_time += (self_delta - se->average_self_time) / double(se->average_self_time_count + 1);
+        ++se->average_self_time_count;
+        se->self_time_histogram.add(self_delta);
       }
     }
-  }
-  if (global_time_monitoring)
-  {
-    const double delta = global_chrono.get_accumulated_time();
+    if (global_time_monitoring)
     {
-      std::lock_guard<internal::mutex_type> _u0(global->lock);
-
-      size_t mcount = call_info.average_global_time_count;
-      if (conf::sliding_average)
-        mcount = std::min(mcount, conf::past_average_weight);
-      call_info.average_global_time = (call_info.average_global_time * mcount + delta) / (mcount + 1.);
-      ++call_info.average_global_time_count;
-    }
-    if (se)
-    {
-      size_t mcount = se->average_global_time_count;
-      if (conf::sliding_average)
-        mcount = std::min(mcount, conf::past_average_weight);
-      se->average_global_time = (se->average_global_time * mcount + delta) / (mcount + 1.);
-      ++se->average_global_time_count;
-
-      if (se->global_time_progression.empty())
-        se->global_time_progression.push_back(duration_progression{ts, se->average_global_time});
-      else if ((se->global_time_progression.back().value < se->average_global_time && se->global_time_progression.back().value * conf::progression_min_factor < se->average_global_time)
-               || (se->global_time_progression.back().value > se->average_global_time && se->global_time_progression.back().value > se->average_global_time * conf::progression_min_factor))
-        se->global_time_progression.push_back(duration_progression{ts, se->average_global_time});
-      if (se->self_time_progression.size() > conf::max_progression_entries)
+      acc.global_time_sum += global_delta;
+      ++acc.global_time_count;
+      acc.global_time_histogram.add(global_delta);
+      if (se)
       {
-        size_t diff = se->self_time_progression.size() - conf::max_progression_entries;
-        se->self_time_progression.erase(se->self_time_progression.begin(), se->self_time_progression.begin() + diff);
+        se->average_global_time += (global_delta - se->average_global_time) / double(se->average_global_time_count + 1);
+        ++se->average_global_time_count;
+        se->global_time_histogram.add(global_delta);
       }
     }
   }
@@ -125,40 +123,92 @@ neam::r::function_call::~function_call()
     tl_data->top = prev;
 
   if (!prev && !conf::disable_auto_save)
-    neam::r::sync_data_to_disk(conf::out_file); // there's nothing after us, sync data to a file
+  {
+    // there's nothing after us, sync data to a file
+    if (conf::background_flush)
+      internal::request_flush();
+    else
+      internal::sync_or_defer(conf::out_file);
+  }
+}
+
+void neam::r::basic_function_call::record_exemplar_call(uint64_t end_ticks)
+{
+  std::vector<internal::thread_local_data::exemplar_event> &events = tl_data->exemplar_events;
+  const bool recorded = start_ticks && conf::exemplars;
+  if (recorded)
+  {
+    if (events.size() < conf::exemplar_max_calls || !prev) // the root call is always there
+      events.push_back(internal::thread_local_data::exemplar_event {call_info_index, start_ticks, end_ticks - start_ticks, depth});
+    else
+      ++tl_data->exemplar_dropped_calls;
+  }
+  if (prev)
+    return;
+
+  // the root call: keep its call tree only if it has been slow
+  if (recorded && se && conf::max_exemplars)
+  {
+    const double duration = internal::clock::to_seconds(end_ticks - start_ticks);
+
+    std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+    const double threshold = tl_data->get_accumulator(global, call_info_index).exemplar_threshold;
+    const std::deque<exemplar> &exemplars = se->cold.get().exemplars;
+    const bool slower = exemplars.size() < conf::max_exemplars
+                        || std::any_of(exemplars.begin(), exemplars.end(), [duration](const exemplar &it) { return it.duration < duration; });
+    if (threshold > 0 && duration > threshold && slower)
+    {
+      // events are in the order the calls have ended
+      std::stable_sort(events.begin(), events.end(), [](const auto &a, const auto &b)
+      {
+        return a.start < b.start || (a.start == b.start && a.depth < b.depth);
+      });
+
+      exemplar ex;
+      ex.timestamp = internal::clock::get_coarse_time();
+      ex.duration = duration;
+      ex.dropped_calls = tl_data->exemplar_dropped_calls;
+      ex.calls.reserve(events.size());
+      for (const auto &it : events)
+      {
+        const double start = it.start > start_ticks ? internal::clock::to_seconds(it.start - start_ticks) : 0.;
+        ex.calls.push_back(exemplar_call {it.call_structure_index, it.depth, start, internal::clock::to_seconds(it.duration)});
+      }
+      se->add_exemplar(std::move(ex));
+    }
+  }
+  events.clear();
+  tl_data->exemplar_dropped_calls = 0;
 }
 
-void neam::r::function_call::fail(const neam::r::reason &rsn)
+void neam::r::basic_function_call::fail(const neam::r::reason &rsn)
 {
   if (conf::print_fails_to_stdout)
   {
     neam::cr::out.error() << LOGGER_INFO_TPL(rsn.file, rsn.line) << rsn.type << ": "  << rsn.message << std::endl;
   }
 
-  if (se)
-    se->fail_count++;
-
   // Avoid huge reports if we always hit the same error
   // We don't test the whole array 'cause we want to keep the ordering
-  int64_t ts = std::time(nullptr);
-  {
-    std::lock_guard<internal::mutex_type> _u0(global->lock);
+  int64_t ts = internal::clock::get_coarse_time();
 
-    call_info.fail_count++;
-  }
+  std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+  tl_data->get_accumulator(global, call_info_index).fail_count++;
 
   if (!se) return;
+  se->fail_count++;
 
-  if (se->fails.size() && se->fails.back() == rsn)
+  std::deque<reason> &fails = se->cold.get_or_create().fails;
+  if (fails.size() && fails.back() == rsn)
   {
-    ++se->fails.back().hit;
-    se->fails.back().last_timestamp = ts;
+    ++fails.back().hit;
+    fails.back().last_timestamp = ts;
   }
   else
-    se->fails.push_back(neam::r::reason {rsn.type, rsn.message, rsn.file, rsn.line, 1, ts, ts});
+    fails.push_back(neam::r::reason {rsn.type, rsn.message, rsn.file, rsn.line, 1, ts, ts});
 }
 
-void neam::r::function_call::report(const std::string &mode, const neam::r::reason &rsn)
+void neam::r::basic_function_call::report(const std::string &mode, const neam::r::reason &rsn)
 {
   if (conf::print_reports_to_stdout)
   {
@@ -167,11 +217,13 @@ void neam::r::function_call::report(const std::string &mode, const neam::r::reas
 
   // Avoid huge reports if we always hit the same thing
   // We don't test the whole array 'cause we want to keep the ordering
-  int64_t ts = std::time(nullptr);
+  int64_t ts = internal::clock::get_coarse_time();
 
   if (!se) return;
 
-  auto &vct = se->reports[mode];
+  std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+  tl_data->use_global(global);
+  auto &vct = se->cold.get_or_create().reports[mode];
 
   if (vct.size() && vct.back() == rsn)
   {
@@ -182,27 +234,33 @@ void neam::r::function_call::report(const std::string &mode, const neam::r::reas
     vct.push_back(neam::r::reason {rsn.type, rsn.message, rsn.file, rsn.line, 1, ts, ts});
 }
 
-neam::r::sequence &neam::r::function_call::create_sequence(const std::string &name)
+neam::r::sequence &neam::r::basic_function_call::create_sequence(const std::string &name)
 {
   // TODO(tim): fix the possible null se pointer
-  neam::r::sequence &ret = se->sequences[name];
+  std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+  tl_data->use_global(global);
+  neam::r::sequence &ret = se->cold.get_or_create().sequences[name];
   ret.clear_sequence();
   return ret;
 }
 
-neam::r::sequence *neam::r::function_call::get_sequence(const std::string &name)
+neam::r::sequence *neam::r::basic_function_call::get_sequence(const std::string &name)
 {
   if (!se)
     return nullptr;
-  auto it = se->sequences.find(name);
-  if (it != se->sequences.end())
+  std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+  internal::stack_entry_cold *cold = se->cold.get_if_exists();
+  if (!cold)
+    return nullptr;
+  auto it = cold->sequences.find(name);
+  if (it != cold->sequences.end())
     return &it->second;
   return nullptr;
 }
 
-neam::r::sequence *neam::r::function_call::get_sequence_callers(const std::string &name)
+neam::r::sequence *neam::r::basic_function_call::get_sequence_callers(const std::string &name)
 {
-  for (neam::r::function_call *it = tl_data->top; it; it = it->prev)
+  for (neam::r::basic_function_call *it = tl_data->top; it; it = it->prev)
   {
     neam::r::sequence *ptr = it->get_sequence(name);
     if (ptr)
@@ -211,14 +269,25 @@ neam::r::sequence *neam::r::function_call::get_sequence_callers(const std::strin
   return nullptr;
 }
 
-void neam::r::function_call::remove_sequence(const std::string &name)
+void neam::r::basic_function_call::remove_sequence(const std::string &name)
 {
-  se->sequences.erase(name);
+  std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+  if (internal::stack_entry_cold *cold = se->cold.get_if_exists())
+    cold->sequences.erase(name);
 }
 
-neam::r::introspect neam::r::function_call::get_introspect() const
+neam::r::introspect neam::r::basic_function_call::get_introspect() const
 {
-  return neam::r::introspect(call_info, call_info_index, se);
+  // se lives in the thread callgraph, the introspect needs the entry of the shared callgraph
+  // (only this thread is merged: that's enough to have this context up to date)
+  internal::stack_entry *shared_se = nullptr;
+  {
+    std::lock_guard<internal::mutex_type> _u0(tl_data->lock);
+    tl_data->merge_to_global();
+    if (se)
+      shared_se = tl_data->graph.get_shared_stack_entry(*global, *se);
+  }
+  return neam::r::introspect(call_info, call_info_index, shared_se);
 }
 
 void neam::r::internal::__addr__() {}
@@ -30,13 +30,16 @@
 #include "tools/embed.hpp"
 
 #include "tools/macro.hpp"
-#include "tools/chrono.hpp"
+#include "level.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
 
 #include "id_gen.hpp"
 #include "func_descriptor.hpp"
 #include "reason.hpp"
 #include "call_info_struct.hpp"
 #include "storage.hpp"
+#include "crash_dump.hpp"
 #include "type.hpp"
 #include "config.hpp"
 namespace neam
@@ -47,22 +50,45 @@ namespace neam
 
     /// \brief The public interface for monitoring function call
     /// This class allow to monitor functions.
+    /// \note Use neam::r::function_call, which is this class unless N_R_LEVEL says otherwise (see level.hpp)
     /// \see introspect
-    class function_call
+    class basic_function_call
     {
       private:
-        void common_init();
+        void common_init(uint32_t sample_ratio);
+        void record_exemplar_call(uint64_t end_ticks);
+
+      protected:
+        /// \brief Tag for the constructors of calls that are never timed
+        struct untimed_t {};
+
+        template<typename FuncType, FuncType Func>
+        basic_function_call(untimed_t, const static_func_descriptor &d, neam::embed::embed<FuncType, Func>)
+          : call_info_index(0), call_info(internal::get_call_info_struct<FuncType, Func>(d, &call_info_index)),
+            global(internal::get_global_data()), tl_data(internal::get_thread_data()), timing_allowed(false)
+        {
+          common_init(d.sample_ratio);
+        }
+
+        template<typename FuncType>
+        basic_function_call(untimed_t, const static_func_descriptor &d, internal::type<FuncType>)
+          : call_info_index(0), call_info(internal::get_call_info_struct<FuncType>(d, &call_info_index)),
+            global(internal::get_global_data()), tl_data(internal::get_thread_data()), timing_allowed(false)
+        {
+          common_init(d.sample_ratio);
+        }
 
       public:
         /// \brief Construct a function call object
         /// \see N_PRETTY_FUNCTION_INFO
         /// \code auto self_call = function_call(N_PRETTY_FUNCTION_INFO(my_class::my_function)); \endcode
+        /// \note Once the call_info_struct has been found, this does not allocate
         template<typename FuncType, FuncType Func>
-        function_call(const func_descriptor &d, neam::embed::embed<FuncType, Func>)
+        basic_function_call(const static_func_descriptor &d, neam::embed::embed<FuncType, Func>)
           : call_info_index(0), call_info(internal::get_call_info_struct<FuncType, Func>(d, &call_info_index)),
             global(internal::get_global_data()), tl_data(internal::get_thread_data())
         {
-          common_init();
+          common_init(d.sample_ratio);
         }
 
         /// \brief Construct a function call object for a [?]
@@ -70,36 +96,52 @@ namespace neam
         /// \see N_PRETTY_NAME_INFO
         /// \code neam::r::function_call self_call(N_PRETTY_NAME_INFO(my_lbd_variable)); \endcode
         template<typename FuncType>
-        function_call(const func_descriptor &d, internal::type<FuncType>)
+        basic_function_call(const static_func_descriptor &d, internal::type<FuncType>)
           : call_info_index(0), call_info(internal::get_call_info_struct<FuncType>(d, &call_info_index)),
             global(internal::get_global_data()), tl_data(internal::get_thread_data())
         {
-          common_init();
+          common_init(d.sample_ratio);
         }
 
         /// \brief If you use this, you have to really know what you're doing...
-        function_call(const char *const name)
-          : function_call(func_descriptor{name, nullptr, nullptr, 0, name, internal::hash_from_str(name)}, internal::type<void>()) {}
+        basic_function_call(const char *const name)
+          : basic_function_call(static_func_descriptor{name, nullptr, nullptr, 0, name, internal::hash_from_str(name), 0}, internal::type<void>()) {}
         /// \brief If you use this, you have to really know what you're doing...
-        function_call(const char *pretty_function, const char *const name)
-          : function_call(func_descriptor{name, pretty_function, nullptr, 0, name, internal::hash_from_str(name)}, internal::type<void>()) {}
+        basic_function_call(const char *pretty_function, const char *const name)
+          : basic_function_call(static_func_descriptor{name, pretty_function, nullptr, 0, name, internal::hash_from_str(name), 0}, internal::type<void>()) {}
 
         /// \brief Get the current/active function call
         /// \warning The returned pointer is ONLY valid in the current scope and should never be stored
         /// \note Could return nullptr if no function_call is active on the current thread
-        static inline function_call *get_active_function_call()
+        static inline basic_function_call *get_active_function_call()
         {
           return internal::get_thread_data()->top;
         }
 
-        ~function_call();
+        ~basic_function_call();
 
-        /// \brief Start monitoring the time consumed by this very function
+        /// \brief Start monitoring the time consumed by this very function (from now on)
         /// \note All calls that are monitored by reflective doesn't add to this time
-        void monitor_self_time() { self_time_monitoring = true; }
+        /// \note Does nothing if this call is not timed (sampled out, or N_R_LEVEL_COUNTS)
+        void monitor_self_time()
+        {
+          if (timing_allowed && !self_time_monitoring)
+          {
+            self_time_monitoring = true;
+            self_chrono.reset();
+          }
+        }
 
-        /// \brief Start monitoring the time consumed by this function
-        void monitor_global_time() { global_time_monitoring = true; }
+        /// \brief Start monitoring the time consumed by this function (from now on)
+        /// \note Does nothing if this call is not timed (sampled out, or N_R_LEVEL_COUNTS)
+        void monitor_global_time()
+        {
+          if (timing_allowed && !global_time_monitoring)
+          {
+            global_time_monitoring = true;
+            global_chrono.reset();
+          }
+        }
 
         /// \brief Report a failure
         void fail(const reason &rsn);
@@ -136,17 +178,91 @@ namespace neam
         internal::call_info_struct &call_info;
         internal::data *global;
         internal::thread_local_data *tl_data;
-        function_call *prev;
-        cr::chrono self_chrono;
-        cr::chrono global_chrono;
+        basic_function_call *prev;
+        internal::tick_chrono self_chrono;
+        internal::tick_chrono global_chrono;
         internal::stack_entry *se = nullptr;
+        uint64_t start_ticks = 0; ///< \brief When the call started, if it is traced (see trace.hpp) or recorded for an exemplar (see conf::exemplars)
+        uint32_t depth = 0; ///< \brief The depth of the call on the stack of the thread (0 for the root call)
         bool self_time_monitoring = conf::monitor_self_time;
         bool global_time_monitoring = conf::monitor_global_time;
+        bool timing_allowed = true; ///< \brief false for calls that are sampled out or untimed
+
 
         bool has_exception = false; // has been constructed when an exception was active
 
-        friend class measure_point;
+        friend class basic_measure_point;
+        friend bool internal::write_crash_dump(int sig);
+    };
+
+    /// \brief A function_call for N_R_LEVEL_COUNTS: calls, fails, reports and the callgraph are recorded, but nothing is timed
+    class counting_function_call : public basic_function_call
+    {
+      public:
+        template<typename FuncType, FuncType Func>
+        counting_function_call(const static_func_descriptor &d, neam::embed::embed<FuncType, Func> e)
+          : basic_function_call(untimed_t(), d, e) {}
+
+        template<typename FuncType>
+        counting_function_call(const static_func_descriptor &d, internal::type<FuncType> t)
+          : basic_function_call(untimed_t(), d, t) {}
+
+        counting_function_call(const char *const name)
+          : basic_function_call(untimed_t(), static_func_descriptor{name, nullptr, nullptr, 0, name, internal::hash_from_str(name), 0}, internal::type<void>()) {}
+        counting_function_call(const char *pretty_function, const char *const name)
+          : basic_function_call(untimed_t(), static_func_descriptor{name, pretty_function, nullptr, 0, name, internal::hash_from_str(name), 0}, internal::type<void>()) {}
     };
+
+    /// \brief A function_call for N_R_LEVEL_DISABLED: an empty object, every method does nothing
+    /// \note Sequences are never found, create_sequence() and get_introspect() are not available
+    /// \note fail() and report() take the reason_info of a predefined reason and the raw mode as they are, so
+    ///       \code self_call.fail(neam::r::exception_reason(N_REASON_INFO, e.what())); \endcode builds no string.
+    ///       Arguments are still evaluated: a message that is built (like a std::string concatenation) still costs its construction.
+    class disabled_function_call
+    {
+      public:
+        template<typename... Args>
+        disabled_function_call(Args &&...) {}
+
+        /// \brief Return the active call of the enabled modules (disabled calls are not on the stack)
+        static inline basic_function_call *get_active_function_call()
+        {
+          return basic_function_call::get_active_function_call();
+        }
+
+        void monitor_self_time() {}
+        void monitor_global_time() {}
+        void fail(const reason &) {}
+        void fail(const reason_info &) {}
+        void report(const std::string &, const reason &) {}
+        void report(const char *, const reason &) {}
+        void report(const char *, const reason_info &) {}
+
+        template<typename Ret>
+        inline Ret fail(const reason &, Ret&& r)
+        {
+          return (r);
+        }
+        template<typename Ret>
+        inline Ret fail(const reason_info &, Ret&& r)
+        {
+          return (r);
+        }
+
+        sequence *get_sequence(const std::string &) { return nullptr; }
+        sequence *get_sequence_callers(const std::string &) { return nullptr; }
+        void remove_sequence(const std::string &) {}
+    };
+
+    /// \brief What monitors a function call in this translation unit (depends on N_R_LEVEL)
+    /// \code neam::r::function_call self_call(N_PRETTY_FUNCTION_INFO(my_class::my_function)); \endcode
+#if N_R_LEVEL == N_R_LEVEL_FULL
+    using function_call = basic_function_call;
+#elif N_R_LEVEL == N_R_LEVEL_COUNTS
+    using function_call = counting_function_call;
+#else
+    using function_call = disabled_function_call;
+#endif
 #ifdef _MSC_VER
 #define _R_PRETTY_FUNC __FUNCSIG__
 #else
@@ -156,46 +272,58 @@ namespace neam
 /// \brief Workaround some C++ limitations. Also provide what is necessary for the name, hash and func parameters of neam::r::function_call()
 /// \note Please provide the full hierarchy of namespaces if possible
 /// \param f is a method or a function with the full hierarchy of namespaces
-#define N_PRETTY_FUNCTION_INFO(f) neam::r::func_descriptor { N_EXP_STRINGIFY(f), _R_PRETTY_FUNC, __FILE__, __LINE__, N__I__FNAME(f), neam::r::internal::generate_id(N__I__FNAME(f), &f)}, neam::embed::embed<decltype(&f), &f>()
+#define N_PRETTY_FUNCTION_INFO(f) N_PRETTY_FUNCTION_INFO_SAMPLED(f, 0)
+
+/// \brief Same as N_PRETTY_FUNCTION_INFO, but only one call in \e ratio is timed (every call is still counted)
+/// Useful to leave the instrumentation in tight loops
+/// \param f is a method or a function with the full hierarchy of namespaces
+/// \param ratio is the sampling ratio (0 means conf::sampling_ratio)
+#define N_PRETTY_FUNCTION_INFO_SAMPLED(f, ratio) neam::r::static_func_descriptor { N__I__SSTR(N_EXP_STRINGIFY(f)), N__I__SSTR(_R_PRETTY_FUNC), N__I__SSTR(__FILE__), __LINE__, N__I__SSTR(N__I__FNAME(f)), neam::r::internal::generate_id(N__I__FNAME(f), &f), ratio}, neam::embed::embed<decltype(&f), &f>()
 
 /// \brief Use this is if you have to monitor constructors, destructors, lambdas, strange things and awkward moments
 /// \note Using this will work in every case (but could be a little bit slower than N_*FUNCTION_INFO as you don't have cache)
 /// \note Using this, you will not be able to use the function with if_wont_fail and introspecting that function will not be possible directly
 /// \param n is a C string. Better if the string is known at compile-time.
+#define N_PRETTY_NAME_INFO(n) N_PRETTY_NAME_INFO_SAMPLED(n, 0)
+
+/// \brief Same as N_PRETTY_NAME_INFO, but only one call in \e ratio is timed (every call is still counted)
+/// \param n is a C string. Better if the string is known at compile-time.
+/// \param ratio is the sampling ratio (0 means conf::sampling_ratio)
 #ifdef _MSC_VER
-#define N_PRETTY_NAME_INFO(n) neam::r::func_descriptor {n, _R_PRETTY_FUNC, __FILE__, __LINE__, N__I__NNAME, neam::r::internal::hash_from_str(N__I__NNAME)}, neam::r::internal::type<neam::r::internal::file_type<__COUNTER__, __LINE__>>()
+#define N_PRETTY_NAME_INFO_SAMPLED(n, ratio) neam::r::static_func_descriptor {n, N__I__SSTR(_R_PRETTY_FUNC), N__I__SSTR(__FILE__), __LINE__, N__I__SSTR(N__I__NNAME), neam::r::internal::hash_from_str(N__I__NNAME), ratio}, neam::r::internal::type<neam::r::internal::file_type<__COUNTER__, __LINE__>>()
 #else
-#define N_PRETTY_NAME_INFO(n) neam::r::func_descriptor {n, _R_PRETTY_FUNC, __FILE__, __LINE__, N__I__NNAME, neam::r::internal::hash_from_str(N__I__NNAME)}, neam::r::internal::type<neam::r::internal::file_type<neam::r::internal::hash_from_str(__FILE__), __LINE__>>()
+#define N_PRETTY_NAME_INFO_SAMPLED(n, ratio) neam::r::static_func_descriptor {n, N__I__SSTR(_R_PRETTY_FUNC), N__I__SSTR(__FILE__), __LINE__, N__I__SSTR(N__I__NNAME), neam::r::internal::hash_from_str(N__I__NNAME), ratio}, neam::r::internal::type<neam::r::internal::file_type<neam::r::internal::hash_from_str(__FILE__), __LINE__>>()
 #endif
 /// \brief Use this with a method or a function that you monitor with N_PRETTY_FUNCTION_INFO
 /// \param n is a C string. Better if the string is known at compile-time.
 /// \param f is a method or a function with the full hierarchy of namespaces
-#define N_FUNCTION(f)    neam::r::func_descriptor {N_EXP_STRINGIFY(f), std::string(), std::string(), 0, std::string(), 0}, neam::embed::embed<decltype(&f), &f>()
+#define N_FUNCTION(f)    neam::r::static_func_descriptor {N__I__SSTR(N_EXP_STRINGIFY(f)), nullptr, nullptr, 0, nullptr, 0, 0}, neam::embed::embed<decltype(&f), &f>()
 
 /// \brief
 /// \param n is a C string. Better if the string is known at compile-time.
 /// \param f is a method or a function with the full hierarchy of namespaces
-#define N_NAME(n, f)    neam::r::func_descriptor {N_EXP_STRINGIFY(f), std::string(), std::string(), 0, std::string(), 0}, neam::r::internal::type<decltype(&f)>()
+#define N_NAME(n, f)    neam::r::static_func_descriptor {N__I__SSTR(N_EXP_STRINGIFY(f)), nullptr, nullptr, 0, nullptr, 0, 0}, neam::r::internal::type<decltype(&f)>()
 
 #if 0
 /// \brief Workaround some C++ limitations. Also provide what is necessary for the name, hash and func parameters of neam::r::function_call()
 /// \note Please provide the full hierarchy of namespaces if possible
 /// \param f is a method or a function with the full hierarchy of namespaces
-#define N_FUNCTION_INFO(f) neam::r::func_descriptor { N_EXP_STRINGIFY(f), nullptr, nullptr, 0, N__I__FNAME(f), neam::r::internal::generate_id(N__I__FNAME(f), &f)}, neam::embed::embed<decltype(&f), &f>()
+#define N_FUNCTION_INFO(f) neam::r::static_func_descriptor { N__I__SSTR(N_EXP_STRINGIFY(f)), nullptr, nullptr, 0, N__I__SSTR(N__I__FNAME(f)), neam::r::internal::generate_id(N__I__FNAME(f), &f), 0}, neam::embed::embed<decltype(&f), &f>()
 
 /// \brief Workaround some C++ limitations. Also provide what is necessary for the name, hash and func parameters of neam::r::function_call()
 /// \note Please provide the full hierarchy of namespaces if possible
 /// \param n is a C string
-#define N_NAME_INFO(n) neam::r::func_descriptor {n, nullptr, nullptr, 0, N__I__NNAME, neam::r::internal::hash_from_str(N__I__NNAME)}, neam::r::internal::type<void>()
+#define N_NAME_INFO(n) neam::r::static_func_descriptor {n, nullptr, nullptr, 0, N__I__SSTR(N__I__NNAME), neam::r::internal::hash_from_str(N__I__NNAME), 0}, neam::r::internal::type<void>()
 
 /// \brief Use this is if everything else fails or gives awkward results
 /// \param n is a C string
 /// \note This should be your last resort as it is totally arbitrary
-#define N_PRETTY_ARBITRARY_INFO(n) neam::r::func_descriptor {n, _R_PRETTY_FUNC, __FILE__, __LINE__, n, neam::r::internal::hash_from_str(n)}, neam::r::internal::type<void>()
+#define N_PRETTY_ARBITRARY_INFO(n) neam::r::static_func_descriptor {n, N__I__SSTR(_R_PRETTY_FUNC), N__I__SSTR(__FILE__), __LINE__, n, neam::r::internal::hash_from_str(n), 0}, neam::r::internal::type<void>()
 #endif
 
 #define N__I__FNAME(f)    __FILE__ ":" N_EXP_STRINGIFY(__LINE__) "#" N_EXP_STRINGIFY(f)
 #define N__I__NNAME       __FILE__ ": " N_EXP_STRINGIFY(__LINE__)
+#define N__I__SSTR(s)     neam::r::static_string {s, sizeof(s) - 1} // s must be a string literal (or a char array)
   } // namespace r
 } // namespace neam
 
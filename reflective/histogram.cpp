@@ -0,0 +1,117 @@
+
+#include <algorithm>
+#include <cmath>
+
+#include "histogram.hpp"
+
+void neam::r::duration_histogram::grow(size_t first, size_t last)
+{
+  const size_t max_size = bucket_count; // std::min() takes references, and bucket_count has no out-of-class definition
+  const size_t current_first = buckets.empty() ? first : size_t(first_bucket);
+  const size_t current_last = buckets.empty() ? last : size_t(first_bucket) + buckets.size();
+  size_t new_first = std::min(first, current_first);
+  size_t new_last = std::min(std::max(last, current_last), max_size);
+
+  const size_t size = std::min(std::max(std::max(new_last - new_first, 2 * buckets.size()), size_t(initial_bucket_count)), max_size);
+  if (buckets.empty()) // center the range on what is recorded
+    new_first = std::min(new_first - std::min(new_first, (size - (new_last - new_first)) / 2), max_size - size);
+  else if (new_first < current_first) // grow down
+    new_first = new_last - std::min(new_last, size);
+  new_last = std::min(new_first + size, max_size);
+  new_first = new_last - size;
+
+  std::vector<uint64_t> grown(size, 0);
+  for (size_t i = 0; i < buckets.size(); ++i)
+    grown[first_bucket + i - new_first] = buckets[i];
+  buckets.swap(grown);
+  first_bucket = new_first;
+}
+
+void neam::r::duration_histogram::add(const duration_histogram &o)
+{
+  if (!o.count)
+    return;
+
+  // find the range that has been hit in o
+  size_t first = 0;
+  size_t last = o.buckets.size();
+  while (first < last && !o.buckets[first])
+    ++first;
+  while (last > first && !o.buckets[last - 1])
+    --last;
+  if (first == last)
+    return;
+
+  if (buckets.empty() || o.first_bucket + first < first_bucket || o.first_bucket + last > first_bucket + buckets.size())
+    grow(o.first_bucket + first, o.first_bucket + last);
+  for (size_t i = first; i < last; ++i)
+    buckets[o.first_bucket + i - first_bucket] += o.buckets[i];
+
+  count += o.count;
+  max = std::max(max, o.max);
+}
+
+void neam::r::duration_histogram::clear()
+{
+  std::fill(buckets.begin(), buckets.end(), 0);
+  count = 0;
+  max = 0;
+}
+
+double neam::r::duration_histogram::get_percentile(double percentile) const
+{
+  if (!count)
+    return 0;
+
+  const double rank_f = std::ceil(std::min(std::max(percentile, 0.), 100.) / 100. * double(count));
+  const uint64_t rank = std::max<uint64_t>(uint64_t(rank_f), 1);
+
+  uint64_t acc = 0;
+  for (size_t i = 0; i < buckets.size(); ++i)
+  {
+    acc += buckets[i];
+    if (acc >= rank)
+      return std::min(get_bucket_value(first_bucket + i), max);
+  }
+  return max;
+}
+
+double neam::r::duration_histogram::get_mean() const
+{
+  if (!count)
+    return 0;
+
+  double sum = 0;
+  for (size_t i = 0; i < buckets.size(); ++i)
+  {
+    if (buckets[i])
+      sum += double(buckets[i]) * std::min(get_bucket_value(first_bucket + i), max);
+  }
+  return sum / double(count);
+}
+
+double neam::r::duration_histogram::get_variance() const
+{
+  if (count < 2)
+    return 0;
+
+  const double mean = get_mean();
+  double sum = 0;
+  for (size_t i = 0; i < buckets.size(); ++i)
+  {
+    if (!buckets[i])
+      continue;
+    const double diff = std::min(get_bucket_value(first_bucket + i), max) - mean;
+    sum += double(buckets[i]) * diff * diff;
+  }
+  return sum / double(count - 1);
+}
+
+double neam::r::duration_histogram::get_bucket_value(size_t index)
+{
+  if (index < sub_bucket_count)
+    return double(index) * 1e-9;
+  const unsigned shift = unsigned(index / sub_bucket_count - 1);
+  const uint64_t low = (sub_bucket_count + index % sub_bucket_count) << shift;
+  return (double(low) + double(uint64_t(1) << shift) / 2.) * 1e-9;
+}
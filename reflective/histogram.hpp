@@ -0,0 +1,121 @@
+//
+// file : histogram.hpp
+// in : file:///home/tim/projects/reflective/reflective/histogram.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 21:02:44
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_664285706793587091_55644572__HISTOGRAM_HPP__
+# define __N_664285706793587091_55644572__HISTOGRAM_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace neam
+{
+  namespace r
+  {
+    /// \brief A fixed-memory, log-linear (HDR-style) histogram of durations
+    /// Durations are recorded in nanoseconds: values under 8ns have their own bucket, then every power of two is split in 8 linear sub-buckets,
+    /// so a percentile is always within 6.25% of the real value. Only a range of buckets around the ones that have been hit is allocated (never more than bucket_count):
+    /// it starts with initial_bucket_count buckets (two powers of two) and at least doubles each time a duration falls outside of it,
+    /// so a histogram reallocates a handful of times at most, and clearing it keeps its memory.
+    /// \note Histograms are merged by adding their buckets: merging threads, stashes or launches does not lose anything
+    struct duration_histogram
+    {
+      static constexpr unsigned sub_bucket_bits = 3;
+      static constexpr uint64_t sub_bucket_count = 1 << sub_bucket_bits;
+      static constexpr unsigned max_exponent = 48; ///< \brief Durations are clamped to 2^48ns (~78 hours)
+      static constexpr size_t bucket_count = (max_exponent - sub_bucket_bits + 1) * sub_bucket_count;
+      static constexpr size_t initial_bucket_count = 2 * sub_bucket_count; ///< \brief The size of the range allocated by the first record
+
+      uint64_t first_bucket = 0; ///< \brief The index of buckets[0]
+      std::vector<uint64_t> buckets = std::vector<uint64_t>(); ///< \brief The counts, from first_bucket (the buckets around the range that has been hit)
+      uint64_t count = 0; ///< \brief The number of recorded durations
+      double max = 0; ///< \brief The largest recorded duration (exact, in seconds)
+
+      /// \brief Record a duration (in seconds)
+      void add(double duration)
+      {
+        const size_t index = get_bucket_index(duration);
+        if (index < first_bucket || index >= first_bucket + buckets.size())
+          grow(index, index + 1);
+        ++buckets[index - first_bucket];
+        ++count;
+        if (duration > max)
+          max = duration;
+      }
+
+      /// \brief Merge another histogram into this one
+      void add(const duration_histogram &o);
+
+      /// \brief Reset the counts (keep the memory)
+      void clear();
+
+      /// \brief Return the duration (in seconds) under which percentile % of the recorded durations are (0 if empty)
+      /// \param[in] percentile The percentile, in [0, 100] (like 50, 90, 99 or 99.9)
+      double get_percentile(double percentile) const;
+
+      /// \brief Return the mean of the recorded durations (in seconds, 0 if empty)
+      /// \note This is computed from the buckets (within 6.25%), but unlike the averages of call_info_struct/stack_entry it is never a sliding average
+      double get_mean() const;
+
+      /// \brief Return the variance of the recorded durations (in seconds^2, 0 if empty), computed from the buckets
+      double get_variance() const;
+
+      /// \brief Return the bucket index for a duration (in seconds)
+      static size_t get_bucket_index(double duration)
+      {
+        uint64_t value = duration > 0 ? uint64_t(duration * 1e9) : 0;
+        if (value < sub_bucket_count)
+          return size_t(value);
+        if (value >> max_exponent)
+          value = (uint64_t(1) << max_exponent) - 1;
+        const unsigned shift = log2(value) - sub_bucket_bits;
+        return size_t((shift + 1) * sub_bucket_count + (value >> shift) - sub_bucket_count);
+      }
+
+      /// \brief Return the middle of a bucket (in seconds)
+      static double get_bucket_value(size_t index);
+
+      private:
+        /// \brief Make the range cover [first, last): it at least doubles, towards the side that is missing (keeping the counts)
+        void grow(size_t first, size_t last);
+
+        static unsigned log2(uint64_t value)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+          return 63 - __builtin_clzll(value);
+#else
+          unsigned ret = 0;
+          while (value >>= 1)
+            ++ret;
+          return ret;
+#endif
+        }
+    };
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_664285706793587091_55644572__HISTOGRAM_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
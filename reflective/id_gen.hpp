@@ -31,12 +31,9 @@
 /// A simple note about why I need a ID generator and not typeid. typeid hashes are not unique AND not consistent
 /// between two invocation of the same program. (There **absolutely** no support for different builds by different compilers).
 /// But reflective being what it is, I needed a ID generator for generating consistent ID and the easiest way to do so was to
-/// compute a hash from a string. Hashes being hashes, they are not unique, but that was allowing a faster string/string comparison
-/// (even if it make the program calling 10 time strcmp for 10,000 functions, that was enough low to not use a complex structure like std::map).
-/// Moreover the hash can be computed at compile time and there is a (simple) cache system for memoizing results. So in term of complexity,
-/// for a program consisting of \e n functions called \e m time, you will search n time the DB consisting of n entries (complexity O(n²))
-/// but for a big enough \e m, you'll get an amortized complexity of O(1) because of the cache (and searching the cache consist of a single if()).
-/// That's why I set-up this system.
+/// compute a hash from a string. The hash is computed at compile time, and is 64bit wide: it is used as the key of the function DB index
+/// (see internal::data::func_index), so registering / searching a function is O(1), and key names are only compared the first time a call site
+/// finds its function, or when two different key names have the same hash (see call_info_struct::hash_collision). There is also a (simple) cache system for memoizing results (searching the cache consist of a single if()).
 ///
 /// A possibility to generate unique hashes could be to use __builtin_return_address (gcc, clang) (or _ReturnAddress, msvc) in a non-inlineable function
 ///
@@ -55,44 +52,40 @@ namespace neam
       void __addr__(); // empty, implemented in function_call.cpp
 
       template<typename Class, typename Ret, typename... Args>
-      static inline uint32_t hash_from_ptr(Ret(Class::*ptr)(Args...))
+      static inline uint64_t hash_from_ptr(Ret(Class::*ptr)(Args...))
       {
         const long addr = reinterpret_cast<long>(&__addr__);
         Ret(*ptr2)(Class *, Args...);
         ptr2 = reinterpret_cast<Ret( *)(Class *, Args...)>(ptr);
-        return uint32_t(addr - reinterpret_cast<long>(reinterpret_cast<void *>(ptr2))) & ~1u;
+        return uint64_t(addr - reinterpret_cast<long>(reinterpret_cast<void *>(ptr2))) | (1ull << 63); // never 0
       }
       template<typename Ret, typename... Args>
-      static inline uint32_t hash_from_ptr(Ret(*ptr)(Args...))
+      static inline uint64_t hash_from_ptr(Ret(*ptr)(Args...))
       {
         const long addr = reinterpret_cast<long>(&__addr__);
-        return (uint32_t(addr - reinterpret_cast<long>((void *)ptr))) & ~1u;
+        return uint64_t(addr - reinterpret_cast<long>((void *)ptr)) | (1ull << 63); // never 0
       }
 
-      /// \brief This hash is guaranteed to be and consistent across program launch
-      /// \note This hash is quite fast AND \b NOT INTENDED TO BE SECURE. Its sole purpose is to allow a quite faster equality test for strings
+      /// \brief This hash is guaranteed to be consistent across program launch (this is a 64bit FNV-1a)
+      /// \note This hash is quite fast AND \b NOT INTENDED TO BE SECURE. Its sole purpose is to identify strings (mostly key names) without comparing them
       /// \note This hash is made to be run at build time (and all decent compiler will not execute it at runtime)
+      /// \note 0 is never returned (0 means "no hash"), and the top bit is always clear (it is set for pointer-based ids, see hash_from_ptr())
       /// \note This is C++14
 #ifndef _MSC_VER
       constexpr
 #endif
-      inline uint32_t hash_from_str(const char *const string)
+      inline uint64_t hash_from_str(const char *const string)
       {
-        const size_t len = neam::ct::safe_strlen(string);
-        uint32_t hash = 0x005A55AA | ((len % 256) << 24); // first byte is (len % 255), and only the remaining 3 bytes are for the hash
+        uint64_t hash = 0xcbf29ce484222325ull;
 
-        for (size_t i = 0; i < len; ++i)
+        for (size_t i = 0; string && string[i]; ++i)
         {
-          uint8_t byte = static_cast<uint8_t>(string[i]);
-
-          // rotate
-          byte = (byte << (i % 8)) | (byte >> (8 - (i % 8)));
-
-          // xor it in the hash.
-          hash ^= (byte << (8 * (i % 3)));
+          hash ^= static_cast<uint8_t>(string[i]);
+          hash *= 0x100000001b3ull;
         }
 
-        return hash | 1;
+        hash &= ~(1ull << 63);
+        return hash ? hash : 1;
       }
 
       /// \brief Generate an id for a string / ptr
@@ -103,7 +96,7 @@ namespace neam
 #endif
       inline
 #endif
-      uint32_t generate_id(const char *const string, Ret (*ptr)(Args...))
+      uint64_t generate_id(const char *const string, Ret (*ptr)(Args...))
       {
 #ifndef N_R_XBUILD_COMPAT
         (void)ptr;
@@ -118,7 +111,7 @@ namespace neam
 #ifndef _MSC_VER
       constexpr
 #endif
-      inline uint32_t generate_id(const char *const string, Ret (Class::*)(Args...))
+      inline uint64_t generate_id(const char *const string, Ret (Class::*)(Args...))
       {
         return hash_from_str(string);
       }
@@ -128,7 +121,7 @@ namespace neam
 #ifndef _MSC_VER
       constexpr
 #endif
-      inline uint32_t generate_id(const char *const string, Type)
+      inline uint64_t generate_id(const char *const string, Type)
       {
         return hash_from_str(string);
       }
@@ -136,7 +129,7 @@ namespace neam
 #ifndef _MSC_VER
       constexpr
 #endif
-      inline uint32_t generate_id<const char *>(const char *const, const char *const other_string)
+      inline uint64_t generate_id<const char *>(const char *const, const char *const other_string)
       {
         return hash_from_str(other_string);
       }
@@ -20,104 +20,45 @@ neam::r::introspect &neam::r::introspect::operator=(const neam::r::introspect &o
 
 void neam::r::introspect::reset()
 {
+  internal::merge_thread_data(); // or the pending counters would come back later
+
   call_info->fail_count = 0;
   call_info->call_count = 1;
   call_info->average_global_time_count = call_info->average_global_time_count ? 1 : 0;
   call_info->average_self_time_count = call_info->average_self_time_count ? 1 : 0;
+  call_info->global_time_histogram = duration_histogram();
+  call_info->self_time_histogram = duration_histogram();
 
   // reset in all the callgraph entries
   std::lock_guard<internal::mutex_type> _u0(global->lock); // lock 'cause we do a lot of nasty things.
+  global->changed_func_info.insert(call_info_index);
 
-  for (auto &graph_it : global->callgraph)
-  {
-    for (internal::stack_entry &it : graph_it)
-    {
-      if (it.call_structure_index == call_info_index)
-      {
-        it.fail_count = 0;
-        it.hit_count = 1;
-        it.average_global_time_count = it.average_global_time_count ? 1 : 0;
-        it.average_self_time_count = it.average_self_time_count ? 1 : 0;
-        it.fails.clear();
-        it.reports.clear();
-        it.sequences.clear();
-        it.measure_points.clear();
-      }
-    }
-  }
-}
-
-std::vector<neam::r::introspect> neam::r::introspect::get_callee_list() const
-{
-  std::vector<neam::r::introspect> ret;
-
-  std::lock_guard<internal::mutex_type> _u0(global->lock); // lock 'cause we do a lot of nasty things.
-
-  if (!context) // the global version
+  for (const auto &location : global->get_stack_entry_locations(call_info_index))
   {
-    for (auto & graph_it : global->callgraph)
+    internal::stack_entry &it = global->callgraph[location.first][location.second];
+    global->changed_stack_entries.emplace(it.stack_index, it.self_index);
+    it.fail_count = 0;
+    it.hit_count = 1;
+    it.average_global_time_count = it.average_global_time_count ? 1 : 0;
+    it.average_self_time_count = it.average_self_time_count ? 1 : 0;
+    it.global_time_histogram = duration_histogram();
+    it.self_time_histogram = duration_histogram();
+    if (internal::stack_entry_cold *cold = it.cold.get_if_exists())
     {
-      for (internal::stack_entry & it : graph_it)
-      {
-        if (it.call_structure_index == call_info_index)
-        {
-          for (uint64_t callee_idx : it.children)
-          {
-            internal::stack_entry &callee = graph_it[callee_idx];
-
-            ret.emplace_back(introspect(internal::get_call_info_struct_at_index(callee.call_structure_index), callee.call_structure_index, &callee));
-          }
-        }
-      }
+      cold->fails.clear();
+      cold->reports.clear();
+      cold->sequences.clear();
+      cold->measure_points.clear();
+      cold->exemplars.clear();
     }
   }
-  else
-  {
-    for (uint64_t &callee_idx : context->children)
-    {
-      internal::stack_entry &callee = global->callgraph[context->stack_index][callee_idx];
-
-      ret.emplace_back(introspect(internal::get_call_info_struct_at_index(callee.call_structure_index), callee.call_structure_index, &callee));
-    }
-  }
-  return ret;
-}
-
-std::vector<neam::r::introspect> neam::r::introspect::get_caller_list() const
-{
-  std::vector<neam::r::introspect> ret;
-
-  std::lock_guard<internal::mutex_type> _u0(global->lock); // lock 'cause we do a lot of nasty things.
-
-  if (!context) // the global version
-  {
-    for (auto & graph_it : global->callgraph)
-    {
-      for (internal::stack_entry & it : graph_it)
-      {
-        if (it.call_structure_index == call_info_index)
-        {
-          size_t caller_idx = it.parent;
-          internal::stack_entry &caller = graph_it[caller_idx];
-
-          ret.emplace_back(introspect(internal::get_call_info_struct_at_index(caller.call_structure_index), caller.call_structure_index, &caller));
-        }
-      }
-    }
-  }
-  else if (context->parent == context->self_index || context->self_index == 0)
-  {
-    internal::stack_entry &caller = global->callgraph[context->stack_index][context->parent];
-
-    ret.emplace_back(introspect(internal::get_call_info_struct_at_index(caller.call_structure_index), caller.call_structure_index, &caller));
-  }
-  return ret;
 }
 
 std::vector<neam::r::introspect> neam::r::introspect::get_root_function_list()
 {
   std::vector<neam::r::introspect> ret;
   internal::data *global = internal::get_global_data();
+  internal::merge_thread_data();
 
   std::lock_guard<internal::mutex_type> _u0(global->lock); // lock 'cause we do a lot of nasty things.
 
@@ -148,11 +89,12 @@ std::vector<neam::r::reason> neam::r::introspect::get_failure_reasons(size_t cou
   if (!context)
     return ret;
 
-  count = std::min(count, context->fails.size());
+  const std::deque<neam::r::reason> &fails = context->cold.get().fails;
+  count = std::min(count, fails.size());
   ret.reserve(count);
 
-  for (size_t i = context->fails.size() - count; i < context->fails.size(); ++i)
-    ret.push_back(context->fails[i]);
+  for (size_t i = fails.size() - count; i < fails.size(); ++i)
+    ret.push_back(fails[i]);
 
   return ret;
 }
@@ -163,8 +105,9 @@ std::vector<neam::r::reason> neam::r::introspect::get_reports_for_mode(const std
   if (!context)
     return ret;
 
-  auto it = context->reports.find(mode);
-  if (it == context->reports.end())
+  const auto &reports_map = context->cold.get().reports;
+  auto it = reports_map.find(mode);
+  if (it == reports_map.end())
     return ret;
   const auto &reports = it->second;
 
@@ -176,3 +119,35 @@ std::vector<neam::r::reason> neam::r::introspect::get_reports_for_mode(const std
 
   return ret;
 }
+
+std::vector<neam::r::exemplar> neam::r::introspect::get_exemplars() const
+{
+  std::vector<neam::r::exemplar> ret;
+  if (!context)
+    return ret;
+
+  {
+    std::lock_guard<internal::mutex_type> _u0(global->lock);
+    const std::deque<neam::r::exemplar> &exemplars = context->cold.get().exemplars;
+    ret.assign(exemplars.begin(), exemplars.end());
+  }
+  std::sort(ret.begin(), ret.end(), [](const neam::r::exemplar &a, const neam::r::exemplar &b) { return a.duration > b.duration; });
+  return ret;
+}
+
+neam::r::introspect neam::r::introspect::get_exemplar_function(const neam::r::exemplar_call &call) const
+{
+  std::lock_guard<internal::mutex_type> _u0(global->lock);
+  if (call.call_structure_index >= global->func_info.size())
+    throw std::runtime_error("neam::r::introspect::get_exemplar_function(): the call does not refer to a known function");
+  return introspect(global->func_info[call.call_structure_index], call.call_structure_index, nullptr);
+}
+
+void neam::r::introspect::set_exemplar_threshold(double threshold)
+{
+  {
+    std::lock_guard<internal::mutex_type> _u0(global->lock);
+    call_info->exemplar_threshold = threshold;
+  }
+  internal::update_exemplar_thresholds();
+}
@@ -28,6 +28,9 @@
 
 #include <cstdint>
 #include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
 
 #include "tools/embed.hpp"
 
@@ -41,7 +44,57 @@ namespace neam
 {
   namespace r
   {
-    class function_call;
+    class basic_function_call;
+
+    /// \brief A read-only reference to some data of the global data, that holds the global lock while it exists
+    /// It avoids copying the maps and deques of a callgraph entry (see introspect::get_measure_point_map_view(), ...)
+    /// \warning The global lock is a spinlock: keep the view as short-lived as possible, and do not call anything that locks it
+    ///          (like the methods of introspect that aren't inline or any instrumented function) while you hold a view
+    template<typename Type>
+    class locked_view
+    {
+      public:
+        /// \brief Lock lock and reference data (or an empty Type if data is nullptr)
+        locked_view(internal::mutex_type &_lock, const Type *_data) : lock(&_lock), data(_data ? _data : &get_empty())
+        {
+          lock->lock();
+        }
+        /// \brief Lock lock and reference a member of the cold part of entry (or an empty Type if entry is nullptr or has no cold part)
+        /// \note The cold part is looked up once the lock is held (a merge may allocate it)
+        locked_view(internal::mutex_type &_lock, const internal::stack_entry *entry, Type internal::stack_entry_cold::*member) : lock(&_lock), data(&get_empty())
+        {
+          lock->lock();
+          if (entry && entry->cold.exists())
+            data = &(entry->cold.get().*member);
+        }
+        locked_view(locked_view &&o) : lock(o.lock), data(o.data)
+        {
+          o.lock = nullptr;
+        }
+        locked_view(const locked_view &) = delete;
+        locked_view &operator = (const locked_view &) = delete;
+
+        ~locked_view()
+        {
+          if (lock)
+            lock->unlock();
+        }
+
+        const Type &get() const { return *data; }
+        const Type &operator *() const { return *data; }
+        const Type *operator ->() const { return data; }
+
+      private:
+        static const Type &get_empty()
+        {
+          static const Type empty = Type();
+          return empty;
+        }
+
+      private:
+        internal::mutex_type *lock;
+        const Type *data;
+    };
 
     /// \brief The main class for introspection
     /// \see function_call
@@ -56,24 +109,27 @@ namespace neam
 
       public:
         /// \brief Construct a function call object
+        /// \note Creating an introspect object merges the pending per-thread counters into the global data
         /// \see N_FUNCTION_INFO
         /// \code neam::r::introspect info(N_FUNCTION_INFO(my_function)); \endcode
         /// \throw std::runtime_error if the function is not found
         template<typename FuncType, FuncType Func>
-        introspect(const func_descriptor &d, neam::embed::embed<FuncType, Func>)
+        introspect(const static_func_descriptor &d, neam::embed::embed<FuncType, Func>)
           : call_info_index(0), call_info(&internal::get_call_info_struct<FuncType, Func>(d, &call_info_index, true)),
             global(internal::get_global_data())
         {
+          internal::merge_thread_data();
         }
 
         /// \brief Construct a function call object for a [?]
         /// \note this is "slower" than normal functions 'cause the hash is computed at runtime (but it have a cache for call_info_index results)
         /// \throw std::runtime_error if the function is not found
         template<typename FuncType>
-        introspect(const func_descriptor &d, internal::type<FuncType>)
+        introspect(const static_func_descriptor &d, internal::type<FuncType>)
           : call_info_index(0), call_info(&internal::get_call_info_struct<FuncType>(d, &call_info_index, true)),
             global(internal::get_global_data())
         {
+          internal::merge_thread_data();
         }
 
         /// \brief Allow you to query at runtime arbitrary functions or methods
@@ -82,7 +138,7 @@ namespace neam
         /// \param[in] name The name of the function plus all the namespaces encapsulating it (like: "neam::r::introspect::common_init")
         /// \throw std::runtime_error if the function is not found
         /// \note that create a context-free introspect object (that can be latter contextualized)
-        explicit introspect(const char *const name) : introspect(func_descriptor {name}, internal::type<void>()) {}
+        explicit introspect(const char *const name) : introspect(static_func_descriptor {name, nullptr, nullptr, 0, nullptr, 0, 0}, internal::type<void>()) {}
 
         /// \brief Copy constructor (no move constructor, 'cause it wouldn't improve anything)
         introspect(const introspect &o);
@@ -92,27 +148,109 @@ namespace neam
 
         // ---- // Things that interact with the callgraph // ---- //
 
-        /// \brief Reset the gathered statistics for this particular function
-        /// \note slow, as it has to iterate over ALL the callgraph
+        /// \brief Reset the gathered statistics for this particular function (in all its callgraph entries)
         /// \note As its name implies it, this is a destructive operation
         void reset();
 
         /// \brief Walks the callgraph to provide the callee list (the list of function that are called by this one)
-        /// \note As "walk" can induce it, it's a quite slow operation
+        /// \note On a context-free introspect, this looks at every callgraph entry of the function
         /// \note The returned introspect ARE contextualized
         /// \note If this method is called on a contextualized introspect, it will only retrieve the "local" callees, and this is much faster than the other thing
-        std::vector<introspect> get_callee_list() const;
+        std::vector<introspect> get_callee_list() const
+        {
+          std::vector<introspect> ret;
+          get_callee_list(ret);
+          return ret;
+        }
+
+        /// \brief Same as get_callee_list(), but fill ret (cleared first): no allocation once ret is large enough
+        void get_callee_list(std::vector<introspect> &ret) const
+        {
+          ret.clear();
+          for_each_callee([&ret](const introspect &callee) { ret.push_back(callee); });
+        }
+
+        /// \brief Call f(const introspect &callee) for every callee (the same ones as get_callee_list()), without allocating anything
+        /// \warning f is called with the global lock held: it must not call anything that locks it (see locked_view)
+        template<typename Func>
+        void for_each_callee(Func &&f) const
+        {
+          std::lock_guard<internal::mutex_type> _u0(global->lock);
+
+          if (!context) // the global version
+          {
+            for (const auto &location : global->get_stack_entry_locations(call_info_index))
+            {
+              internal::stack_entry_list &graph = global->callgraph[location.first];
+              for (uint64_t callee_idx : graph[location.second].children)
+              {
+                internal::stack_entry &callee = graph[callee_idx];
+                f(introspect(global->func_info[callee.call_structure_index], callee.call_structure_index, &callee));
+              }
+            }
+          }
+          else
+          {
+            for (uint64_t callee_idx : context->children)
+            {
+              internal::stack_entry &callee = global->callgraph[context->stack_index][callee_idx];
+              f(introspect(global->func_info[callee.call_structure_index], callee.call_structure_index, &callee));
+            }
+          }
+        }
 
         /// \brief Walks the callgraph to retrieve the caller list (the list of function that call this one)
-        /// \note As "walk" can induce it, it's a quite slow operation
+        /// \note On a context-free introspect, this looks at every callgraph entry of the function
         /// \note The returned introspect ARE contextualized
         /// \note If this method is called on a contextualized introspect, it will only retrieve the "local" callers, and this is VERY much faster than the other thing
-        std::vector<introspect> get_caller_list() const;
+        std::vector<introspect> get_caller_list() const
+        {
+          std::vector<introspect> ret;
+          get_caller_list(ret);
+          return ret;
+        }
+
+        /// \brief Same as get_caller_list(), but fill ret (cleared first): no allocation once ret is large enough
+        void get_caller_list(std::vector<introspect> &ret) const
+        {
+          ret.clear();
+          for_each_caller([&ret](const introspect &caller) { ret.push_back(caller); });
+        }
+
+        /// \brief Call f(const introspect &caller) for every caller (the same ones as get_caller_list()), without allocating anything
+        /// \warning f is called with the global lock held: it must not call anything that locks it (see locked_view)
+        template<typename Func>
+        void for_each_caller(Func &&f) const
+        {
+          std::lock_guard<internal::mutex_type> _u0(global->lock);
+
+          if (!context) // the global version
+          {
+            for (const auto &location : global->get_stack_entry_locations(call_info_index))
+            {
+              internal::stack_entry_list &graph = global->callgraph[location.first];
+              internal::stack_entry &caller = graph[graph[location.second].parent];
+              f(introspect(global->func_info[caller.call_structure_index], caller.call_structure_index, &caller));
+            }
+          }
+          else if (context->parent == context->self_index || context->self_index == 0)
+          {
+            internal::stack_entry &caller = global->callgraph[context->stack_index][context->parent];
+            f(introspect(global->func_info[caller.call_structure_index], caller.call_structure_index, &caller));
+          }
+        }
 
         /// \brief Return the list of root functions (like, main(), the functions used to start threads, ...)
         /// \note this is a static function, yo.
         static std::vector<introspect> get_root_function_list();
 
+        /// \brief Return a contextualized introspect object for an entry of the callgraph of the global data
+        /// \note This is for the tools that walk the callgraph by themselves (the entry MUST be in get_global_data()->callgraph)
+        static introspect from_stack_entry(internal::stack_entry &entry)
+        {
+          return introspect(internal::get_call_info_struct_at_index(entry.call_structure_index), entry.call_structure_index, &entry);
+        }
+
         // ---- // operations/getters on the method/function // ---- //
 
         /// \brief Return whether or not a context is in use or not
@@ -199,7 +337,9 @@ namespace neam
         /// \brief Set the shorthand name
         void set_name(const std::string &name)
         {
+          std::lock_guard<internal::mutex_type> _u0(global->lock);
           call_info->descr.name = name;
+          global->changed_func_info.insert(call_info_index);
         }
 
         /// \brief Return the function descriptor of the function. You could copy it but NEVER, NEVER change it.
@@ -214,8 +354,9 @@ namespace neam
         {
           if (!context)
             return nullptr;
-          const auto &it = context->measure_points.find(name);
-          if (it == context->measure_points.end())
+          const auto &measure_points = context->cold.get().measure_points;
+          const auto &it = measure_points.find(name);
+          if (it == measure_points.end())
             return nullptr;
           return &it->second;
         }
@@ -223,27 +364,37 @@ namespace neam
         /// \brief Return the whole measure point map
         std::map<std::string, measure_point_entry> get_measure_point_map() const
         {
-          if (context)
-            return context->measure_points;
-          return std::map<std::string, measure_point_entry>();
+          return *get_measure_point_map_view();
+        }
+
+        /// \brief Return the whole measure point map, without copying it (see locked_view)
+        locked_view<std::map<std::string, measure_point_entry>> get_measure_point_map_view() const
+        {
+          return {global->lock, context, &internal::stack_entry_cold::measure_points};
         }
 
         /// \brief return the duration progression of the self time
         std::deque<duration_progression> get_self_duration_progression() const
         {
-          if (!context)
-            return std::deque<duration_progression>();
-          else
-            return context->self_time_progression;
+          return *get_self_duration_progression_view();
+        }
+
+        /// \brief return the duration progression of the self time, without copying it (see locked_view)
+        locked_view<std::deque<duration_progression>> get_self_duration_progression_view() const
+        {
+          return {global->lock, context, &internal::stack_entry_cold::self_time_progression};
         }
 
         /// \brief return the duration progression of the global time
         std::deque<duration_progression> get_global_duration_progression() const
         {
-          if (!context)
-            return std::deque<duration_progression>();
-          else
-            return context->global_time_progression;
+          return *get_global_duration_progression_view();
+        }
+
+        /// \brief return the duration progression of the global time, without copying it (see locked_view)
+        locked_view<std::deque<duration_progression>> get_global_duration_progression_view() const
+        {
+          return {global->lock, context, &internal::stack_entry_cold::global_time_progression};
         }
 
         /// \brief Return the probability of a incoming failure
@@ -285,6 +436,43 @@ namespace neam
           return call_info->average_global_time_count;
         }
 
+        /// \brief Return the distribution of the self duration of the function
+        inline const duration_histogram &get_self_duration_histogram() const
+        {
+          if (context)
+            return context->self_time_histogram;
+          return call_info->self_time_histogram;
+        }
+        /// \brief Return the distribution of the duration of the function (including all sub calls)
+        inline const duration_histogram &get_duration_histogram() const
+        {
+          if (context)
+            return context->global_time_histogram;
+          return call_info->global_time_histogram;
+        }
+        /// \brief Return a percentile of the self duration of the function (like get_self_duration_percentile(99.9) for the p99.9)
+        /// \param[in] percentile The percentile, in [0, 100]
+        inline float get_self_duration_percentile(double percentile) const
+        {
+          return get_self_duration_histogram().get_percentile(percentile);
+        }
+        /// \brief Return a percentile of the duration of the function (like get_duration_percentile(99.9) for the p99.9)
+        /// \param[in] percentile The percentile, in [0, 100]
+        inline float get_duration_percentile(double percentile) const
+        {
+          return get_duration_histogram().get_percentile(percentile);
+        }
+        /// \brief Return the longest self duration of the function
+        inline float get_max_self_duration() const
+        {
+          return get_self_duration_histogram().max;
+        }
+        /// \brief Return the longest duration of the function (including all sub calls)
+        inline float get_max_duration() const
+        {
+          return get_duration_histogram().max;
+        }
+
         /// \brief Return the last \e count errors for the function, most recent last
         /// \param[in] count The number of errors to return
         /// \note this method IS NOT context dependent, but always return errors from the global error list
@@ -300,16 +488,44 @@ namespace neam
         /// \note this method IS NOT context dependent
         std::map<std::string, std::deque<reason>> get_reports() const
         {
-          if (context)
-            return context->reports;
-          return std::map<std::string, std::deque<reason>>();
+          return *get_reports_view();
+        }
+
+        /// \brief Return the whole reports map, without copying it (see locked_view)
+        locked_view<std::map<std::string, std::deque<reason>>> get_reports_view() const
+        {
+          return {global->lock, context, &internal::stack_entry_cold::reports};
         }
 
+        /// \brief Return the sequences
         std::map<std::string, sequence> get_sequences() const
         {
-          if (context)
-            return context->sequences;
-          return std::map<std::string, sequence>();
+          return *get_sequences_view();
+        }
+
+        /// \brief Return the sequences, without copying them (see locked_view)
+        locked_view<std::map<std::string, sequence>> get_sequences_view() const
+        {
+          return {global->lock, context, &internal::stack_entry_cold::sequences};
+        }
+
+        /// \brief Return the exemplars: the call trees of the slowest calls of the function (see conf::exemplars), the slowest first
+        /// \note Only root functions have exemplars, and only in their context (see get_root_function_list())
+        std::vector<exemplar> get_exemplars() const;
+
+        /// \brief Return the (context-free) introspect of the function of a call of an exemplar
+        /// \throw std::runtime_error if the call does not refer to a known function
+        introspect get_exemplar_function(const exemplar_call &call) const;
+
+        /// \brief Set the duration (in seconds) over which a root call of the function is kept as an exemplar
+        /// \param[in] threshold The threshold. 0 means the p99 of the duration of the function (the default)
+        /// \note The threshold is not saved
+        void set_exemplar_threshold(double threshold);
+
+        /// \brief Return the exemplar threshold set with set_exemplar_threshold() (0 if it's the p99)
+        double get_exemplar_threshold() const
+        {
+          return call_info->exemplar_threshold;
         }
 
         /// \brief equality operator
@@ -338,7 +554,7 @@ namespace neam
 
         internal::stack_entry *context = nullptr;
 
-        friend class function_call;
+        friend class basic_function_call;
     };
   } // namespace r
 } // namespace neam
@@ -0,0 +1,154 @@
+
+#include <fstream>
+#include <new>
+
+#include "tools/logger/logger.hpp"
+#include "journal.hpp"
+#include "storage.hpp"
+
+#include "persistence_metadata.hpp"
+
+// A journal file is a sequence of records, each one being: [uint64_t size][serialized journal_record]
+
+bool neam::r::internal::make_journal_record(data &d, uint64_t data_index, journal_record &record)
+{
+  if (d.changed_func_info.empty() && d.changed_stack_entries.empty())
+    return false;
+
+  record.data_index = data_index;
+  record.launch_count = d.launch_count;
+  record.name = d.name;
+  record.timestamp = d.timestamp;
+
+  record.func_info.clear();
+  record.func_info.reserve(d.changed_func_info.size());
+  for (uint64_t index : d.changed_func_info)
+  {
+    if (index < d.func_info.size())
+      record.func_info.push_back(journal_call_info{index, d.func_info[index]});
+  }
+
+  record.callgraph.clear();
+  record.callgraph.reserve(d.changed_stack_entries.size());
+  for (const auto &it : d.changed_stack_entries)
+  {
+    if (it.first < d.callgraph.size() && it.second < d.callgraph[it.first].size())
+      record.callgraph.push_back(journal_stack_entry{it.first, it.second, persisted_stack_entry::from_stack_entry(d.callgraph[it.first][it.second])});
+  }
+
+  d.changed_func_info.clear();
+  d.changed_stack_entries.clear();
+  return true;
+}
+
+size_t neam::r::internal::append_journal_record(const std::string &journal_file, const journal_record &record)
+{
+  neam::cr::raw_data serialized_data = neam::cr::persistence::serialize<neam::cr::persistence_backend::json>(&record);
+
+  if (!serialized_data.size)
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to serialize a journal record for '" << journal_file << "'" << std::endl;
+    return 0;
+  }
+
+  const uint64_t size = serialized_data.size;
+  std::ofstream of(journal_file, std::ios_base::binary | std::ios_base::app);
+  of.write((const char *)&size, sizeof(size));
+  of.write((const char *)serialized_data.data, serialized_data.size);
+  of.flush();
+
+  if (!of)
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to append a journal record to '" << journal_file << "'" << std::endl;
+    return 0;
+  }
+  return sizeof(size) + serialized_data.size;
+}
+
+/// \brief Apply a record on a stash list
+bool neam::r::internal::apply_journal_record(const journal_record &record, std::deque<data> &root)
+{
+  while (root.size() <= record.data_index)
+    root.emplace_back();
+
+  data &d = root[record.data_index];
+  load_stash(d);
+  d.launch_count = record.launch_count;
+  d.name = record.name;
+  d.timestamp = record.timestamp;
+
+  for (const journal_call_info &it : record.func_info)
+  {
+    if (it.index < d.func_info.size())
+      d.func_info[it.index] = it.info;
+    else if (it.index == d.func_info.size())
+      d.func_info.push_back(it.info);
+    else
+      return false; // there's a hole: the journal does not match the snapshot
+  }
+
+  for (const journal_stack_entry &it : record.callgraph)
+  {
+    while (d.callgraph.size() <= it.stack_index)
+      d.callgraph.emplace_back();
+    stack_entry_list &graph = d.callgraph[it.stack_index];
+
+    if (it.self_index < graph.size())
+    {
+      // const members: we have to re-construct it
+      graph[it.self_index].~stack_entry();
+      new (&graph[it.self_index]) stack_entry(it.entry.to_stack_entry());
+    }
+    else if (it.self_index == graph.size())
+      graph.push_back(it.entry.to_stack_entry());
+    else
+      return false; // there's a hole: the journal does not match the snapshot
+
+    // the indexes aren't serialized
+    const_cast<uint64_t &>(graph[it.self_index].self_index) = it.self_index;
+    const_cast<uint64_t &>(graph[it.self_index].stack_index) = it.stack_index;
+  }
+  return true;
+}
+
+bool neam::r::internal::replay_journal(const std::string &journal_file, std::deque<data> &root)
+{
+  std::ifstream inf(journal_file, std::ios_base::binary);
+  if (!inf)
+    return false;
+
+  size_t count = 0;
+  std::string memory;
+  while (true)
+  {
+    uint64_t size = 0;
+    if (!inf.read((char *)&size, sizeof(size)))
+      break;
+
+    memory.resize(size + 1);
+    if (!inf.read(&memory[0], size))
+    {
+      neam::cr::out.warning() << LOGGER_INFO << "'" << journal_file << "': ignoring a truncated record" << std::endl;
+      break;
+    }
+    memory[size] = 0;
+
+    neam::cr::raw_data serialized_data;
+    serialized_data.ownership = false;
+    serialized_data.data = (int8_t *)&memory[0];
+    serialized_data.size = size;
+
+    journal_record *record = neam::cr::persistence::deserialize<neam::cr::persistence_backend::json, journal_record>(serialized_data);
+    if (!record || !apply_journal_record(*record, root))
+    {
+      delete record;
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to replay '" << journal_file << "', data is probably corrupted" << std::endl;
+      return false;
+    }
+    delete record;
+    ++count;
+  }
+
+  neam::cr::out.debug() << LOGGER_INFO << "Replayed " << count << " records from '" << journal_file << "'" << std::endl;
+  return true;
+}
@@ -0,0 +1,97 @@
+//
+// file : journal.hpp
+// in : file:///home/tim/projects/reflective/reflective/journal.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 16:05:41
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_14649377870619113110_202561926__JOURNAL_HPP__
+# define __N_14649377870619113110_202561926__JOURNAL_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "call_info_struct.hpp"
+#include "stack_entry.hpp"
+
+namespace neam
+{
+  namespace r
+  {
+    namespace internal
+    {
+      class data;
+
+      /// \brief A call_info_struct that has changed since the last journal record
+      struct journal_call_info
+      {
+        uint64_t index; ///< \brief Index in data::func_info
+        call_info_struct info;
+      };
+
+      /// \brief A stack_entry that has changed since the last journal record
+      struct journal_stack_entry
+      {
+        uint64_t stack_index; ///< \brief Index in data::callgraph
+        uint64_t self_index; ///< \brief Index in data::callgraph[stack_index]
+        persisted_stack_entry entry;
+      };
+
+      /// \brief What has changed in a data since the last record
+      /// Records hold the whole state of the changed entries (not their increments),
+      /// so replaying a record more than once, or over a snapshot that already contains it, is harmless.
+      struct journal_record
+      {
+        uint64_t data_index; ///< \brief Index of the data in the stash list
+        uint64_t launch_count;
+        std::string name;
+        int64_t timestamp;
+
+        std::vector<journal_call_info> func_info;
+        std::vector<journal_stack_entry> callgraph;
+      };
+
+      /// \brief Build a record with what has changed in d, and clear its changes
+      /// \note The lock of d must be held
+      /// \return false if nothing has changed
+      bool make_journal_record(data &d, uint64_t data_index, journal_record &record);
+
+      /// \brief Append a record at the end of a journal file
+      /// \return the number of bytes written (0 on failure)
+      size_t append_journal_record(const std::string &journal_file, const journal_record &record);
+
+      /// \brief Apply a record on a stash list
+      /// \return false if the record does not match the stash list (it would leave a hole in it)
+      bool apply_journal_record(const journal_record &record, std::deque<data> &root);
+
+      /// \brief Replay all the records of a journal file on a stash list
+      /// \note A truncated record at the end of the file (an append that hasn't completed) is ignored
+      /// \return false if the file does not exists or is corrupted
+      bool replay_journal(const std::string &journal_file, std::deque<data> &root);
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_14649377870619113110_202561926__JOURNAL_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
@@ -0,0 +1,62 @@
+//
+// file : level.hpp
+// in : file:///home/tim/projects/reflective/reflective/level.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 22:41:19
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_4349990210823748929_1797479767__LEVEL_HPP__
+# define __N_4349990210823748929_1797479767__LEVEL_HPP__
+
+/// \file level.hpp
+/// \brief The compile-time instrumentation level
+///
+/// N_R_LEVEL selects what neam::r::function_call and neam::r::measure_point are in a translation unit:
+///  - N_R_LEVEL_DISABLED: they are empty objects that do nothing (and are fully inlined away). fail() and report() with a predefined reason,
+///                        N_REASON_INFO and a literal message build no string (see reason_info)
+///  - N_R_LEVEL_COUNTS: calls, fails, reports and the callgraph are recorded, but nothing is timed
+///                      (conf::monitor_*, monitor_self_time() and monitor_global_time() are ignored, measure points are disabled)
+///  - N_R_LEVEL_FULL: everything (this is the default)
+///
+/// Define it before including any reflective header, like:
+/// \code
+/// #define N_R_LEVEL N_R_LEVEL_DISABLED
+/// #include <reflective/reflective.hpp>
+/// \endcode
+/// or per module, from the build system (-DN_R_LEVEL=0).
+/// \note The library itself does not depend on N_R_LEVEL: translation units with different levels can be linked together.
+///       Do not use function_call or measure_point in inline functions of headers shared by modules with different levels.
+
+#define N_R_LEVEL_DISABLED  0
+#define N_R_LEVEL_COUNTS    1
+#define N_R_LEVEL_FULL      2
+
+#ifndef N_R_LEVEL
+# define N_R_LEVEL N_R_LEVEL_FULL
+#endif
+
+#if N_R_LEVEL != N_R_LEVEL_DISABLED && N_R_LEVEL != N_R_LEVEL_COUNTS && N_R_LEVEL != N_R_LEVEL_FULL
+# error "N_R_LEVEL must be N_R_LEVEL_DISABLED, N_R_LEVEL_COUNTS or N_R_LEVEL_FULL"
+#endif
+
+#endif /*__N_4349990210823748929_1797479767__LEVEL_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
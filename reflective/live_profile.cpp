@@ -0,0 +1,280 @@
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "tools/logger/logger.hpp"
+#include "live_profile.hpp"
+#include "config.hpp"
+
+namespace
+{
+  static constexpr size_t min_capacity = 64 * 1024;
+  static constexpr unsigned max_read_tries = 100;
+
+  static std::mutex live_lock; // protects the segment (a publisher never holds it while encoding)
+  static int segment_fd = -1;
+  static neam::r::live::live_header *segment = nullptr;
+  static size_t segment_size = 0;
+  static std::string segment_name;
+
+  static std::thread publisher_thread;
+  static std::mutex publisher_mutex;
+  static std::condition_variable publisher_cv;
+  static bool publisher_stop = false; // protected by publisher_mutex
+  static bool atexit_registered = false; // protected by publisher_mutex
+
+  static std::string _get_shm_name(const std::string &name)
+  {
+    if (name.empty() || name[0] != '/')
+      return '/' + name;
+    return name;
+  }
+
+#ifndef _WIN32
+  /// \brief (Re)map the segment with a given size. live_lock must be held
+  /// \note On failure, the previous mapping (if any) is still there (the new one is mapped before the previous one is unmapped)
+  static bool _map_segment(size_t size)
+  {
+    if (ftruncate(segment_fd, off_t(size)) != 0)
+      return false;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+    if (memory == MAP_FAILED)
+      return false;
+    if (segment)
+      munmap(segment, segment_size);
+    segment = reinterpret_cast<neam::r::live::live_header *>(memory);
+    segment_size = size;
+    return true;
+  }
+#endif
+
+  /// \brief Write an image in the segment. live_lock must be held
+  static void _write_image(const std::string &image)
+  {
+#ifndef _WIN32
+    if (!segment)
+      return;
+
+    // the sequence is odd from now on: readers will retry
+    const uint64_t sequence = __atomic_load_n(&segment->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&segment->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (image.size() > segment->capacity)
+    {
+      size_t capacity = segment->capacity;
+      while (capacity < image.size())
+        capacity *= 2;
+      if (!_map_segment(sizeof(neam::r::live::live_header) + capacity))
+      {
+        neam::cr::out.warning() << LOGGER_INFO << "Failed to grow the live profile '" << segment_name << "'" << std::endl;
+        __atomic_store_n(&segment->sequence, sequence, __ATOMIC_RELEASE); // nothing has changed (the segment is still mapped)
+        return;
+      }
+      segment->capacity = capacity;
+    }
+
+    memcpy(segment + 1, image.data(), image.size());
+    segment->size = image.size();
+    ++segment->publish_count;
+    segment->timestamp = time(nullptr);
+
+    __atomic_store_n(&segment->sequence, sequence + 2, __ATOMIC_RELEASE);
+#else
+    (void)image;
+#endif
+  }
+
+  static void _publisher_loop()
+  {
+    std::unique_lock<std::mutex> _u0(publisher_mutex);
+    while (!publisher_stop)
+    {
+      publisher_cv.wait_for(_u0, std::chrono::milliseconds(std::max<size_t>(neam::r::conf::live_profile_interval, 1)));
+      if (publisher_stop)
+        break;
+
+      _u0.unlock();
+      neam::r::publish_live_profile();
+      _u0.lock();
+    }
+  }
+
+  static void _stop_publisher()
+  {
+    {
+      std::lock_guard<std::mutex> _u0(publisher_mutex);
+      publisher_stop = true;
+      publisher_cv.notify_one();
+    }
+    if (publisher_thread.joinable())
+      publisher_thread.join();
+  }
+} // namespace
+
+bool neam::r::start_live_profile(const std::string &name)
+{
+#ifndef _WIN32
+  {
+    std::lock_guard<std::mutex> _u0(live_lock);
+    if (segment && segment_name == _get_shm_name(name))
+      return true; // already published there
+  }
+  stop_live_profile();
+
+  {
+    std::lock_guard<std::mutex> _u0(live_lock);
+    segment_name = _get_shm_name(name);
+    segment_fd = shm_open(segment_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, mode_t(conf::live_profile_mode));
+    if (segment_fd < 0)
+    {
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to create the live profile '" << segment_name << "': " << strerror(errno) << std::endl;
+      return false;
+    }
+    if (fchmod(segment_fd, mode_t(conf::live_profile_mode)) != 0) // the segment may already exist (with other permissions)
+    {
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to set the permissions of the live profile '" << segment_name << "': " << strerror(errno) << std::endl;
+      close(segment_fd);
+      segment_fd = -1;
+      return false;
+    }
+    if (!_map_segment(sizeof(live::live_header) + min_capacity))
+    {
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to map the live profile '" << segment_name << "'" << std::endl;
+      close(segment_fd);
+      shm_unlink(segment_name.c_str());
+      segment_fd = -1;
+      return false;
+    }
+
+    memset(segment, 0, sizeof(live::live_header));
+    segment->magic = live::magic;
+    segment->version = live::version;
+    segment->capacity = min_capacity;
+    segment->pid = getpid();
+  }
+
+  {
+    std::lock_guard<std::mutex> _u0(publisher_mutex);
+    publisher_stop = false;
+    publisher_thread = std::thread(_publisher_loop);
+    if (!atexit_registered)
+    {
+      std::atexit([]() { neam::r::stop_live_profile(); });
+      atexit_registered = true;
+    }
+  }
+
+  neam::cr::out.debug() << LOGGER_INFO << "Publishing the live profile in '" << segment_name << "'" << std::endl;
+  return true;
+#else
+  neam::cr::out.warning() << LOGGER_INFO << "The live profile '" << name << "' is not available on this platform" << std::endl;
+  return false;
+#endif
+}
+
+void neam::r::stop_live_profile()
+{
+  _stop_publisher();
+
+#ifndef _WIN32
+  std::lock_guard<std::mutex> _u0(live_lock);
+  if (segment)
+    munmap(segment, segment_size);
+  if (segment_fd >= 0)
+  {
+    close(segment_fd);
+    shm_unlink(segment_name.c_str());
+  }
+  segment = nullptr;
+  segment_size = 0;
+  segment_fd = -1;
+#endif
+}
+
+void neam::r::publish_live_profile()
+{
+  {
+    std::lock_guard<std::mutex> _u0(live_lock);
+    if (!segment)
+      return;
+  }
+
+  // encoding takes the internal locks: do it without holding the live lock
+  const std::string image = internal::encode_live_data();
+  if (image.empty())
+    return;
+
+  std::lock_guard<std::mutex> _u0(live_lock);
+  _write_image(image);
+}
+
+bool neam::r::internal::read_live_profile(const std::string &name, std::string &image, live::live_header *header)
+{
+#ifndef _WIN32
+  const std::string shm_name = _get_shm_name(name);
+  const int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+
+  bool ret = false;
+  for (unsigned i = 0; i < max_read_tries && !ret; ++i)
+  {
+    if (i)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    // the segment may have grown since the last try
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(live::live_header))
+      continue;
+    const size_t size = size_t(st.st_size);
+    void *memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+      continue;
+    const live::live_header *hdr = reinterpret_cast<const live::live_header *>(memory);
+
+    const uint64_t sequence = __atomic_load_n(&hdr->sequence, __ATOMIC_ACQUIRE);
+    live::live_header copy;
+    memcpy(&copy, hdr, sizeof(copy));
+    if (copy.magic != live::magic || copy.version != live::version)
+    {
+      munmap(memory, size);
+      break;
+    }
+    if (!(sequence & 1) && copy.publish_count && copy.size <= size - sizeof(live::live_header))
+    {
+      image.assign(reinterpret_cast<const char *>(hdr + 1), copy.size);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&hdr->sequence, __ATOMIC_RELAXED) == sequence)
+      {
+        copy.sequence = sequence;
+        if (header)
+          *header = copy;
+        ret = true;
+      }
+    }
+    munmap(memory, size);
+  }
+  close(fd);
+  return ret;
+#else
+  (void)name;
+  (void)image;
+  (void)header;
+  return false;
+#endif
+}
@@ -0,0 +1,94 @@
+//
+// file : live_profile.hpp
+// in : file:///home/tim/projects/reflective/reflective/live_profile.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 23:05:37
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_12328264223553315511_2142229769__LIVE_PROFILE_HPP__
+# define __N_12328264223553315511_2142229769__LIVE_PROFILE_HPP__
+
+#include <cstdint>
+#include <string>
+
+namespace neam
+{
+  namespace r
+  {
+    /// \brief The live profile: a shared memory segment (shm_open()) that external tools can read while the process runs
+    /// A publisher thread periodically merges the per-thread counters and writes the whole data, in the binary format (see binary_format.hpp),
+    /// in the segment. The segment is protected by a seqlock: readers never block the process, they copy the image and retry if it has
+    /// been modified meanwhile. The instrumented threads never touch the segment.
+    ///
+    /// Layout: [live_header] [binary image (size bytes)]
+    /// \note The segment is removed by stop_live_profile() (and at exit)
+    /// \note Not available on windows (start_live_profile() returns false)
+    namespace live
+    {
+      static constexpr uint32_t magic = 0x4C524E2E; // ".NRL"
+      static constexpr uint32_t version = 1;
+
+      /// \brief The header of the segment
+      struct live_header
+      {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sequence; ///< \brief The seqlock: odd while the image is being written. Only use it with atomic operations.
+        uint64_t capacity; ///< \brief The number of bytes available for the image (after the header)
+        uint64_t size; ///< \brief The size of the image
+        uint64_t publish_count; ///< \brief The number of images published so far
+        int64_t timestamp; ///< \brief When the image has been published
+        int64_t pid; ///< \brief The pid of the process
+        uint64_t _reserved;
+      };
+      static_assert(sizeof(live_header) == 64, "live::live_header must have a fixed size");
+    } // namespace live
+
+    /// \brief Create the live profile segment and start publishing in it every conf::live_profile_interval milliseconds
+    /// \param[in] name The name of the segment (as for shm_open(), a leading '/' is added if missing)
+    /// \note This is done automatically when conf::live_profile is set when reflective is initialized
+    bool start_live_profile(const std::string &name);
+
+    /// \brief Stop publishing and remove the live profile segment
+    void stop_live_profile();
+
+    /// \brief Publish the current data now (does nothing if the live profile isn't started)
+    void publish_live_profile();
+
+    /// \brief Read the live profile of another process (or of this one) and load it like load_data_from_disk()
+    /// \note As with load_data_from_disk(), you probably want to set conf::disable_auto_save and conf::out_file before calling this
+    bool load_data_from_live_profile(const std::string &name);
+
+    namespace internal
+    {
+      /// \brief Copy a consistent image of the live profile segment name
+      /// \return false if the segment does not exist, is invalid, or if no consistent image could be read
+      bool read_live_profile(const std::string &name, std::string &image, live::live_header *header = nullptr);
+
+      /// \brief Merge the per-thread counters and encode the whole data in the binary format (see storage.cpp)
+      std::string encode_live_data();
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_12328264223553315511_2142229769__LIVE_PROFILE_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
@@ -7,9 +7,9 @@
 #include "measure_point.hpp"
 #include "config.hpp"
 
-void neam::r::measure_point::_save()
+void neam::r::basic_measure_point::_save()
 {
-  function_call *cfc = function_call::get_active_function_call();
+  basic_function_call *cfc = basic_function_call::get_active_function_call();
   if (!cfc)
   {
     neam::cr::out.debug() << LOGGER_INFO << "could not save measure point '" << name << "': no active function_call object." << std::endl;
@@ -19,7 +19,10 @@ void neam::r::measure_point::_save()
   internal::stack_entry *se = cfc->se;
   if (!se)
     return;
-  measure_point_entry &mpe = se->measure_points[name];
+
+  std::lock_guard<internal::mutex_type> _u0(cfc->tl_data->lock);
+  cfc->tl_data->use_global(cfc->global);
+  measure_point_entry &mpe = se->cold.get_or_create().measure_points[name];
 
   uint64_t mcount = mpe.hit_count;
   if (conf::sliding_average)
@@ -30,16 +33,20 @@ void neam::r::measure_point::_save()
   ++mpe.hit_count;
 }
 
-double neam::r::measure_point::get_average_time() const
+double neam::r::basic_measure_point::get_average_time() const
 {
-  function_call *cfc = function_call::get_active_function_call();
+  basic_function_call *cfc = basic_function_call::get_active_function_call();
   if (!cfc)
     return 0.;
 
   internal::stack_entry *se = cfc->se;
   if (!se)
     return 0.;
-  measure_point_entry &mpe = se->measure_points[name];
 
-  return mpe.value;
+  std::lock_guard<internal::mutex_type> _u0(cfc->tl_data->lock);
+  const std::map<std::string, measure_point_entry> &measure_points = se->cold.get().measure_points;
+  const auto it = measure_points.find(name);
+  if (it == measure_points.end())
+    return 0.;
+  return it->second.value;
 }
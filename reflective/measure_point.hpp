@@ -26,7 +26,9 @@
 #ifndef __N_9812925241253721972_117284647__MEASURE_POINT_HPP__
 # define __N_9812925241253721972_117284647__MEASURE_POINT_HPP__
 
-#include "tools/chrono.hpp"
+#include "level.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
 
 namespace neam
 {
@@ -38,14 +40,15 @@ namespace neam
     /// \brief Some additional, named, chrono information to a monitored function
     /// \note only a measure_point that has been started and stopped
     ///       (could be by the constructor and the destructor) will be saved.
-    class measure_point
+    /// \note Use neam::r::measure_point, which is this class unless N_R_LEVEL says otherwise (see level.hpp)
+    class basic_measure_point
     {
       public:
         /// \brief Construct (and activate) a measure point
         /// \param[in] name The name of the measure point
         /// \note name should not a dynamically allocated string, else it has to live in
         ///       the same scope as the instance.
-        measure_point(const char *_name) : name(_name)
+        basic_measure_point(const char *_name) : name(_name)
         {
           start();
         }
@@ -54,10 +57,10 @@ namespace neam
         /// \param[in] name The name of the measure point
         /// \note name should not a dynamically allocated string, else it has to live in
         ///       the same scope as the instance.
-        measure_point(const char *_name, defer_start_t) : name(_name) {}
+        basic_measure_point(const char *_name, defer_start_t) : name(_name) {}
 
         /// \brief destructor
-        ~measure_point()
+        ~basic_measure_point()
         {
           stop();
         }
@@ -68,10 +71,13 @@ namespace neam
         {
           if (running)
           {
-            value = chrono.get_accumulated_time();
+            const uint64_t ticks = chrono.get_accumulated_ticks();
+            value = internal::clock::to_seconds(ticks);
             running = false;
             stopped = true;
             _save();
+            if (internal::trace::is_enabled())
+              internal::trace::record(chrono.start, ticks, internal::trace::intern_name(name), internal::trace::event_type::measure_point);
           }
         }
 
@@ -103,13 +109,33 @@ namespace neam
 
       private:
         const char *name;
-        cr::chrono chrono;
+        internal::tick_chrono chrono;
         double value = 0;
 
         bool started = false; ///< \brief True if the instance has run
         bool running = false; ///< \brief True if the instance is running
         bool stopped = false; ///< \brief True if the instance is stopped
     };
+
+    /// \brief A measure_point for N_R_LEVEL_DISABLED and N_R_LEVEL_COUNTS: an empty object, every method does nothing
+    class disabled_measure_point
+    {
+      public:
+        disabled_measure_point(const char *) {}
+        disabled_measure_point(const char *, defer_start_t) {}
+
+        void stop() {}
+        void start() {}
+        double get_average_time() const { return 0.; }
+        double get_elapsed_time() const { return 0.; }
+    };
+
+    /// \brief A named chrono in the current function call in this translation unit (depends on N_R_LEVEL)
+#if N_R_LEVEL == N_R_LEVEL_FULL
+    using measure_point = basic_measure_point;
+#else
+    using measure_point = disabled_measure_point;
+#endif
   } // namespace r
 } // namespace neam
 
@@ -37,10 +37,11 @@
 #include "call_info_struct.hpp"
 #include "stack_entry.hpp"
 #include "storage.hpp"
+#include "journal.hpp"
 
 
 // This file will hold all serialization metadata for reflective
-// This file should not be included except by storage.cpp
+// This file should not be included except by storage.cpp and journal.cpp
 
 namespace neam
 {
@@ -84,6 +85,60 @@ namespace neam
       NCRP_NAMED_TYPED_OFFSET(r::duration_progression, value, names::r__duration_progression::value)
     > {};
 
+    // // duration_histogram // //
+    NCRP_DECLARE_NAME(r__duration_histogram, first_bucket);
+    NCRP_DECLARE_NAME(r__duration_histogram, buckets);
+    NCRP_DECLARE_NAME(r__duration_histogram, count);
+    NCRP_DECLARE_NAME(r__duration_histogram, max);
+    template<typename Backend> class persistence::serializable<Backend, r::duration_histogram> : public persistence::serializable_object
+    <
+      Backend, // < the backend (here: all backends)
+
+      r::duration_histogram, // < the class type to handle
+
+      // simply list here the members you want to serialize / deserialize
+      NCRP_NAMED_TYPED_OFFSET(r::duration_histogram, first_bucket, names::r__duration_histogram::first_bucket),
+      NCRP_NAMED_TYPED_OFFSET(r::duration_histogram, buckets, names::r__duration_histogram::buckets),
+      NCRP_NAMED_TYPED_OFFSET(r::duration_histogram, count, names::r__duration_histogram::count),
+      NCRP_NAMED_TYPED_OFFSET(r::duration_histogram, max, names::r__duration_histogram::max)
+    > {};
+
+    // // exemplar_call // //
+    NCRP_DECLARE_NAME(r__exemplar_call, call_structure_index);
+    NCRP_DECLARE_NAME(r__exemplar_call, depth);
+    NCRP_DECLARE_NAME(r__exemplar_call, start);
+    NCRP_DECLARE_NAME(r__exemplar_call, duration);
+    template<typename Backend> class persistence::serializable<Backend, r::exemplar_call> : public persistence::serializable_object
+    <
+      Backend, // < the backend (here: all backends)
+
+      r::exemplar_call, // < the class type to handle
+
+      // simply list here the members you want to serialize / deserialize
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar_call, call_structure_index, names::r__exemplar_call::call_structure_index),
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar_call, depth, names::r__exemplar_call::depth),
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar_call, start, names::r__exemplar_call::start),
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar_call, duration, names::r__exemplar_call::duration)
+    > {};
+
+    // // exemplar // //
+    NCRP_DECLARE_NAME(r__exemplar, timestamp);
+    NCRP_DECLARE_NAME(r__exemplar, duration);
+    NCRP_DECLARE_NAME(r__exemplar, dropped_calls);
+    NCRP_DECLARE_NAME(r__exemplar, calls);
+    template<typename Backend> class persistence::serializable<Backend, r::exemplar> : public persistence::serializable_object
+    <
+      Backend, // < the backend (here: all backends)
+
+      r::exemplar, // < the class type to handle
+
+      // simply list here the members you want to serialize / deserialize
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar, timestamp, names::r__exemplar::timestamp),
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar, duration, names::r__exemplar::duration),
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar, dropped_calls, names::r__exemplar::dropped_calls),
+      NCRP_NAMED_TYPED_OFFSET(r::exemplar, calls, names::r__exemplar::calls)
+    > {};
+
     // // measure_point_entry // //
     NCRP_DECLARE_NAME(r__measure_point_entry, hit_count);
     NCRP_DECLARE_NAME(r__measure_point_entry, value);
@@ -156,7 +211,7 @@ namespace neam
       NCRP_NAMED_TYPED_OFFSET(r::internal::data, name, names::r__data::name),
       NCRP_NAMED_TYPED_OFFSET(r::internal::data, timestamp, names::r__data::timestamp),
       NCRP_NAMED_TYPED_OFFSET(r::internal::data, func_info, names::r__data::func_info),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::data, callgraph, names::r__data::callgraph)
+      NCRP_NAMED_TYPED_OFFSET(r::internal::data, persisted_callgraph, names::r__data::callgraph)
     > {};
 
     // // func_descriptor // //
@@ -189,6 +244,8 @@ namespace neam
     NCRP_DECLARE_NAME(r__call_info_struct, average_self_time_count);
     NCRP_DECLARE_NAME(r__call_info_struct, average_global_time);
     NCRP_DECLARE_NAME(r__call_info_struct, average_global_time_count);
+    NCRP_DECLARE_NAME(r__call_info_struct, self_time_histogram);
+    NCRP_DECLARE_NAME(r__call_info_struct, global_time_histogram);
     template<typename Backend> class persistence::serializable<Backend, r::internal::call_info_struct> : public persistence::serializable_object
     <
       Backend, // < the backend (here: all backends)
@@ -202,10 +259,13 @@ namespace neam
       NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, average_self_time, names::r__call_info_struct::average_self_time),
       NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, average_self_time_count, names::r__call_info_struct::average_self_time_count),
       NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, average_global_time, names::r__call_info_struct::average_global_time),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, average_global_time_count, names::r__call_info_struct::average_global_time_count)
+      NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, average_global_time_count, names::r__call_info_struct::average_global_time_count),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, self_time_histogram, names::r__call_info_struct::self_time_histogram),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::call_info_struct, global_time_histogram, names::r__call_info_struct::global_time_histogram)
     > {};
 
     // // stack_entry // //
+    // (the JSON layout of a stack_entry, with its cold part inline)
     NCRP_DECLARE_NAME(r__stack_entry, self_index);
     NCRP_DECLARE_NAME(r__stack_entry, stack_index);
     NCRP_DECLARE_NAME(r__stack_entry, call_structure_index);
@@ -217,36 +277,94 @@ namespace neam
     NCRP_DECLARE_NAME(r__stack_entry, average_global_time);
     NCRP_DECLARE_NAME(r__stack_entry, average_global_time_count);
     NCRP_DECLARE_NAME(r__stack_entry, global_time_progression);
+    NCRP_DECLARE_NAME(r__stack_entry, self_time_histogram);
+    NCRP_DECLARE_NAME(r__stack_entry, global_time_histogram);
     NCRP_DECLARE_NAME(r__stack_entry, sequences);
     NCRP_DECLARE_NAME(r__stack_entry, fails);
     NCRP_DECLARE_NAME(r__stack_entry, reports);
     NCRP_DECLARE_NAME(r__stack_entry, measure_points);
+    NCRP_DECLARE_NAME(r__stack_entry, exemplars);
     NCRP_DECLARE_NAME(r__stack_entry, parent);
     NCRP_DECLARE_NAME(r__stack_entry, children);
-    template<typename Backend> class persistence::serializable<Backend, r::internal::stack_entry> : public persistence::serializable_object
+    template<typename Backend> class persistence::serializable<Backend, r::internal::persisted_stack_entry> : public persistence::serializable_object
+    <
+      Backend, // < the backend (here: all backends)
+
+      r::internal::persisted_stack_entry, // < the class type to handle
+
+      // simply list here the members you want to serialize / deserialize
+//       NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, self_index, names::r__stack_entry::self_index),
+//       NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, stack_index, names::r__stack_entry::stack_index),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, call_structure_index, names::r__stack_entry::call_structure_index),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, hit_count, names::r__stack_entry::hit_count),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, fail_count, names::r__stack_entry::fail_count),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, average_self_time, names::r__stack_entry::average_self_time),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, average_self_time_count, names::r__stack_entry::average_self_time_count),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, self_time_progression, names::r__stack_entry::self_time_progression),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, average_global_time, names::r__stack_entry::average_global_time),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, average_global_time_count, names::r__stack_entry::average_global_time_count),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, global_time_progression, names::r__stack_entry::global_time_progression),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, self_time_histogram, names::r__stack_entry::self_time_histogram),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, global_time_histogram, names::r__stack_entry::global_time_histogram),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, sequences, names::r__stack_entry::sequences),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, measure_points, names::r__stack_entry::measure_points),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, fails, names::r__stack_entry::fails),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, reports, names::r__stack_entry::reports),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, exemplars, names::r__stack_entry::exemplars),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, parent, names::r__stack_entry::parent),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::persisted_stack_entry, children, names::r__stack_entry::children)
+    > {};
+
+    // // journal_call_info // //
+    NCRP_DECLARE_NAME(r__journal_call_info, index);
+    NCRP_DECLARE_NAME(r__journal_call_info, info);
+    template<typename Backend> class persistence::serializable<Backend, r::internal::journal_call_info> : public persistence::serializable_object
+    <
+      Backend, // < the backend (here: all backends)
+
+      r::internal::journal_call_info, // < the class type to handle
+
+      // simply list here the members you want to serialize / deserialize
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_call_info, index, names::r__journal_call_info::index),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_call_info, info, names::r__journal_call_info::info)
+    > {};
+
+    // // journal_stack_entry // //
+    NCRP_DECLARE_NAME(r__journal_stack_entry, stack_index);
+    NCRP_DECLARE_NAME(r__journal_stack_entry, self_index);
+    NCRP_DECLARE_NAME(r__journal_stack_entry, entry);
+    template<typename Backend> class persistence::serializable<Backend, r::internal::journal_stack_entry> : public persistence::serializable_object
+    <
+      Backend, // < the backend (here: all backends)
+
+      r::internal::journal_stack_entry, // < the class type to handle
+
+      // simply list here the members you want to serialize / deserialize
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_stack_entry, stack_index, names::r__journal_stack_entry::stack_index),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_stack_entry, self_index, names::r__journal_stack_entry::self_index),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_stack_entry, entry, names::r__journal_stack_entry::entry)
+    > {};
+
+    // // journal_record // //
+    NCRP_DECLARE_NAME(r__journal_record, data_index);
+    NCRP_DECLARE_NAME(r__journal_record, launch_count);
+    NCRP_DECLARE_NAME(r__journal_record, name);
+    NCRP_DECLARE_NAME(r__journal_record, timestamp);
+    NCRP_DECLARE_NAME(r__journal_record, func_info);
+    NCRP_DECLARE_NAME(r__journal_record, callgraph);
+    template<typename Backend> class persistence::serializable<Backend, r::internal::journal_record> : public persistence::serializable_object
     <
       Backend, // < the backend (here: all backends)
 
-      r::internal::stack_entry, // < the class type to handle
+      r::internal::journal_record, // < the class type to handle
 
       // simply list here the members you want to serialize / deserialize
-//       NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, self_index, names::r__stack_entry::self_index),
-//       NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, stack_index, names::r__stack_entry::stack_index),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, call_structure_index, names::r__stack_entry::call_structure_index),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, hit_count, names::r__stack_entry::hit_count),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, fail_count, names::r__stack_entry::fail_count),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, average_self_time, names::r__stack_entry::average_self_time),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, average_self_time_count, names::r__stack_entry::average_self_time_count),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, self_time_progression, names::r__stack_entry::self_time_progression),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, average_global_time, names::r__stack_entry::average_global_time),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, average_global_time_count, names::r__stack_entry::average_global_time_count),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, global_time_progression, names::r__stack_entry::global_time_progression),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, sequences, names::r__stack_entry::sequences),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, measure_points, names::r__stack_entry::measure_points),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, fails, names::r__stack_entry::fails),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, reports, names::r__stack_entry::reports),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, parent, names::r__stack_entry::parent),
-      NCRP_NAMED_TYPED_OFFSET(r::internal::stack_entry, children, names::r__stack_entry::children)
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_record, data_index, names::r__journal_record::data_index),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_record, launch_count, names::r__journal_record::launch_count),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_record, name, names::r__journal_record::name),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_record, timestamp, names::r__journal_record::timestamp),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_record, func_info, names::r__journal_record::func_info),
+      NCRP_NAMED_TYPED_OFFSET(r::internal::journal_record, callgraph, names::r__journal_record::callgraph)
     > {};
   } // namespace cr
 } // namespace neam
@@ -32,6 +32,8 @@ namespace neam
 {
   namespace r
   {
+    struct reason_info;
+
     /// \brief A failure reason
     struct reason
     {
@@ -66,6 +68,10 @@ namespace neam
       reason operator() (const std::string &_file, uint64_t _line) const { return reason { type, message, _file, _line }; }
       reason operator() (const std::string &_file, uint64_t _line, const std::string &_message) const { return reason { type, _message, _file, _line }; }
 
+      /// \brief Same as above, but with raw strings (like N_REASON_INFO and a literal): nothing is copied until the reason_info is converted to a reason
+      inline reason_info operator() (const char *_file, uint64_t _line) const;
+      inline reason_info operator() (const char *_file, uint64_t _line, const char *_message) const;
+
       /// \brief Equality operator
       bool operator == (const reason &o) const
       {
@@ -82,6 +88,25 @@ namespace neam
       }
     };
 
+    /// \brief A predefined reason with a file, a line and maybe a message (see reason::operator()), that has not been copied in a reason yet
+    /// function_call::fail() and report() convert it to a reason, but at N_R_LEVEL_DISABLED they take it as it is: the strings are never built.
+    /// \note It references the predefined reason: use it in the expression that creates it
+    struct reason_info
+    {
+      const reason &base;
+      const char *file;
+      uint64_t line;
+      const char *message; ///< \brief nullptr: the message of base
+
+      operator reason () const
+      {
+        return reason { base.type, message ? std::string(message) : base.message, file ? std::string(file) : std::string(), line };
+      }
+    };
+
+    inline reason_info reason::operator() (const char *_file, uint64_t _line) const { return reason_info { *this, _file, _line, nullptr }; }
+    inline reason_info reason::operator() (const char *_file, uint64_t _line, const char *_message) const { return reason_info { *this, _file, _line, _message }; }
+
 /// \brief To be used to fill the operator() automatically
 /// \code
 /// return self_call.fail(neam::r::out_of_memory_reason(N_REASON_INFO), nullptr);
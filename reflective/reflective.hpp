@@ -30,6 +30,9 @@
 #include "function_call.hpp"
 #include "introspect.hpp"
 #include "measure_point.hpp"
+#include "live_profile.hpp"
+#include "trace.hpp"
+#include "arena.hpp"
 
 #define N_REFLECTIVE_PRESENT
 
@@ -68,20 +68,25 @@ namespace neam
       public:
         /// \brief Add a new entry to the sequence
         /// \see N_SEQUENCE_ENTRY_INFO
-        void add_entry(entry &&ent) { entries.emplace_back(std::move(ent)); }
+        void add_entry(entry &&ent) { entries.emplace_back(std::move(ent)); changed = true; }
 
         /// \brief Add a new entry to the sequence
         /// \see N_SEQUENCE_ENTRY_INFO
-        void add_entry(const entry &ent) { entries.push_back(std::move(ent)); }
+        void add_entry(const entry &ent) { entries.push_back(std::move(ent)); changed = true; }
 
         /// \brief Return the entries of that sequence
         const std::deque<entry> &get_entries() const { return entries; }
 
         /// \brief Clear the sequence
-        void clear_sequence() { entries.clear(); }
+        void clear_sequence() { entries.clear(); changed = true; }
+
+        /// \brief Whether or not the sequence has changed since the last clear_changed() (used to only copy it to the shared callgraph when it has)
+        bool has_changed() const { return changed; }
+        void clear_changed() { changed = false; }
 
       private:
         std::deque<entry> entries;
+        bool changed = true; // not saved
 
         friend neam::cr::persistence;
     };
@@ -5,11 +5,24 @@
 #include "storage.hpp"
 #include "config.hpp"
 #include "function_call.hpp"
+#include "crash_dump.hpp"
+
+void neam::r::prepare_crash_dump()
+{
+  internal::prepare_crash_dump(conf::out_file);
+}
 
 void neam::r::on_signal(int sig)
 {
+  if (conf::safe_crash_dump && internal::write_crash_dump(sig))
+  {
+    // The crash dump will be applied on the next launch. Nothing else is async-signal-safe in here.
+    conf::disable_auto_save = true; // further saves may corrupt the file once we've done this
+    return;
+  }
+
   // report
-  function_call *fc = function_call::get_active_function_call();
+  basic_function_call *fc = basic_function_call::get_active_function_call();
   if (fc)
   {
     neam::cr::out.log() << LOGGER_INFO << "REFLECTIVE: a signal has been caugh. Will report it." << std::endl;
@@ -59,6 +72,8 @@ void neam::r::on_signal(int sig)
 void neam::r::install_default_signal_handler(std::initializer_list<int> signals)
 {
 #ifdef _WIN32
+  prepare_crash_dump();
+
   auto handler = [](int sig)
   {
     // report & save
@@ -72,6 +87,8 @@ void neam::r::install_default_signal_handler(std::initializer_list<int> signals)
   for (int sig : signals)
     signal(sig, handler);
 #else
+  prepare_crash_dump();
+
   struct sigaction sct;
   sct.sa_handler = [](int sig)
   {
@@ -35,9 +35,14 @@ namespace neam
     /// \brief If you install a custom signal handler, but still want reflective to reports signals
     /// Just call this.
     /// \note the same notes and warning from install_default_signal_handler applies to this function
+    /// \note If conf::safe_crash_dump is true, you must have called prepare_crash_dump() before
     /// \see install_default_signal_handler
     void on_signal(int sig);
 
+    /// \brief Preallocate what on_signal() needs to write its crash dump (conf::out_file + ".crash")
+    /// \note install_default_signal_handler() calls it. Call it again if you change conf::out_file or conf::crash_dump_size.
+    void prepare_crash_dump();
+
     /// \brief Install the default signal handler on the given signal list
     /// \note The default signal handler behavior is to "report, save and die"
     /// \warning If your program crashed because of a segfault, an uncaught exception, ...
@@ -51,6 +56,8 @@ namespace neam
     ///
     /// \note If the conf::cleanup_on_crash config variable is true, an additional file is created "conf::out_file + '.bak'" with the data "as-is",
     ///       as the stack cleanup will most probably lead to another crash
+    /// \note If conf::safe_crash_dump is true (the default), none of the above happens: only an async-signal-safe crash dump
+    ///       of the active stack and of the counters is written, and it is merged into the data on the next launch.
     void install_default_signal_handler(std::initializer_list<int> signals);
   } // namespace r
 } // namespace neam
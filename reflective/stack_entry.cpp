@@ -1,10 +1,11 @@
 
+#include <ctime>
+#include <algorithm>
 #include "storage.hpp"
 #include "stack_entry.hpp"
-
-
-thread_local size_t thread_index = 0;
-
+#include "clock.hpp"
+#include "average.hpp"
+#include "config.hpp"
 
 inline long int neam::r::internal::stack_entry::get_children_stack_entry_index(uint64_t call_info_struct_index) const
 {
@@ -14,7 +15,7 @@ inline long int neam::r::internal::stack_entry::get_children_stack_entry_index(u
 
   for (auto &it : children)
   {
-    if (global->callgraph[thread_index][it].call_structure_index == call_info_struct_index)
+    if (global->callgraph[stack_index][it].call_structure_index == call_info_struct_index)
       return (long)it;
   }
   return -1;
@@ -22,25 +23,7 @@ inline long int neam::r::internal::stack_entry::get_children_stack_entry_index(u
 
 neam::r::internal::stack_entry &neam::r::internal::stack_entry::push_children_call_info(uint64_t call_info_struct_index)
 {
-  data *global = get_global_data();
-
-  std::lock_guard<mutex_type> _u0(global->lock); // lock 'cause we do a search and create if not present.
-
-  long index = get_children_stack_entry_index(call_info_struct_index);
-
-  if (index < 0)
-  {
-    index = global->callgraph[thread_index].size();
-
-    global->callgraph[thread_index].emplace_back(stack_entry{(uint64_t)index, thread_index, call_info_struct_index, self_index});
-    children.push_back(index);
-    return global->callgraph[thread_index].back();
-  }
-  else
-  {
-    global->callgraph[thread_index][index].hit_count++;
-    return global->callgraph[thread_index][index];
-  }
+  return get_thread_data()->graph.get_child(*this, call_info_struct_index);
 }
 
 neam::r::internal::stack_entry *neam::r::internal::stack_entry::get_children_stack_entry(uint64_t call_info_struct_index) const
@@ -52,41 +35,351 @@ neam::r::internal::stack_entry *neam::r::internal::stack_entry::get_children_sta
   long index = get_children_stack_entry_index(call_info_struct_index);
 
   if (index >= 0)
-    return &global->callgraph[thread_index][index];
+    return &global->callgraph[stack_index][index];
   return nullptr;
 }
 
 neam::r::internal::stack_entry &neam::r::internal::stack_entry::initial_get_stack_entry(uint64_t call_info_struct_index)
 {
-  size_t index = 0;
-  data *global = get_global_data();
+  return get_thread_data()->graph.get_root(call_info_struct_index);
+}
 
-  std::lock_guard<mutex_type> _u0(global->lock); // lock 'cause we do a search and create if not present.
+void neam::r::internal::stack_entry::dispose_initial()
+{
+  get_thread_data()->graph.stack_index = 0;
+}
 
-  // the root stack_entry always have the first index (0), so we only loop over all first-level entries at test if the root has the good call_info_struct_index
-  for (auto &it : global->callgraph)
+void neam::r::internal::stack_entry::add_exemplar(exemplar &&ex)
+{
+  std::deque<exemplar> &exemplars = cold.get_or_create().exemplars;
+  if (exemplars.size() >= conf::max_exemplars)
+  {
+    // replace the fastest one (if ex is slower)
+    auto fastest = std::min_element(exemplars.begin(), exemplars.end(), [](const exemplar &a, const exemplar &b) { return a.duration < b.duration; });
+    if (fastest == exemplars.end() || fastest->duration >= ex.duration)
+      return;
+    exemplars.erase(fastest);
+  }
+  exemplars.push_back(std::move(ex));
+}
+
+// // persisted_stack_entry // //
+
+neam::r::internal::persisted_stack_entry neam::r::internal::persisted_stack_entry::from_stack_entry(const stack_entry &entry)
+{
+  const stack_entry_cold &cold = entry.cold.get();
+  return persisted_stack_entry
+  {
+    entry.self_index, entry.stack_index, entry.call_structure_index, entry.parent,
+    std::vector<uint64_t>(entry.children.begin(), entry.children.end()),
+    entry.hit_count, entry.fail_count,
+    entry.average_self_time, entry.average_self_time_count, cold.self_time_progression,
+    entry.average_global_time, entry.average_global_time_count, cold.global_time_progression,
+    entry.self_time_histogram, entry.global_time_histogram,
+    cold.sequences, cold.fails, cold.reports, cold.measure_points, cold.exemplars
+  };
+}
+
+neam::r::internal::stack_entry neam::r::internal::persisted_stack_entry::to_stack_entry() const
+{
+  stack_entry ret {self_index, stack_index, call_structure_index, parent};
+  ret.children.assign(children.begin(), children.end());
+  ret.hit_count = hit_count;
+  ret.fail_count = fail_count;
+  ret.average_self_time = average_self_time;
+  ret.average_self_time_count = average_self_time_count;
+  ret.average_global_time = average_global_time;
+  ret.average_global_time_count = average_global_time_count;
+  ret.self_time_histogram = self_time_histogram;
+  ret.global_time_histogram = global_time_histogram;
+
+  stack_entry_cold cold {self_time_progression, global_time_progression, sequences, fails, reports, measure_points, exemplars};
+  if (!cold.empty())
+    ret.cold.get_or_create() = std::move(cold);
+  return ret;
+}
+
+// // thread_callgraph // //
+
+neam::r::internal::stack_entry &neam::r::internal::thread_callgraph::get_root(uint64_t call_info_struct_index)
+{
+  // the root stack_entry always have the first index (0), and a thread only have a few roots
+  size_t index = 0;
+  for (auto &it : callgraph)
   {
     if (it[0].call_structure_index == call_info_struct_index)
     {
       it[0].hit_count++; // increment the hit count
-      thread_index = index;
+      stack_index = index;
       return it[0];
     }
     ++index;
   }
 
   // not found: create the new entry
-  index = global->callgraph.size();
-  thread_index = index;
-  global->callgraph.emplace_back(); // call the default constructor
+  index = callgraph.size();
+  stack_index = index;
+  callgraph.emplace_back();
+  callgraph.back().emplace_back(stack_entry{0, index, call_info_struct_index, 0});
+  return callgraph.back().back();
+}
 
-  // create the root element
-  global->callgraph.back().emplace_back(stack_entry{0, thread_index, call_info_struct_index, 0});
+neam::r::internal::stack_entry &neam::r::internal::thread_callgraph::get_child(stack_entry &parent, uint64_t call_info_struct_index)
+{
+  // the memo: last child found for a (parent, callee) pair
+  memo_entry &me = memo[((reinterpret_cast<size_t>(&parent) >> 4) ^ (call_info_struct_index * 0x9E3779B1u)) & (memo_size - 1)];
+  if (me.parent == &parent && me.call_structure_index == call_info_struct_index)
+  {
+    me.child->hit_count++;
+    return *me.child;
+  }
 
-  return global->callgraph.back().back();
+  stack_entry *child;
+  const child_key key = {&parent, call_info_struct_index};
+  auto it = children_index.find(key);
+  if (it != children_index.end())
+  {
+    child = it->second;
+    child->hit_count++;
+  }
+  else // create it
+  {
+    stack_entry_list &graph = callgraph[parent.stack_index];
+    const uint64_t index = graph.size();
+    graph.emplace_back(stack_entry{index, parent.stack_index, call_info_struct_index, parent.self_index});
+    parent.children.push_back(index);
+    child = &graph.back();
+    children_index.emplace(key, child);
+  }
+
+  me.parent = &parent;
+  me.call_structure_index = call_info_struct_index;
+  me.child = child;
+  return *child;
 }
 
-void neam::r::internal::stack_entry::dispose_initial()
+uint64_t neam::r::internal::thread_callgraph::get_shared_index(data &global, index_list &shared, stack_entry_list &local, uint64_t index)
 {
-  thread_index = 0;
+  if (shared[index] != uint64_t(-1))
+    return shared[index];
+
+  // collect the unresolved ancestors, then resolve them from the top (the chain can be as deep as the call stack: no recursion)
+  // the root is always resolved by fold_into(), so the chain always ends
+  unresolved.clear();
+  for (uint64_t it = index; shared[it] == uint64_t(-1); it = local[it].parent)
+    unresolved.push_back(it);
+
+  const uint64_t shared_stack_index = shared_roots[local[index].stack_index];
+  stack_entry_list &graph = global.callgraph[shared_stack_index];
+  for (auto uit = unresolved.rbegin(); uit != unresolved.rend(); ++uit)
+  {
+    const stack_entry &entry = local[*uit];
+    const uint64_t parent_index = shared[entry.parent];
+    stack_entry &parent = graph[parent_index];
+
+    long sindex = -1;
+    for (uint64_t it : parent.children)
+    {
+      if (graph[it].call_structure_index == entry.call_structure_index)
+      {
+        sindex = it;
+        break;
+      }
+    }
+    if (sindex < 0)
+    {
+      sindex = graph.size();
+      graph.emplace_back(stack_entry{uint64_t(sindex), shared_stack_index, entry.call_structure_index, parent_index});
+      graph.back().hit_count = 0;
+      parent.children.push_back(sindex);
+      global.changed_stack_entries.emplace(shared_stack_index, parent_index);
+    }
+    shared[*uit] = sindex;
+  }
+  return shared[index];
+}
+
+void neam::r::internal::thread_callgraph::fold_entry(stack_entry &shared, stack_entry &local, int64_t ts)
+{
+  shared.hit_count += local.hit_count;
+  shared.fail_count += local.fail_count;
+
+  // averages & progressions
+  auto progress = [ts](std::deque<duration_progression> &progression, double value)
+  {
+    if (progression.empty()
+        || (progression.back().value < value && progression.back().value * conf::progression_min_factor < value)
+        || (progression.back().value > value && progression.back().value > value * conf::progression_min_factor))
+      progression.push_back(duration_progression{ts, value});
+    if (progression.size() > conf::max_progression_entries)
+    {
+      size_t diff = progression.size() - conf::max_progression_entries;
+      progression.erase(progression.begin(), progression.begin() + diff);
+    }
+  };
+  if (local.average_self_time_count)
+  {
+    merge_average(shared.average_self_time, shared.average_self_time_count, local.average_self_time * double(local.average_self_time_count), local.average_self_time_count);
+    progress(shared.cold.get_or_create().self_time_progression, shared.average_self_time);
+  }
+  if (local.average_global_time_count)
+  {
+    merge_average(shared.average_global_time, shared.average_global_time_count, local.average_global_time * double(local.average_global_time_count), local.average_global_time_count);
+    progress(shared.cold.get_or_create().global_time_progression, shared.average_global_time);
+  }
+  shared.self_time_histogram.add(local.self_time_histogram);
+  shared.global_time_histogram.add(local.global_time_histogram);
+
+  // reasons (don't duplicate the last one)
+  auto append_reasons = [](std::deque<reason> &dest, std::deque<reason> &src)
+  {
+    for (reason &r : src)
+    {
+      if (dest.size() && dest.back() == r)
+      {
+        dest.back().hit += r.hit;
+        dest.back().last_timestamp = r.last_timestamp;
+      }
+      else
+        dest.push_back(std::move(r));
+    }
+    src.clear();
+  };
+  if (stack_entry_cold *local_cold = local.cold.get_if_exists())
+  {
+    if (local_cold->fails.size())
+      append_reasons(shared.cold.get_or_create().fails, local_cold->fails);
+    for (auto &it : local_cold->reports)
+      append_reasons(shared.cold.get_or_create().reports[it.first], it.second);
+    local_cold->reports.clear();
+
+    // measure points: keep the local value (measure_point::get_average_time() uses it), but reset the hit count
+    for (auto &it : local_cold->measure_points)
+    {
+      if (!it.second.hit_count)
+        continue;
+      measure_point_entry &mpe = shared.cold.get_or_create().measure_points[it.first];
+      merge_average(mpe.value, mpe.hit_count, it.second.value * double(it.second.hit_count), it.second.hit_count);
+      it.second.hit_count = 0;
+    }
+
+    // sequences are "live" objects (the user may hold pointers to them): copy those that have changed
+    for (auto &it : local_cold->sequences)
+    {
+      if (!it.second.has_changed())
+        continue;
+      it.second.clear_changed();
+      shared.cold.get_or_create().sequences[it.first] = it.second;
+    }
+
+    for (exemplar &it : local_cold->exemplars)
+      shared.add_exemplar(std::move(it));
+    local_cold->exemplars.clear();
+  }
+
+  local.hit_count = 0;
+  local.fail_count = 0;
+  local.average_self_time = 0;
+  local.average_self_time_count = 0;
+  local.average_global_time = 0;
+  local.average_global_time_count = 0;
+  local.self_time_histogram.clear();
+  local.global_time_histogram.clear();
+}
+
+void neam::r::internal::thread_callgraph::fold_into(data &global)
+{
+  if (shared_owner != &global)
+  {
+    forget_shared();
+    shared_owner = &global;
+  }
+
+  const int64_t ts = internal::clock::get_coarse_time();
+
+  for (size_t i = 0; i < callgraph.size(); ++i)
+  {
+    stack_entry_list &local = callgraph[i];
+
+    if (shared_roots.size() <= i)
+      shared_roots.resize(i + 1, uint64_t(-1));
+    if (shared_indexes.size() <= i)
+      shared_indexes.resize(i + 1);
+    index_list &shared = shared_indexes[i];
+    shared.resize(local.size(), uint64_t(-1));
+
+    // resolve the root
+    if (shared_roots[i] == uint64_t(-1))
+    {
+      uint64_t index = 0;
+      for (auto &it : global.callgraph)
+      {
+        if (it.size() && it[0].call_structure_index == local[0].call_structure_index)
+          break;
+        ++index;
+      }
+      if (index == global.callgraph.size())
+      {
+        global.callgraph.emplace_back();
+        global.callgraph.back().emplace_back(stack_entry{0, index, local[0].call_structure_index, 0});
+        global.callgraph.back().back().hit_count = 0;
+        global.changed_stack_entries.emplace(index, 0);
+      }
+      shared_roots[i] = index;
+      shared[0] = 0;
+    }
+
+    // fold the entries (only those with something to fold are resolved/created)
+    for (size_t j = 0; j < local.size(); ++j)
+    {
+      stack_entry &entry = local[j];
+      const stack_entry_cold &cold = entry.cold.get();
+      if (!entry.hit_count && !entry.fail_count && !entry.average_self_time_count && !entry.average_global_time_count
+          && cold.fails.empty() && cold.reports.empty() && cold.exemplars.empty()
+          && std::none_of(cold.measure_points.begin(), cold.measure_points.end(), [](const auto &mp) { return mp.second.hit_count != 0; })
+          && std::none_of(cold.sequences.begin(), cold.sequences.end(), [](const auto &seq) { return seq.second.has_changed(); }))
+        continue;
+
+      const uint64_t index = get_shared_index(global, shared, local, j);
+      fold_entry(global.callgraph[shared_roots[i]][index], entry, ts);
+      global.changed_stack_entries.emplace(shared_roots[i], index);
+    }
+  }
+}
+
+neam::r::internal::stack_entry *neam::r::internal::thread_callgraph::get_shared_stack_entry(data &global, const stack_entry &local)
+{
+  if (shared_owner != &global || local.stack_index >= shared_indexes.size())
+    return nullptr;
+  const index_list &shared = shared_indexes[local.stack_index];
+  if (local.self_index >= shared.size() || shared[local.self_index] == uint64_t(-1))
+    return nullptr;
+  return &global.callgraph[shared_roots[local.stack_index]][shared[local.self_index]];
+}
+
+void neam::r::internal::thread_callgraph::discard()
+{
+  for (auto &graph_it : callgraph)
+  {
+    for (stack_entry &it : graph_it)
+    {
+      it.hit_count = 0;
+      it.fail_count = 0;
+      it.average_self_time = 0;
+      it.average_self_time_count = 0;
+      it.average_global_time = 0;
+      it.average_global_time_count = 0;
+      it.self_time_histogram.clear();
+      it.global_time_histogram.clear();
+      if (stack_entry_cold *cold = it.cold.get_if_exists())
+      {
+        cold->fails.clear();
+        cold->reports.clear();
+        cold->exemplars.clear();
+        for (auto &mp : cold->measure_points)
+          mp.second.hit_count = 0;
+      }
+    }
+  }
+  forget_shared();
 }
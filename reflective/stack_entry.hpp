@@ -31,9 +31,14 @@
 #include <vector>
 #include <deque>
 #include <map>
+#include <functional>
+#include <unordered_map>
+#include <utility>
 
+#include "arena.hpp"
 #include "sequence.hpp"
 #include "reason.hpp"
+#include "histogram.hpp"
 
 namespace neam
 {
@@ -53,9 +58,144 @@ namespace neam
       double value = 0;     /// \brief The average value
     };
 
+    /// \brief A call of an exemplar (see exemplar)
+    struct exemplar_call
+    {
+      uint64_t call_structure_index; ///< \brief The index of the call struct of the function
+      uint32_t depth;                ///< \brief The depth in the call tree (0 for the root call)
+      double start;                  ///< \brief When the call has started, in seconds since the start of the root call
+      double duration;               ///< \brief The duration of the call (with its children), in seconds
+    };
+
+    /// \brief The detailed call tree of a slow root call (see conf::exemplars)
+    struct exemplar
+    {
+      int64_t timestamp = 0; ///< \brief When the root call has ended
+      double duration = 0; ///< \brief The duration of the root call, in seconds
+      uint64_t dropped_calls = 0; ///< \brief The number of calls that didn't fit in the exemplar (see conf::exemplar_max_calls)
+      std::vector<exemplar_call> calls = std::vector<exemplar_call>(); ///< \brief The calls, in the order they started (the root call first)
+    };
+
     namespace internal
     {
+      class data;
+
+      /// \brief The parts of a stack_entry that are only there when something has been recorded for it
+      /// (progressions, sequences, fails, reports, measure points, exemplars)
+      struct stack_entry_cold
+      {
+        std::deque<duration_progression> self_time_progression = std::deque<duration_progression>(); ///< \brief Hold the progression of the self_time average
+        std::deque<duration_progression> global_time_progression = std::deque<duration_progression>();
+
+        std::map<std::string, sequence> sequences = std::map<std::string, sequence>(); ///< \brief Hold sequences
+
+        std::deque<reason> fails = std::deque<reason>(); ///< \brief Holds all the past fails reasons
+
+        std::map<std::string, std::deque<reason>> reports = decltype(reports)(); /// \brief Hold reports
+
+        // GCC does not like std::map<std::string, measure_point_entry> measure_points = std::map<std::string, measure_point_entry>()
+        std::map<std::string, measure_point_entry> measure_points = decltype(measure_points)(); /// \brief Holds informations about measure points
+
+        std::deque<exemplar> exemplars = std::deque<exemplar>(); ///< \brief The slowest root calls, with their call tree (only for roots, see conf::exemplars)
+
+        bool empty() const
+        {
+          return self_time_progression.empty() && global_time_progression.empty() && sequences.empty() && fails.empty()
+                 && reports.empty() && measure_points.empty() && exemplars.empty();
+        }
+      };
+
+      /// \brief Owns the cold part of a stack_entry, allocated (in the arena) the first time something is written in it
+      /// Copies are deep, so a stack_entry is still a value type.
+      class stack_entry_cold_ptr
+      {
+        public:
+          stack_entry_cold_ptr() = default;
+          stack_entry_cold_ptr(stack_entry_cold_ptr &&o) : ptr(o.ptr) { o.ptr = nullptr; }
+          stack_entry_cold_ptr(const stack_entry_cold_ptr &o)
+          {
+            if (o.ptr)
+              create(*o.ptr);
+          }
+          ~stack_entry_cold_ptr() { reset(); }
+
+          stack_entry_cold_ptr &operator = (stack_entry_cold_ptr &&o)
+          {
+            if (this != &o)
+            {
+              reset();
+              std::swap(ptr, o.ptr);
+            }
+            return *this;
+          }
+          stack_entry_cold_ptr &operator = (const stack_entry_cold_ptr &o)
+          {
+            if (this != &o)
+            {
+              reset();
+              if (o.ptr)
+                create(*o.ptr);
+            }
+            return *this;
+          }
+
+          /// \brief Whether or not the cold part has been allocated
+          bool exists() const { return ptr != nullptr; }
+
+          /// \brief Return the cold part (an empty one if it hasn't been allocated)
+          const stack_entry_cold &get() const
+          {
+            static const stack_entry_cold empty = stack_entry_cold();
+            return ptr ? *ptr : empty;
+          }
+
+          /// \brief Return the cold part, allocating it if needed
+          stack_entry_cold &get_or_create()
+          {
+            if (!ptr)
+              create();
+            return *ptr;
+          }
+
+          /// \brief Return the cold part, or nullptr if it hasn't been allocated
+          stack_entry_cold *get_if_exists() const { return ptr; }
+
+          /// \brief Free the cold part
+          void reset()
+          {
+            if (!ptr)
+              return;
+            ptr->~stack_entry_cold();
+            get_arena().deallocate(ptr, sizeof(stack_entry_cold));
+            ptr = nullptr;
+          }
+
+        private:
+          template<typename... Args>
+          void create(Args &&... args)
+          {
+            void *memory = get_arena().allocate(sizeof(stack_entry_cold));
+            try
+            {
+              ptr = new (memory) stack_entry_cold(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+              get_arena().deallocate(memory, sizeof(stack_entry_cold));
+              throw;
+            }
+          }
+
+        private:
+          stack_entry_cold *ptr = nullptr;
+      };
+
+      /// \brief The children indexes of a stack_entry (in the arena)
+      using children_list = std::vector<uint64_t, arena_allocator<uint64_t>>;
+
       /// \brief Hold an entry
+      /// The counters that are updated on every fold are stored inline, in the order they are used,
+      /// everything else (see stack_entry_cold) is only allocated when it is needed.
       struct stack_entry
       {
 #ifdef _MSC_VER
@@ -67,48 +207,163 @@ namespace neam
 
         const uint64_t parent; ///< \brief Parent index
         // ----- //
-        std::vector<uint64_t> children = std::vector<uint64_t>(); ///< \brief Children indexes
-
         uint64_t hit_count = 1; ///< \brief The number of time the entry has been hit
         uint64_t fail_count = 0; ///< \brief The number of time that function failed
 
         double average_self_time = 0; ///< \brief The average time consumed by the function and only this function
         uint64_t average_self_time_count = 0; ///< \brief Number of time the self_time has been monitored
-        std::deque<duration_progression> self_time_progression = std::deque<duration_progression>(); ///< \brief Hold the progression of the self_time average
         double average_global_time = 0; ///< \brief The average time consumed by the whole function call (including all its children)
         uint64_t average_global_time_count = 0; ///< \brief Number of time the global_time has been monitored
-        std::deque<duration_progression> global_time_progression = std::deque<duration_progression>();
 
-        std::map<std::string, sequence> sequences = std::map<std::string, sequence>(); ///< \brief Hold sequences
+        children_list children = children_list(); ///< \brief Children indexes
 
-        std::deque<reason> fails = std::deque<reason>(); ///< \brief Holds all the past fails reasons
+        duration_histogram self_time_histogram = duration_histogram(); ///< \brief The distribution of the self_time
+        duration_histogram global_time_histogram = duration_histogram(); ///< \brief The distribution of the global_time
 
-        std::map<std::string, std::deque<reason>> reports = decltype(reports)(); /// \brief Hold reports
-
-        // GCC does not like std::map<std::string, measure_point_entry> measure_points = std::map<std::string, measure_point_entry>()
-        std::map<std::string, measure_point_entry> measure_points = decltype(measure_points)(); /// \brief Holds informations about measure points
+        stack_entry_cold_ptr cold = stack_entry_cold_ptr(); ///< \brief Progressions, sequences, fails, reports, measure points and exemplars
 
         // ----- //
 
 
         /// \brief push (or increment hit_count) into children a new call_info_struct.
         /// \note If not already in children, it will create a new stack_entry and insert its index at the end of children
+        /// \note This works on the thread callgraph (this MUST be an entry of the thread callgraph) and the thread lock must be held
         /// \return the reference of the stack_entry corresponding to the call_info_struct
         stack_entry &push_children_call_info(uint64_t call_info_struct_index);
 
         /// \brief Unlike push_children_call_info(), this method won't create anything / modify anithing
         /// It will simply lookup in the children array for a stack_entry for the call_info_struct_index call_info_struct
         /// If nothing is found, it returns nullptr
+        /// \note This works on the shared callgraph (the one of the global data)
         stack_entry *get_children_stack_entry(uint64_t call_info_struct_index) const;
 
         /// \brief Returns a children stack_entry index corresponding to a given call_info_struct index
+        /// \note This works on the shared callgraph (the one of the global data)
         /// \return -1 if nothing found
         long get_children_stack_entry_index(uint64_t call_info_struct_index) const;
 
-        /// \brief Start a stack
+        /// \brief Start a stack (in the thread callgraph, the thread lock must be held)
         static stack_entry &initial_get_stack_entry(uint64_t call_info_struct_index);
         /// \brief End a stack
         static void dispose_initial();
+
+        /// \brief Add an exemplar, keeping only the conf::max_exemplars slowest ones
+        void add_exemplar(exemplar &&ex);
+      };
+
+      /// \brief A stack_entry with all its fields inline: the layout the JSON files and the journals use
+      struct persisted_stack_entry
+      {
+        uint64_t self_index;
+        uint64_t stack_index;
+        uint64_t call_structure_index;
+        uint64_t parent;
+
+        std::vector<uint64_t> children = std::vector<uint64_t>();
+
+        uint64_t hit_count = 1;
+        uint64_t fail_count = 0;
+
+        double average_self_time = 0;
+        uint64_t average_self_time_count = 0;
+        std::deque<duration_progression> self_time_progression = std::deque<duration_progression>();
+        double average_global_time = 0;
+        uint64_t average_global_time_count = 0;
+        std::deque<duration_progression> global_time_progression = std::deque<duration_progression>();
+        duration_histogram self_time_histogram = duration_histogram();
+        duration_histogram global_time_histogram = duration_histogram();
+
+        std::map<std::string, sequence> sequences = std::map<std::string, sequence>();
+        std::deque<reason> fails = std::deque<reason>();
+        std::map<std::string, std::deque<reason>> reports = decltype(reports)();
+        std::map<std::string, measure_point_entry> measure_points = decltype(measure_points)();
+        std::deque<exemplar> exemplars = std::deque<exemplar>();
+
+        /// \brief Copy a stack_entry
+        static persisted_stack_entry from_stack_entry(const stack_entry &entry);
+
+        /// \brief Make the stack_entry back (its cold part is only allocated if there's something to put in it)
+        stack_entry to_stack_entry() const;
+      };
+
+      /// \brief The entries of a callgraph that have the same root (in the arena)
+      using stack_entry_list = std::deque<stack_entry, arena_allocator<stack_entry>>;
+
+      /// \brief The callgraph a thread builds for itself, without taking the global lock.
+      /// Each entry holds the counters since the last fold, and the whole graph is folded (by path) into the shared callgraph
+      /// of the global data only when data is synced or introspected (or when the thread exits).
+      /// Children are found with a hashed index (plus a small direct-mapped memo), not by scanning the children array.
+      class thread_callgraph
+      {
+        public:
+          /// \brief Return the root entry for a call_info_struct (creates it if needed)
+          stack_entry &get_root(uint64_t call_info_struct_index);
+
+          /// \brief Return the child entry of parent for a call_info_struct (creates it if needed) and increment its hit count
+          stack_entry &get_child(stack_entry &parent, uint64_t call_info_struct_index);
+
+          /// \brief Fold the counters into the shared callgraph of global, then clear them
+          /// \note global->lock must be held
+          void fold_into(data &global);
+
+          /// \brief Return the entry of the shared callgraph a (folded) local entry maps to
+          /// \return nullptr if the local entry has never been folded in global
+          stack_entry *get_shared_stack_entry(data &global, const stack_entry &local);
+
+          /// \brief Forget the mapping to the shared callgraph (the next fold will find the entries by path again)
+          void forget_shared()
+          {
+            shared_owner = nullptr;
+            shared_roots.clear();
+            shared_indexes.clear();
+          }
+
+          /// \brief Drop the counters without folding them
+          void discard();
+
+        public:
+          size_t stack_index = 0; ///< \brief The index of the current stack (in callgraph)
+
+        private:
+          struct child_key
+          {
+            const stack_entry *parent;
+            uint64_t call_structure_index;
+
+            bool operator == (const child_key &o) const { return parent == o.parent && call_structure_index == o.call_structure_index; }
+          };
+          struct child_key_hasher
+          {
+            size_t operator()(const child_key &k) const
+            {
+              return (reinterpret_cast<size_t>(k.parent) >> 4) * 0x9E3779B97F4A7C15ull ^ k.call_structure_index;
+            }
+          };
+          struct memo_entry
+          {
+            const stack_entry *parent = nullptr;
+            uint64_t call_structure_index = 0;
+            stack_entry *child = nullptr;
+          };
+
+          static constexpr size_t memo_size = 64; // must be a power of 2
+
+          using index_list = std::deque<uint64_t, arena_allocator<uint64_t>>;
+          using children_index_map = std::unordered_map<child_key, stack_entry *, child_key_hasher, std::equal_to<child_key>,
+                                                        arena_allocator<std::pair<const child_key, stack_entry *>>>;
+
+          uint64_t get_shared_index(data &global, index_list &shared, stack_entry_list &local, uint64_t index);
+          static void fold_entry(stack_entry &shared, stack_entry &local, int64_t ts);
+
+        private:
+          std::deque<stack_entry_list> callgraph; // The thread's callgraph. Entries are never removed.
+          children_index_map children_index;
+          memo_entry memo[memo_size];
+
+          const data *shared_owner = nullptr; // the data shared_roots / shared_indexes refers to
+          std::deque<uint64_t> shared_roots; // stack index in callgraph -> stack index in the shared callgraph (or -1)
+          std::deque<index_list> shared_indexes; // same layout as callgraph, holds the index in the shared callgraph (or -1)
+          std::vector<uint64_t, arena_allocator<uint64_t>> unresolved; // the chain get_shared_index() resolves (kept to reuse its memory)
       };
     } // namespace internal
   } // namespace r
@@ -3,12 +3,25 @@
 #include <ctime>
 #include <set>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 
 #include "tools/logger/logger.hpp"
 #include "storage.hpp"
 #include "function_call.hpp"
+#include "journal.hpp"
+#include "binary_format.hpp"
+#include "crash_dump.hpp"
+#include "live_profile.hpp"
+#include "trace.hpp"
 
 #include "persistence_metadata.hpp"
+#include "average.hpp"
 #include "config.hpp"
 
 using root_data = std::deque<neam::r::internal::data>;
@@ -18,19 +31,125 @@ static neam::r::internal::data *global_ptr = nullptr;
 
 static std::set<neam::r::internal::thread_local_data *> tl_data_ptrs;
 static thread_local neam::r::internal::thread_local_data tl_data;
+static thread_local neam::r::internal::thread_local_data *tl_data_self = nullptr; // trivially constructible: set once tl_data is constructed (see peek_thread_data())
 
 static neam::r::internal::mutex_type internal_lock;
 
+static std::atomic<bool> warm_start_pending(false); // the previous data is being loaded (see _warm_start())
+static void _start_warm_start(const std::string &file);
+static void _wait_for_warm_start();
+static std::string deferred_sync_file; // a sync_or_defer() call while warm_start_pending, done by _warm_start() (protected by the internal lock)
+
 neam::r::internal::thread_local_data::thread_local_data()
 {
   std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
   tl_data_ptrs.emplace(this);
+  tl_data_self = this;
 }
 
 neam::r::internal::thread_local_data::~thread_local_data()
 {
+  tl_data_self = nullptr;
   std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
   tl_data_ptrs.erase(this);
+
+  std::lock_guard<neam::r::internal::mutex_type> _u1(lock);
+  merge_to_global();
+}
+
+/// \brief Return the duration over which a root call is kept as an exemplar (-1 if there's none yet)
+static double _get_exemplar_threshold(const neam::r::internal::call_info_struct &cis)
+{
+  if (cis.exemplar_threshold > 0)
+    return cis.exemplar_threshold;
+  if (cis.global_time_histogram.count >= neam::r::conf::exemplar_min_samples)
+    return cis.global_time_histogram.get_percentile(99);
+  return -1;
+}
+
+void neam::r::internal::thread_local_data::merge_to_global()
+{
+  if (!owner)
+    return;
+
+  std::lock_guard<mutex_type> _u0(owner->lock);
+
+  const size_t count = std::min(accumulators.size(), owner->func_info.size());
+  for (size_t i = 0; i < count; ++i)
+  {
+    call_info_accumulator &acc = accumulators[i];
+    call_info_struct &cis = owner->func_info[i];
+
+    if (acc.call_count || acc.fail_count || acc.self_time_count || acc.global_time_count)
+    {
+      owner->changed_func_info.insert(i);
+
+      cis.call_count += acc.call_count;
+      cis.fail_count += acc.fail_count;
+      merge_average(cis.average_self_time, cis.average_self_time_count, acc.self_time_sum, acc.self_time_count);
+      merge_average(cis.average_global_time, cis.average_global_time_count, acc.global_time_sum, acc.global_time_count);
+      cis.self_time_histogram.add(acc.self_time_histogram);
+      cis.global_time_histogram.add(acc.global_time_histogram);
+
+      acc.clear();
+    }
+
+    // the thread reads the exemplar threshold without taking the global lock
+    if (conf::exemplars)
+      acc.exemplar_threshold = _get_exemplar_threshold(cis);
+  }
+
+  graph.fold_into(*owner);
+  publish_func_info(*owner);
+  owner = nullptr; // the data may be stashed / deleted before the next call
+}
+
+enum class merge_mode
+{
+  merge,
+  merge_and_forget, // the global data is about to change: forget the mapping between thread callgraphs and the shared one
+  discard,
+};
+
+/// \brief Merge (or discard) the per-thread counters of every thread. The internal lock must be held (or not needed)
+static void _merge_thread_data(merge_mode mode = merge_mode::merge)
+{
+  if (mode != merge_mode::merge)
+    neam::r::internal::forget_published_func_info(); // the global data is about to change
+  for (neam::r::internal::thread_local_data *it : tl_data_ptrs)
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(it->lock);
+    if (mode == merge_mode::discard)
+    {
+      it->discard();
+      continue;
+    }
+    it->merge_to_global();
+    if (mode == merge_mode::merge_and_forget)
+      it->graph.forget_shared();
+  }
+}
+
+void neam::r::internal::merge_thread_data()
+{
+  std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+  _merge_thread_data();
+}
+
+void neam::r::internal::update_exemplar_thresholds()
+{
+  data *global = get_global_data();
+  std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+  for (thread_local_data *it : tl_data_ptrs)
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u1(it->lock);
+    if (it->owner && it->owner != global)
+      continue; // will be done at its next merge
+    std::lock_guard<neam::r::internal::mutex_type> _u2(global->lock);
+    const size_t count = std::min(it->accumulators.size(), global->func_info.size());
+    for (size_t i = 0; i < count; ++i)
+      it->accumulators[i].exemplar_threshold = _get_exemplar_threshold(global->func_info[i]);
+  }
 }
 
 neam::r::internal::thread_local_data *neam::r::internal::get_thread_data()
@@ -38,6 +157,11 @@ neam::r::internal::thread_local_data *neam::r::internal::get_thread_data()
   return &tl_data;
 }
 
+neam::r::internal::thread_local_data *neam::r::internal::peek_thread_data()
+{
+  return tl_data_self;
+}
+
 std::set<neam::r::internal::thread_local_data *> &neam::r::internal::get_all_thread_data()
 {
   return tl_data_ptrs;
@@ -50,7 +174,10 @@ neam::r::internal::data *neam::r::internal::get_global_data()
     std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
     if (!global_ptr)
     {
-      load_data_from_disk(conf::out_file);
+      // with async_load, recording starts in a fresh data and the previous one is merged into it once loaded
+      const bool warm_start = conf::async_load && !root_ptr && conf::out_file && conf::out_file[0];
+      if (!warm_start)
+        load_data_from_disk(conf::out_file);
       if (!root_ptr)
         root_ptr = new root_data;
       if (!global_ptr)
@@ -59,76 +186,159 @@ neam::r::internal::data *neam::r::internal::get_global_data()
           root_ptr->emplace_back(neam::r::internal::data());
         global_ptr = &root_ptr->back();
       }
+      if (warm_start)
+        _start_warm_start(conf::out_file);
+      static bool live_profile_started = false;
+      if (!live_profile_started && conf::live_profile && conf::live_profile[0])
+        live_profile_started = start_live_profile(conf::live_profile);
+      static bool trace_started = false;
+      if (!trace_started && conf::trace_file && conf::trace_file[0])
+        trace_started = start_trace(conf::trace_file);
+    }
+  }
+  return global_ptr;
+}
+
+neam::r::internal::data *neam::r::internal::peek_global_data(long &index)
+{
+  index = -1;
+  if (!global_ptr || !root_ptr)
+    return global_ptr;
+
+  long i = 0;
+  for (const data &it : *root_ptr)
+  {
+    if (&it == global_ptr)
+    {
+      index = i;
+      break;
     }
+    ++i;
   }
+  if (warm_start_pending) // the stash list is about to change
+    index = -1;
   return global_ptr;
 }
 
-neam::r::internal::call_info_struct &neam::r::internal::_get_call_info_struct(const func_descriptor &d, long &index)
+/// \brief Whether or not d is the function cis, which has the same hash
+/// The key names are compared the first time a call site finds the function (its key name is then remembered by its address)
+static bool _same_key_name(neam::r::internal::call_info_struct &cis, const neam::r::static_func_descriptor &d)
+{
+  if (cis.descr.key_name.empty() || d.key_name.empty())
+    return true;
+  if (cis.verified_key_name == d.key_name.str && d.key_name.size == cis.descr.key_name.size())
+    return true;
+  if (d.key_name != cis.descr.key_name)
+    return false;
+  cis.verified_key_name = d.key_name.str;
+  return true;
+}
+
+static bool _same_key_name(const neam::r::internal::call_info_struct &cis, const neam::r::func_descriptor &d)
+{
+  return cis.descr.key_name.empty() || d.key_name.empty() || d.key_name == cis.descr.key_name;
+}
+
+/// \brief Search a call_info_struct in the function DB (O(1) if the descriptor has a hash). The lock of global must be held
+template<typename Descriptor>
+static long _find_call_info_struct(neam::r::internal::data &global, const Descriptor &d)
+{
+  if (d.key_hash)
+  {
+    auto it = global.func_index.find(d.key_hash);
+    if (it == global.func_index.end())
+      return -1;
+
+    neam::r::internal::call_info_struct &cis = global.func_info[it->second];
+    if (_same_key_name(cis, d))
+      return long(it->second);
+    cis.hash_collision = true; // a new function, with the same hash (this is only known when its key name is different)
+
+    // a real collision (two different key names with the same hash): the only case where we have to search
+    long index = 0;
+    for (neam::r::internal::call_info_struct &other : global.func_info)
+    {
+      if (other.descr.key_hash == d.key_hash && other.hash_collision && _same_key_name(other, d))
+        return index;
+      ++index;
+    }
+    return -1;
+  }
+
+  // no hash: this is a search by name (like introspect("name")), so this is slow
+  long index = 0;
+  for (neam::r::internal::call_info_struct &it : global.func_info)
+  {
+    if (it.descr == d)
+      return index;
+    ++index;
+  }
+  return -1;
+}
+
+neam::r::internal::call_info_struct &neam::r::internal::_get_call_info_struct(const static_func_descriptor &d, long &index)
 {
   data *global = get_global_data(); // call info structs are located in the global thread
 
   std::lock_guard<mutex_type> _u0(global->lock); // lock 'cause we do a search and create if not present.
 
   // search
-  index = 0;
-  for (call_info_struct &it : global->func_info)
+  index = _find_call_info_struct(*global, d);
+  if (index >= 0)
   {
-    // doing everything to call as least as possible strcmp...
-    // NOTE: the first bit tells if the hash comes from a string (in that case we have to strcmp) or from a pointer
-    if (d == it.descr)
+    call_info_struct &it = global->func_info[index];
+
+    // set properties if not already present (this is the only place, with the creation, where the strings are copied)
+    const bool incomplete = (it.descr.pretty_name.empty() && !d.pretty_name.empty()) || (it.descr.name.empty() && !d.name.empty())
+                            || (it.descr.file.empty() && !d.file.empty()) || (!it.descr.key_hash && d.key_hash);
+    if (incomplete)
     {
-      // set properties if not already present
       if (it.descr.pretty_name.empty() && !d.pretty_name.empty())
-        it.descr.pretty_name = d.pretty_name;
+        it.descr.pretty_name = d.pretty_name.to_string();
       if (it.descr.name.empty() && !d.name.empty())
-        it.descr.name = d.name;
+        it.descr.name = d.name.to_string();
       if (it.descr.file.empty() && !d.file.empty())
       {
-        it.descr.file = d.file;
+        it.descr.file = d.file.to_string();
         it.descr.line = d.line;
       }
       if (!it.descr.key_hash && d.key_hash)
+      {
         it.descr.key_hash = d.key_hash;
-      if (it.descr.key_name.empty() && !d.key_name.empty())
-        it.descr.key_hash = d.key_hash;
-      // done !
-      return it;
+        global->index_func(index);
+      }
+      global->changed_func_info.insert(index);
     }
-    ++index;
+    publish_func_info(*global);
+    // done !
+    return it;
   }
 
   // before creating it, check that the descriptor is a valid one
-  if (d.key_name.empty() && (!d.key_hash || ((d.key_hash & 0x01) != 0)))
-    throw std::runtime_error("reflective: invalid func_descriptor structure when registering a new call_info_struct: no key_name or no unique key_hash");
+  if (d.key_name.empty() && !d.key_hash)
+    throw std::runtime_error("reflective: invalid func_descriptor structure when registering a new call_info_struct: no key_name and no key_hash");
 
   // nothing found: create it
   index = global->func_info.size();
-  global->func_info.emplace_back(call_info_struct{d});
+  global->func_info.emplace_back(call_info_struct{d.to_func_descriptor()});
+  if (!global->index_func(index))
+    neam::cr::out.warning() << LOGGER_INFO << "reflective: hash collision between '" << d.key_name.to_string() << "' and '" << global->func_info[global->func_index[d.key_hash]].descr.key_name << "'" << std::endl;
+  global->changed_func_info.insert(index);
+  publish_func_info(*global);
   neam::r::internal::call_info_struct &ret = global->func_info.back();
 
   return ret;
 }
 
-neam::r::internal::call_info_struct *neam::r::internal::_get_call_info_struct_search_only(const func_descriptor &d, long int &index)
+neam::r::internal::call_info_struct *neam::r::internal::_get_call_info_struct_search_only(const static_func_descriptor &d, long int &index)
 {
   data *global = get_global_data(); // call info structs are located in the global thread
 
-  std::lock_guard<mutex_type> _u0(global->lock); // lock 'cause we do a search and create if not present.
+  std::lock_guard<mutex_type> _u0(global->lock); // lock 'cause we do a search
 
-  // search
-  index = 0;
-  for (call_info_struct &it : global->func_info)
-  {
-    // doing everything to call as least as possible strcmp...
-    // NOTE: the first bit tells if the hash comes from a string (in that case we have to strcmp) or from a pointer
-    if (d == it.descr)
-    {
-      // found !
-      return &it;
-    }
-    ++index;
-  }
+  index = _find_call_info_struct(*global, d);
+  if (index >= 0)
+    return &global->func_info[index];
   return nullptr;
 }
 
@@ -149,54 +359,490 @@ void neam::r::internal::cleanup_reflective_data()
   // begin with the current thread (we may crash on some other thread)
   while (get_thread_data()->top)
   {
-    get_thread_data()->top->~function_call();
+    get_thread_data()->top->~basic_function_call();
   }
 
   for (thread_local_data *it : tl_data_ptrs)
   {
     while (it->top)
     {
-      it->top->~function_call();
+      it->top->~basic_function_call();
     }
   }
 }
 
-void neam::r::sync_data_to_disk(const std::string &file)
+/// \brief Serialize a stash list and write it to file (via a temporary file, so file is always a complete snapshot)
+static bool _write_snapshot(root_data *root, const std::string &file)
 {
-  std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+  std::string binary_data;
   neam::cr::raw_data serialized_data;
-
-  if (root_ptr == nullptr)
+  if (neam::r::conf::binary_format)
   {
-    neam::cr::out.warning() << LOGGER_INFO << "Empty data, will not overwrite/create '" << file << "'" << std::endl;
-    return;
+    binary_data = neam::r::binary::encode(*root);
+    serialized_data.ownership = false;
+    serialized_data.data = (int8_t *)&binary_data[0];
+    serialized_data.size = binary_data.size();
+  }
+  else
+  {
+    for (neam::r::internal::data &data_it : *root)
+    {
+      neam::r::internal::load_stash(data_it); // the JSON has everything
+      data_it.fill_persisted_callgraph();
+    }
+    serialized_data = neam::cr::persistence::serialize<neam::cr::persistence_backend::json>(root);
+    for (neam::r::internal::data &data_it : *root)
+      data_it.clear_persisted_callgraph();
   }
-
-  serialized_data = neam::cr::persistence::serialize<neam::cr::persistence_backend::json>(root_ptr);
 
   if (!serialized_data.size)
   {
     neam::cr::out.warning() << LOGGER_INFO << "Empty data, will not overwrite/create '" << file << "'" << std::endl;
-    return;
+    return false;
   }
 
-  std::ofstream of(file, std::ios_base::binary);
+  const std::string tmp_file = file + ".tmp";
+  std::ofstream of(tmp_file, std::ios_base::binary);
   of.write((const char *)serialized_data.data, serialized_data.size);
   of.flush();
   of.close();
 
+  if (!of || std::rename(tmp_file.c_str(), file.c_str()) != 0)
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to write '" << file << "'" << std::endl;
+    return false;
+  }
+
   neam::cr::out.debug() << LOGGER_INFO << "Wrote '" << file << "'" << std::endl;
+  return true;
+}
+
+// // JOURNAL // //
+
+/// \brief The compaction thread (joined before starting another one, and at exit)
+static struct compaction_thread_holder
+{
+  ~compaction_thread_holder()
+  {
+    if (thread.joinable())
+      thread.join();
+  }
+  std::thread thread;
+} compaction;
+
+static std::mutex write_lock; // held while writing a snapshot (always locked before internal_lock)
+
+static std::string crash_dump_file; // the file whose crash dump has been applied but not yet written (protected by internal_lock)
+static std::string snapshot_file; // the file the journal is relative to (empty: a snapshot is needed)
+static size_t journal_size = 0; // the size of the current journal
+
+static root_data *flush_image = nullptr; // the stash list as of the last background flush, kept up to date with the changes only (protected by write_lock)
+static bool flush_image_outdated = true; // the changes have been taken by something else, or the stash list has changed: flush_image has to be copied again (protected by internal_lock)
+
+// // WARM START // //
+
+/// \brief The thread that loads the previous data when conf::async_load is true (joined by _wait_for_warm_start(), and at exit)
+static struct warm_start_thread_holder
+{
+  ~warm_start_thread_holder()
+  {
+    if (thread.joinable())
+      thread.join();
+  }
+  std::thread thread;
+  std::mutex lock; // protects thread (it may be joined by multiple threads)
+} warm_start;
+
+static void _warm_start(const std::string &file);
+
+/// \brief Reserve enough of the arena to record the callgraph of d replica_count times, so that recording the same callgraph again
+/// (the thread callgraphs rebuild it, the merges may copy it) does not ask the system for callgraph memory (the histogram buckets are not in the arena)
+static void _reserve_arena(const neam::r::internal::data &d, size_t replica_count)
+{
+  using neam::r::internal::arena;
+
+  size_t size = 0;
+  for (const neam::r::internal::stack_entry_list &graph : d.callgraph)
+  {
+    for (const neam::r::internal::stack_entry &it : graph)
+    {
+      // the entry, its node in the children index of its thread callgraph and its shared index
+      size += sizeof(neam::r::internal::stack_entry) + arena::get_allocation_size(4 * sizeof(void *)) + sizeof(uint64_t);
+      size += arena::get_allocation_size(it.children.size() * sizeof(uint64_t));
+      if (it.cold.exists())
+        size += arena::get_allocation_size(sizeof(neam::r::internal::stack_entry_cold));
+    }
+  }
+  if (!size)
+    return;
+  neam::r::internal::get_arena().reserve(size * replica_count);
+  neam::cr::out.debug() << LOGGER_INFO << "Reserved " << size * replica_count << " bytes of arena for the callgraph" << std::endl;
+}
+
+/// \brief Start loading file in background. The internal lock must be held
+static void _start_warm_start(const std::string &file)
+{
+  std::lock_guard<std::mutex> _u0(warm_start.lock);
+  if (warm_start.thread.joinable())
+    return;
+  warm_start_pending = true;
+  warm_start.thread = std::thread(_warm_start, file);
+}
+
+/// \brief Wait for the previous data to be merged (must be called before anything that uses the stash list or writes a file)
+/// \note The internal lock must NOT be held
+static void _wait_for_warm_start()
+{
+  std::lock_guard<std::mutex> _u0(warm_start.lock);
+  if (warm_start.thread.joinable())
+    warm_start.thread.join();
+}
+
+/// \brief Clear the changes of every data (they are in the snapshot). The internal lock must be held
+static void _forget_changes()
+{
+  flush_image_outdated = true;
+  for (neam::r::internal::data &it : *root_ptr)
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(it.lock);
+    it.changed_func_info.clear();
+    it.changed_stack_entries.clear();
+  }
+}
+
+/// \brief Copy the stash list and clear the changes of every data (they are in the copy). The internal lock must be held
+static root_data *_take_snapshot()
+{
+  flush_image_outdated = true;
+  for (neam::r::internal::data &it : *root_ptr)
+    it.lock.lock();
+  root_data *copy = new root_data(*root_ptr);
+  for (neam::r::internal::data &it : *root_ptr)
+  {
+    it.changed_func_info.clear();
+    it.changed_stack_entries.clear();
+    it.lock.unlock();
+  }
+  return copy;
+}
+
+/// \brief Start the compaction of the journal into the snapshot. The internal lock must be held
+/// The current journal is renamed file.journal.old and a copy of the data is written in background.
+/// Until that copy is written, the snapshot + the old journal + the new journal are still a complete state.
+static void _start_compaction(const std::string &file)
+{
+  if (compaction.thread.joinable())
+    compaction.thread.join();
+
+  const std::string journal = file + ".journal";
+  const std::string old_journal = journal + ".old";
+
+  root_data *copy = _take_snapshot();
+
+  snapshot_file = file;
+  journal_size = 0;
+
+  if (std::ifstream(old_journal)) // a previous compaction has not completed: don't lose that journal
+  {
+    if (_write_snapshot(copy, file))
+    {
+      std::remove(old_journal.c_str());
+      std::remove(journal.c_str());
+      if (crash_dump_file == file)
+      {
+        neam::r::internal::remove_crash_dump(file);
+        crash_dump_file.clear();
+      }
+    }
+    delete copy;
+    return;
+  }
+
+  const bool has_crash_dump = (crash_dump_file == file);
+  if (has_crash_dump)
+    crash_dump_file.clear();
+
+  std::rename(journal.c_str(), old_journal.c_str());
+  compaction.thread = std::thread([copy, file, old_journal, has_crash_dump]()
+  {
+    if (_write_snapshot(copy, file))
+    {
+      std::remove(old_journal.c_str());
+      if (has_crash_dump)
+        neam::r::internal::remove_crash_dump(file);
+    }
+    delete copy;
+  });
+}
+
+/// \brief Append the changes to the journal (or compact it). The internal lock must be held
+static void _sync_journal(const std::string &file)
+{
+  if (snapshot_file != file || journal_size >= neam::r::conf::journal_max_size)
+    return _start_compaction(file);
+  flush_image_outdated = true;
+
+  const std::string journal = file + ".journal";
+  neam::r::internal::journal_record record;
+  uint64_t index = 0;
+  for (neam::r::internal::data &it : *root_ptr)
+  {
+    bool changed;
+    {
+      std::lock_guard<neam::r::internal::mutex_type> _u0(it.lock);
+      changed = neam::r::internal::make_journal_record(it, index, record);
+    }
+    if (changed)
+      journal_size += neam::r::internal::append_journal_record(journal, record);
+    ++index;
+  }
+}
+
+/// \brief Do sync_data_to_disk(), without waiting for the warm start (the stash list must not be about to change)
+static void _sync_data_to_disk(const std::string &file)
+{
+  std::lock_guard<std::mutex> _u1(write_lock);
+  std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+
+  if (root_ptr == nullptr)
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Empty data, will not overwrite/create '" << file << "'" << std::endl;
+    return;
+  }
+
+  _merge_thread_data();
+
+  if (neam::r::conf::use_journal)
+    return _sync_journal(file);
+
+  if (compaction.thread.joinable())
+    compaction.thread.join();
+  _forget_changes();
+  snapshot_file.clear();
+  if (_write_snapshot(root_ptr, file))
+  {
+    // the journals are now outdated
+    std::remove((file + ".journal").c_str());
+    std::remove((file + ".journal.old").c_str());
+    if (crash_dump_file == file)
+    {
+      neam::r::internal::remove_crash_dump(file);
+      crash_dump_file.clear();
+    }
+  }
+}
+
+void neam::r::sync_data_to_disk(const std::string &file)
+{
+  _wait_for_warm_start();
+  _sync_data_to_disk(file);
+}
+
+void neam::r::internal::sync_or_defer(const std::string &file)
+{
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+    if (warm_start_pending)
+    {
+      deferred_sync_file = file;
+      return;
+    }
+  }
+  _sync_data_to_disk(file);
+}
+
+// // BACKGROUND FLUSH // //
+
+static std::thread flusher_thread;
+static std::mutex flusher_mutex;
+static std::condition_variable flusher_cv;
+static std::atomic<bool> flush_pending(false);
+static bool flusher_stop = false; // protected by flusher_mutex
+
+/// \brief Whether or not the global data has changed since the last sync. The internal lock must be held
+static bool _has_changes()
+{
+  for (neam::r::internal::data &it : *root_ptr)
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(it.lock);
+    if (!it.changed_func_info.empty() || !it.changed_stack_entries.empty())
+      return true;
+  }
+  return false;
+}
+
+/// \brief Like sync_data_to_disk(), but the serialization is done on a copy (flush_image), without holding the internal lock
+/// Only the first flush (and the first one after the stash list has changed) copies everything: then, only the entries that have changed
+/// since the last flush are copied under the lock (as journal records), and applied to the copy outside of it.
+static void _background_flush(const std::string &file)
+{
+  _wait_for_warm_start();
+  std::lock_guard<std::mutex> _u1(write_lock);
+  std::vector<neam::r::internal::journal_record> records;
+  bool has_crash_dump;
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+    if (root_ptr == nullptr)
+      return;
+
+    _merge_thread_data();
+    if (!_has_changes())
+      return;
+
+    if (neam::r::conf::use_journal)
+      return _sync_journal(file); // appending is already cheap, and the compaction is done in background
+
+    if (compaction.thread.joinable())
+      compaction.thread.join();
+    snapshot_file.clear();
+    if (flush_image_outdated || !flush_image || flush_image->size() != root_ptr->size())
+    {
+      delete flush_image;
+      flush_image = _take_snapshot();
+      flush_image_outdated = false;
+    }
+    else
+    {
+      uint64_t index = 0;
+      for (neam::r::internal::data &it : *root_ptr)
+      {
+        std::lock_guard<neam::r::internal::mutex_type> _u2(it.lock);
+        neam::r::internal::data &image = (*flush_image)[index];
+        image.launch_count = it.launch_count; // the header of a stash may change without its entries (a rename)
+        image.name = it.name;
+        image.timestamp = it.timestamp;
+
+        records.emplace_back();
+        if (!neam::r::internal::make_journal_record(it, index, records.back()))
+          records.pop_back();
+        ++index;
+      }
+    }
+    has_crash_dump = (crash_dump_file == file);
+    if (has_crash_dump)
+      crash_dump_file.clear();
+  }
+
+  for (const neam::r::internal::journal_record &it : records)
+  {
+    if (!neam::r::internal::apply_journal_record(it, *flush_image))
+    {
+      // the changes do not match the copy: copy everything again (changes are absolute values, the new copy has them)
+      neam::cr::out.warning() << LOGGER_INFO << "Background flush: the changes do not match the copy of the data" << std::endl;
+      std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+      if (root_ptr == nullptr)
+        return;
+      delete flush_image;
+      flush_image = _take_snapshot();
+      flush_image_outdated = false;
+      break;
+    }
+  }
+
+  if (_write_snapshot(flush_image, file))
+  {
+    // the journals are now outdated
+    std::remove((file + ".journal").c_str());
+    std::remove((file + ".journal.old").c_str());
+    if (has_crash_dump)
+      neam::r::internal::remove_crash_dump(file);
+  }
+}
+
+static void _flusher_loop()
+{
+  using clock = std::chrono::steady_clock;
+  clock::time_point last_flush = clock::now();
+
+  std::unique_lock<std::mutex> _u0(flusher_mutex);
+  while (!flusher_stop)
+  {
+    const clock::time_point min_time = last_flush + std::chrono::milliseconds(neam::r::conf::flush_min_interval);
+    const clock::time_point max_time = last_flush + std::chrono::milliseconds(neam::r::conf::flush_max_staleness);
+    const bool pending = flush_pending.load();
+
+    if (pending && neam::r::conf::flush_max_staleness)
+      flusher_cv.wait_until(_u0, std::min(min_time, max_time));
+    else if (pending)
+      flusher_cv.wait_until(_u0, min_time);
+    else if (neam::r::conf::flush_max_staleness)
+      flusher_cv.wait_until(_u0, max_time);
+    else
+      flusher_cv.wait(_u0);
+
+    if (flusher_stop)
+      break;
+
+    const clock::time_point now = clock::now();
+    if (!(flush_pending.load() && now >= min_time) && !(neam::r::conf::flush_max_staleness && now >= max_time))
+      continue;
+
+    flush_pending = false;
+    _u0.unlock();
+    _background_flush(neam::r::conf::out_file);
+    _u0.lock();
+    last_flush = clock::now();
+  }
+
+  // last flush, so nothing is lost
+  _u0.unlock();
+  if (flush_pending.exchange(false))
+    _background_flush(neam::r::conf::out_file);
+}
+
+static void _stop_flusher()
+{
+  {
+    std::lock_guard<std::mutex> _u0(flusher_mutex);
+    flusher_stop = true;
+    flusher_cv.notify_one();
+  }
+  if (flusher_thread.joinable())
+    flusher_thread.join();
+}
+
+void neam::r::internal::request_flush()
+{
+  if (flush_pending.exchange(true))
+    return; // already requested
+
+  {
+    std::lock_guard<std::mutex> _u0(flusher_mutex);
+    if (!flusher_stop)
+    {
+      if (!flusher_thread.joinable())
+      {
+        flusher_thread = std::thread(_flusher_loop);
+        std::atexit(_stop_flusher); // registered after everything the flusher uses has been constructed
+      }
+      flusher_cv.notify_one();
+      return;
+    }
+  }
+
+  // the flusher has been stopped (we're exiting): do it here
+  flush_pending = false;
+  sync_data_to_disk(conf::out_file);
 }
 
 std::string neam::r::get_data_as_json()
 {
+  _wait_for_warm_start();
   std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
   neam::cr::raw_data serialized_data;
 
   if (root_ptr == nullptr)
     return std::string();
 
+  _merge_thread_data();
+  for (internal::data &data_it : *root_ptr)
+  {
+    internal::load_stash(data_it);
+    data_it.fill_persisted_callgraph();
+  }
   serialized_data = neam::cr::persistence::serialize<neam::cr::persistence_backend::json>(root_ptr);
+  for (internal::data &data_it : *root_ptr)
+    data_it.clear_persisted_callgraph();
 
   if (serialized_data.size <= 1)
     return std::string();
@@ -204,8 +850,145 @@ std::string neam::r::get_data_as_json()
   return (const char *)(serialized_data.data);
 }
 
+/// \brief Set the ids of the stack entries and index the functions of a freshly loaded stash. Its lock must be held
+static void _prepare_data(neam::r::internal::data &data)
+{
+  // walk the whole callgraph to set correct ids
+  uint64_t stack_index = 0;
+  for (auto & graph_it : data.callgraph)
+  {
+    uint64_t index = 0;
+    for (neam::r::internal::stack_entry & it : graph_it)
+    {
+      const_cast<uint64_t &>(it.self_index) = index;
+      const_cast<uint64_t &>(it.stack_index) = stack_index;
+      ++index;
+    }
+    ++stack_index;
+  }
+
+  data.index_func_info();
+}
+
+/// \brief Set the ids of the stack entries and index the functions of freshly loaded data (only the stashes that are decoded)
+static void _prepare_loaded_data(root_data &root)
+{
+  for (neam::r::internal::data &data_it : root)
+  {
+    if (!data_it.is_loaded())
+      continue;
+    std::lock_guard<neam::r::internal::mutex_type> _u0(data_it.lock); // lock 'cause we do a lot of nasty things.
+    _prepare_data(data_it);
+  }
+}
+
+void neam::r::internal::load_stash(data &d)
+{
+  std::lock_guard<neam::r::internal::mutex_type> _u0(d.lock);
+  if (d.is_loaded())
+    return;
+
+  std::shared_ptr<const binary::mapped_file> source = std::move(d.lazy_source);
+  d.lazy_source.reset();
+  if (!binary::decode_data(source->get_view(), d.lazy_index, d))
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to load the stash '" << d.name << "', data is probably corrupted" << std::endl;
+    d.func_info.clear();
+    d.callgraph.clear();
+  }
+  _prepare_data(d);
+}
+
+/// \brief Read and deserialize a snapshot
+/// \note For binary files, only the active stash is decoded (see binary::decode())
+static root_data *_read_snapshot(const std::string &file)
+{
+  std::shared_ptr<const neam::r::binary::mapped_file> source = neam::r::binary::mapped_file::open(file);
+
+  if (!source)
+  {
+    if (!std::ifstream(file))
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "': file does not exists" << std::endl;
+    else
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "': empty file" << std::endl;
+    return nullptr;
+  }
+
+  const size_t size = source->get_size();
+  const char *memory = reinterpret_cast<const char *>(source->get_memory());
+
+  root_data *root;
+  const neam::r::binary::view binary_file = source->get_view();
+  if (binary_file.is_valid())
+    root = neam::r::binary::decode(binary_file, source);
+  else if (size >= 4 && *reinterpret_cast<const uint32_t *>(memory) == neam::r::binary::magic)
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "': unsupported version or truncated file" << std::endl;
+    return nullptr;
+  }
+  else
+  {
+    // the JSON deserializer wants a null-terminated string
+    std::string json(memory, size);
+    neam::cr::raw_data serialized_data;
+    serialized_data.ownership = false;
+    serialized_data.data = (int8_t *)&json[0];
+    serialized_data.size = size;
+
+    root = neam::cr::persistence::deserialize<neam::cr::persistence_backend::json, root_data>(serialized_data);
+#ifdef _MSC_VER
+    if (root)
+    {
+      for (neam::r::internal::data &data_it : *root)
+        data_it.post_deserialization();
+    }
+#endif
+  }
+
+  if (!root)
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "', data is probably corrupted" << std::endl;
+  return root;
+}
+
+/// \brief Read a snapshot, replay its journals and apply its crash dump (the global data is not touched)
+/// \param[out] crash_dump_applied Whether or not a crash dump has been applied
+static root_data *_load_root(const std::string &file, bool &crash_dump_applied)
+{
+  crash_dump_applied = false;
+  root_data *root = _read_snapshot(file);
+
+  // replay the journals (the old one first: it's from a compaction that has not completed)
+  const std::string journal = file + ".journal";
+  const std::string old_journal = journal + ".old";
+  if (std::ifstream(old_journal) || std::ifstream(journal))
+  {
+    if (!root)
+      root = new root_data;
+    neam::r::internal::replay_journal(old_journal, *root);
+    neam::r::internal::replay_journal(journal, *root);
+  }
+  if (!root && std::ifstream(file + ".crash")) // crashed before the first sync
+    root = new root_data;
+
+  if (!root)
+    return nullptr;
+
+  _prepare_loaded_data(*root);
+
+  // the crash dump of the last launch (if any) is applied once the ids and the hashes are correct
+  if (neam::r::internal::apply_crash_dump(file, *root))
+  {
+    crash_dump_applied = true;
+    for (neam::r::internal::data &data_it : *root)
+      data_it.index_func_info(); // it may have added some functions
+  }
+  return root;
+}
+
 bool neam::r::load_data_from_disk(const std::string &file)
 {
+  _wait_for_warm_start();
+  _merge_thread_data(merge_mode::discard); // pending counters refer to the data we are about to delete
   if (root_ptr)
   {
     delete root_ptr;
@@ -213,75 +996,367 @@ bool neam::r::load_data_from_disk(const std::string &file)
   }
   global_ptr = nullptr;
 
-  std::string contents;
-  std::ifstream inf(file, std::ios_base::binary);
+  if (compaction.thread.joinable()) // it may be writing file
+    compaction.thread.join();
+  snapshot_file.clear(); // the next journaled sync will start with a snapshot
+  flush_image_outdated = true;
+  crash_dump_file.clear();
 
-  if (!inf)
-  {
-    neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "': file does not exists" << std::endl;
+  bool crash_dump_applied;
+  root_ptr = _load_root(file, crash_dump_applied);
+  if (!root_ptr)
     return false;
+
+  if (root_ptr->size())
+  {
+    global_ptr = &root_ptr->back();
+    ++global_ptr->launch_count;
+    _reserve_arena(*global_ptr, 1);
   }
+  if (crash_dump_applied)
+    crash_dump_file = file;
+
+  neam::cr::out.debug() << LOGGER_INFO << "Loaded '" << file << "'" << std::endl;
+  return true;
+}
 
-  inf.seekg(0, std::ios_base::end);
-  int64_t size = inf.tellg();
-  inf.seekg(0, std::ios_base::beg);
+// // // MERGE // // //
 
-  if (!size || size < 0)
+/// \brief Merge the average of older samples (the ones of d are the most recent ones)
+/// \param exact Whether or not the result is the count-weighted average (else, conf::sliding_average applies, as for recorded samples)
+static void _merge_older_average(double &average, uint64_t &count, double older_average, uint64_t older_count, bool exact)
+{
+  if (!older_count)
+    return;
+  if (exact)
   {
-    neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "': empty file" << std::endl;
-    return false;
+    average = (average * double(count) + older_average * double(older_count)) / double(count + older_count);
+    count += older_count;
+    return;
   }
+  double merged = older_average;
+  uint64_t merged_count = older_count;
+  neam::r::internal::merge_average(merged, merged_count, average * double(count), count);
+  average = merged;
+  count = merged_count;
+}
 
-  char *memory = new char[size + 1];
+/// \brief Put the older elements of a deque before the ones of d
+template<typename Type>
+static void _prepend(std::deque<Type> &d, const std::deque<Type> &older, size_t max_size = 0)
+{
+  d.insert(d.begin(), older.begin(), older.end());
+  if (max_size && d.size() > max_size)
+    d.erase(d.begin(), d.begin() + (d.size() - max_size));
+}
 
-  inf.read(memory, size);
-  memory[size] = 0;
+/// \brief Merge the content of a stack_entry (not its children)
+static void _merge_stack_entry(neam::r::internal::stack_entry &d, const neam::r::internal::stack_entry &older, const std::vector<uint64_t> &func_map, bool exact_average)
+{
+  d.hit_count += older.hit_count;
+  d.fail_count += older.fail_count;
 
-  cr::raw_data serialized_data;
-  serialized_data.ownership = false;
-  serialized_data.data = (int8_t *)memory;
-  serialized_data.size = size;
+  _merge_older_average(d.average_self_time, d.average_self_time_count, older.average_self_time, older.average_self_time_count, exact_average);
+  _merge_older_average(d.average_global_time, d.average_global_time_count, older.average_global_time, older.average_global_time_count, exact_average);
+  d.self_time_histogram.add(older.self_time_histogram);
+  d.global_time_histogram.add(older.global_time_histogram);
 
-  root_ptr = neam::cr::persistence::deserialize<neam::cr::persistence_backend::json, root_data>(serialized_data);
+  if (!older.cold.exists())
+    return;
+  const neam::r::internal::stack_entry_cold &older_cold = older.cold.get();
+  neam::r::internal::stack_entry_cold &d_cold = d.cold.get_or_create();
 
-  delete [] memory;
+  _prepend(d_cold.self_time_progression, older_cold.self_time_progression, neam::r::conf::max_progression_entries);
+  _prepend(d_cold.global_time_progression, older_cold.global_time_progression, neam::r::conf::max_progression_entries);
 
-  if (root_ptr)
+  _prepend(d_cold.fails, older_cold.fails);
+  for (const auto &it : older_cold.reports)
+    _prepend(d_cold.reports[it.first], it.second);
+  for (const auto &it : older_cold.measure_points)
   {
-    if (root_ptr->size())
+    neam::r::measure_point_entry &mpe = d_cold.measure_points[it.first];
+    _merge_older_average(mpe.value, mpe.hit_count, it.second.value, it.second.hit_count, exact_average);
+  }
+  for (const auto &it : older_cold.sequences)
+    d_cold.sequences.emplace(it.first, it.second); // the most recent one is kept
+
+  // the calls of the exemplars refer to the functions of older
+  for (neam::r::exemplar ex : older_cold.exemplars)
+  {
+    if (std::any_of(ex.calls.begin(), ex.calls.end(), [&func_map](const neam::r::exemplar_call &call) { return call.call_structure_index >= func_map.size(); }))
+      continue;
+    for (neam::r::exemplar_call &call : ex.calls)
+      call.call_structure_index = func_map[call.call_structure_index];
+    d.add_exemplar(std::move(ex));
+  }
+}
+
+void neam::r::internal::merge_data(data &d, const data &older, bool exact_average)
+{
+  // functions
+  std::vector<uint64_t> func_map(older.func_info.size());
+  for (size_t i = 0; i < older.func_info.size(); ++i)
+  {
+    const call_info_struct &ocis = older.func_info[i];
+    long index = _find_call_info_struct(d, ocis.descr);
+    if (index < 0)
     {
-      global_ptr = &root_ptr->back();
-      ++global_ptr->launch_count;
+      index = d.func_info.size();
+      d.func_info.push_back(ocis);
+      d.index_func(index);
     }
-    for (internal::data &data_it : *root_ptr)
+    else
     {
-#ifdef _MSC_VER
-      data_it.post_deserialization();
-#endif
-      std::lock_guard<internal::mutex_type> _u0(data_it.lock); // lock 'cause we do a lot of nasty things.
+      call_info_struct &cis = d.func_info[index];
+      cis.call_count += ocis.call_count;
+      cis.fail_count += ocis.fail_count;
+      _merge_older_average(cis.average_self_time, cis.average_self_time_count, ocis.average_self_time, ocis.average_self_time_count, exact_average);
+      _merge_older_average(cis.average_global_time, cis.average_global_time_count, ocis.average_global_time, ocis.average_global_time_count, exact_average);
+      cis.self_time_histogram.add(ocis.self_time_histogram);
+      cis.global_time_histogram.add(ocis.global_time_histogram);
+      if (cis.descr.pretty_name.empty())
+        cis.descr.pretty_name = ocis.descr.pretty_name;
+      if (cis.descr.file.empty())
+      {
+        cis.descr.file = ocis.descr.file;
+        cis.descr.line = ocis.descr.line;
+      }
+    }
+    func_map[i] = index;
+    d.changed_func_info.insert(index);
+  }
 
-      // walk the whole callgraph to set correct ids
-      uint64_t stack_index = 0;
-      for (auto & graph_it : data_it.callgraph)
+  // callgraph: roots are matched by function, then children are matched by function, by path
+  for (const stack_entry_list &ograph : older.callgraph)
+  {
+    if (ograph.empty() || ograph[0].call_structure_index >= func_map.size())
+      continue;
+    const uint64_t root_func = func_map[ograph[0].call_structure_index];
+
+    uint64_t stack_index = 0;
+    while (stack_index < d.callgraph.size() && (d.callgraph[stack_index].empty() || d.callgraph[stack_index][0].call_structure_index != root_func))
+      ++stack_index;
+    if (stack_index == d.callgraph.size())
+    {
+      d.callgraph.emplace_back();
+      d.callgraph.back().emplace_back(stack_entry{0, stack_index, root_func, 0});
+      d.callgraph.back().back().hit_count = 0;
+    }
+    stack_entry_list &graph = d.callgraph[stack_index];
+
+    std::vector<std::pair<uint64_t, uint64_t>> to_merge = {{0, 0}}; // (index in ograph, index in graph)
+    while (!to_merge.empty())
+    {
+      const uint64_t oindex = to_merge.back().first;
+      const uint64_t index = to_merge.back().second;
+      to_merge.pop_back();
+
+      _merge_stack_entry(graph[index], ograph[oindex], func_map, exact_average);
+      d.changed_stack_entries.emplace(stack_index, index);
+
+      for (uint64_t ochild : ograph[oindex].children)
       {
-        uint64_t index = 0;
-        for (internal::stack_entry & it : graph_it)
+        if (ochild >= ograph.size() || ograph[ochild].call_structure_index >= func_map.size())
+          continue;
+        const uint64_t func = func_map[ograph[ochild].call_structure_index];
+        long child = -1;
+        for (uint64_t it : graph[index].children)
+        {
+          if (graph[it].call_structure_index == func)
+          {
+            child = long(it);
+            break;
+          }
+        }
+        if (child < 0)
         {
-          const_cast<uint64_t &>(it.self_index) = index;
-          const_cast<uint64_t &>(it.stack_index) = stack_index;
-          ++index;
+          child = graph.size();
+          graph.emplace_back(stack_entry{uint64_t(child), stack_index, func, index});
+          graph.back().hit_count = 0;
+          graph[index].children.push_back(child);
         }
-        ++stack_index;
+        to_merge.emplace_back(ochild, uint64_t(child));
       }
     }
-    neam::cr::out.debug() << LOGGER_INFO << "Loaded '" << file << "'" << std::endl;
-    return true;
   }
-  else
+}
+
+/// \brief Merge every stash of from into the stash of root that has the same name (from is decoded)
+static void _merge_stashes(root_data &root, root_data &from)
+{
+  for (neam::r::internal::data &it : from)
   {
-    neam::cr::out.warning() << LOGGER_INFO << "Failed to load '" << file << "', data is probably corrupted" << std::endl;
+    neam::r::internal::load_stash(it);
+
+    neam::r::internal::data *target = nullptr;
+    for (neam::r::internal::data &rit : root)
+    {
+      if (rit.name == it.name)
+        target = &rit;
+    }
+    if (!target)
+    {
+      root.emplace_back();
+      target = &root.back();
+      target->launch_count = 0;
+      target->name = it.name;
+      target->timestamp = it.timestamp;
+    }
+
+    std::lock_guard<neam::r::internal::mutex_type> _u0(target->lock);
+    neam::r::internal::merge_data(*target, it, true);
+    target->launch_count += it.launch_count;
+    target->timestamp = std::max(target->timestamp, it.timestamp);
+  }
+}
+
+size_t neam::r::merge_data_files(const std::vector<std::string> &files, const std::string &out_file, size_t thread_count)
+{
+  if (!thread_count)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::min(thread_count, files.size());
+
+  // each thread merges the files it loads in its own root, those are merged once every file has been loaded
+  std::vector<root_data> partials(thread_count);
+  std::atomic<size_t> next_file(0);
+  std::atomic<size_t> merged_count(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    threads.emplace_back([&, i]()
+    {
+      for (size_t index = next_file++; index < files.size(); index = next_file++)
+      {
+        bool crash_dump_applied;
+        root_data *root = _load_root(files[index], crash_dump_applied);
+        if (!root)
+          continue;
+        _merge_stashes(partials[i], *root);
+        delete root;
+        ++merged_count;
+      }
+    });
+  }
+  for (std::thread &it : threads)
+    it.join();
+
+  if (!merged_count)
+    return 0;
+
+  root_data *result = new root_data;
+  for (root_data &it : partials)
+    _merge_stashes(*result, it);
+  if (!_write_snapshot(result, out_file))
+    merged_count = 0;
+  delete result;
+  return merged_count;
+}
+
+/// \brief Load file and merge it into the data threads are already recording into (run by the warm start thread)
+static void _warm_start(const std::string &file)
+{
+  bool crash_dump_applied;
+  root_data *loaded = _load_root(file, crash_dump_applied);
+  std::string sync_file;
+
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+    if (loaded && !loaded->empty())
+    {
+      neam::r::internal::data &older = loaded->back();
+      _reserve_arena(older, 2); // merged into the global data, then recorded again by the threads
+      {
+        std::lock_guard<neam::r::internal::mutex_type> _u1(global_ptr->lock);
+        neam::r::internal::merge_data(*global_ptr, older);
+        global_ptr->launch_count = older.launch_count + 1;
+        if (global_ptr->name.empty())
+          global_ptr->name = older.name;
+      }
+
+      // the other stashes go before the active one (push_front() does not invalidate the references to it)
+      loaded->pop_back();
+      while (!loaded->empty())
+      {
+        root_ptr->emplace_front();
+        neam::r::internal::data &stash = root_ptr->front();
+        neam::r::internal::data &it = loaded->back();
+        stash.launch_count = it.launch_count;
+        stash.func_info.swap(it.func_info);
+        stash.func_index.swap(it.func_index);
+        stash.callgraph.swap(it.callgraph);
+        stash.name.swap(it.name);
+        stash.timestamp = it.timestamp;
+        stash.lazy_source = std::move(it.lazy_source);
+        stash.lazy_index = it.lazy_index;
+        loaded->pop_back();
+      }
+
+      snapshot_file.clear(); // the indexes of the stashes have changed: the next journaled sync will start with a snapshot
+      flush_image_outdated = true;
+      if (crash_dump_applied)
+        crash_dump_file = file;
+      neam::cr::out.debug() << LOGGER_INFO << "Loaded '" << file << "' (warm start)" << std::endl;
+    }
+    warm_start_pending = false;
+    sync_file.swap(deferred_sync_file);
+  }
+  delete loaded;
+
+  // the syncs that have been asked while loading (this thread can't wait for itself)
+  if (!sync_file.empty())
+    _sync_data_to_disk(sync_file);
+}
+
+// // // LIVE PROFILE // // //
+
+std::string neam::r::internal::encode_live_data()
+{
+  std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+  if (root_ptr == nullptr)
+    return std::string();
+
+  _merge_thread_data();
+  for (internal::data &it : *root_ptr)
+    it.lock.lock();
+  std::string ret = binary::encode(*root_ptr);
+  for (internal::data &it : *root_ptr)
+    it.lock.unlock();
+  return ret;
+}
+
+bool neam::r::load_data_from_live_profile(const std::string &name)
+{
+  _wait_for_warm_start();
+  std::string image;
+  if (!internal::read_live_profile(name, image))
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to read the live profile '" << name << "'" << std::endl;
+    return false;
+  }
+  binary::view view(image.data(), image.size());
+  root_data *root = view.is_valid() ? binary::decode(view) : nullptr;
+  if (!root)
+  {
+    neam::cr::out.warning() << LOGGER_INFO << "Failed to load the live profile '" << name << "', data is probably corrupted" << std::endl;
     return false;
   }
+
+  _merge_thread_data(merge_mode::discard); // pending counters refer to the data we are about to delete
+  if (compaction.thread.joinable())
+    compaction.thread.join();
+  snapshot_file.clear();
+  flush_image_outdated = true;
+  crash_dump_file.clear();
+
+  delete root_ptr;
+  root_ptr = root;
+  if (root_ptr->empty())
+    root_ptr->emplace_back();
+  global_ptr = &root_ptr->back();
+  _prepare_loaded_data(*root_ptr);
+
+  neam::cr::out.debug() << LOGGER_INFO << "Loaded the live profile '" << name << "'" << std::endl;
+  return true;
 }
 
 // // // STASH // // //
@@ -289,6 +1364,11 @@ bool neam::r::load_data_from_disk(const std::string &file)
 void neam::r::stash_current_data(const std::string &name)
 {
   internal::get_global_data(); // init, if not already done
+  _wait_for_warm_start();
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+    _merge_thread_data(merge_mode::merge_and_forget); // pending counters belong to the data being stashed
+  }
 
   // stash it !
   global_ptr->timestamp = time(nullptr);
@@ -298,16 +1378,26 @@ void neam::r::stash_current_data(const std::string &name)
 
   if (std::max(2l, conf::max_stash_count) < long(root_ptr->size()) && conf::max_stash_count >= 0)
     root_ptr->pop_front();
+
+  std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+  snapshot_file.clear(); // the indexes of the stashes may have changed: the next journaled sync will start with a snapshot
+  flush_image_outdated = true;
 }
 
 bool neam::r::load_data_from_stash(const std::string &data_name)
 {
   internal::get_global_data(); // init, if not already done
+  _wait_for_warm_start();
+  {
+    std::lock_guard<neam::r::internal::mutex_type> _u0(internal_lock);
+    _merge_thread_data(merge_mode::merge_and_forget); // pending counters belong to the current data
+  }
 
   for (internal::data &data_it : *root_ptr)
   {
     if (data_it.name == data_name)
     {
+      internal::load_stash(data_it);
       global_ptr = &data_it;
       return true;
     }
@@ -318,6 +1408,7 @@ bool neam::r::load_data_from_stash(const std::string &data_name)
 bool neam::r::auto_stash_current_data(const std::string &name)
 {
   internal::get_global_data(); // init, if not already done
+  _wait_for_warm_start();
 
   if (global_ptr->name.empty())
   {
@@ -335,6 +1426,7 @@ bool neam::r::auto_stash_current_data(const std::string &name)
 std::vector<std::string> neam::r::get_stashes_name()
 {
   internal::get_global_data(); // init, if not already done
+  _wait_for_warm_start();
 
   std::vector<std::string> namevec;
   for (internal::data &data_it : *root_ptr)
@@ -350,6 +1442,7 @@ std::vector<std::string> neam::r::get_stashes_name()
 std::vector<long> neam::r::get_stashes_timestamp()
 {
   internal::get_global_data(); // init, if not already done
+  _wait_for_warm_start();
 
   std::vector<long> tsvec;
   for (internal::data &data_it : *root_ptr)
@@ -360,6 +1453,7 @@ std::vector<long> neam::r::get_stashes_timestamp()
 size_t neam::r::get_active_stash_index()
 {
   internal::get_global_data(); // init, if not already done
+  _wait_for_warm_start();
 
   size_t index = 0;
   for (internal::data &data_it : *root_ptr)
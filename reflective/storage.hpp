@@ -30,6 +30,10 @@
 #include <mutex>
 #include <set>
 #include <map>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <memory>
 #include "stack_entry.hpp"
 #include "call_info_struct.hpp"
 #include "type.hpp"
@@ -43,7 +47,11 @@ namespace neam
 
   namespace r
   {
-    class function_call;
+    class basic_function_call;
+    namespace binary
+    {
+      class mapped_file;
+    } // namespace binary
 
     /// \brief This is internal data. If you touch anything from here,
     /// please expect reflective to either crash, be corrupted or simply doesn't
@@ -55,24 +63,143 @@ namespace neam
       {
         public: // methods
           data(const data &o)
-          : launch_count(o.launch_count), func_info(o.func_info),
-            callgraph(o.callgraph), name(o.name), timestamp(o.timestamp)
+          : launch_count(o.launch_count), func_info(o.func_info), func_index(o.func_index),
+            callgraph(o.callgraph), name(o.name), timestamp(o.timestamp),
+            lazy_source(o.lazy_source), lazy_index(o.lazy_index)
           {}
           data() = default;
           ~data() = default;
 
+          /// \brief Rebuild func_index (after a load). Legacy 32bit hashes and string hashes with the top bit set (older files) are recomputed from the key names.
+          /// \note Pointer-based ids (N_R_XBUILD_COMPAT, see hash_from_ptr()) have their top bit set and are kept as they are
+          /// \note The callgraph index is rebuilt too (see get_stack_entry_locations())
+          void index_func_info()
+          {
+            stack_entry_index.clear();
+            indexed_entry_counts.clear();
+            func_index.clear();
+            for (uint64_t i = 0; i < func_info.size(); ++i)
+            {
+              func_descriptor &descr = func_info[i].descr;
+              if (!descr.key_name.empty())
+              {
+                const uint64_t hash = hash_from_str(descr.key_name.c_str());
+                if (descr.key_hash <= 0xFFFFFFFFull || (descr.key_hash & ~(1ull << 63)) == hash)
+                  descr.key_hash = hash;
+              }
+              func_info[i].hash_collision = false;
+              func_info[i].verified_key_name = nullptr;
+              index_func(i);
+            }
+          }
+
+          /// \brief Add the function at index to func_index. If another function already has its hash, both are marked (see call_info_struct::hash_collision)
+          /// \return false on a collision
+          bool index_func(uint64_t index)
+          {
+            call_info_struct &cis = func_info[index];
+            if (!cis.descr.key_hash)
+              return true;
+            auto it = func_index.emplace(cis.descr.key_hash, index);
+            if (it.second)
+              return true;
+            cis.hash_collision = true;
+            func_info[it.first->second].hash_collision = true;
+            return false;
+          }
+
+          /// \brief Return the locations (stack_index, self_index) of the callgraph entries of a function (the lock must be held)
+          /// \note The callgraph only grows: the entries added since the last call are indexed first, so this costs O(occurrences)
+          ///       instead of a scan of the whole callgraph
+          const std::vector<std::pair<uint64_t, uint64_t>> &get_stack_entry_locations(uint64_t call_info_index)
+          {
+            index_callgraph();
+            if (call_info_index >= stack_entry_index.size())
+            {
+              static const std::vector<std::pair<uint64_t, uint64_t>> empty;
+              return empty;
+            }
+            return stack_entry_index[call_info_index];
+          }
+
+          /// \brief Index the callgraph entries added since the last call (the lock must be held)
+          void index_callgraph()
+          {
+            // the callgraph has been replaced: start over
+            bool replaced = callgraph.size() < indexed_entry_counts.size();
+            for (uint64_t i = 0; i < indexed_entry_counts.size() && !replaced; ++i)
+              replaced = callgraph[i].size() < indexed_entry_counts[i];
+            if (replaced)
+            {
+              stack_entry_index.clear();
+              indexed_entry_counts.clear();
+            }
+
+            indexed_entry_counts.resize(callgraph.size(), 0);
+            for (uint64_t stack_index = 0; stack_index < callgraph.size(); ++stack_index)
+            {
+              const stack_entry_list &graph = callgraph[stack_index];
+              for (uint64_t self_index = indexed_entry_counts[stack_index]; self_index < graph.size(); ++self_index)
+              {
+                const uint64_t call_info_index = graph[self_index].call_structure_index;
+                if (call_info_index >= stack_entry_index.size())
+                  stack_entry_index.resize(call_info_index + 1);
+                stack_entry_index[call_info_index].emplace_back(stack_index, self_index);
+              }
+              indexed_entry_counts[stack_index] = graph.size();
+            }
+          }
+
+          /// \brief Copy the callgraph in persisted_callgraph, just before a JSON serialization (see clear_persisted_callgraph())
+          void fill_persisted_callgraph()
+          {
+            persisted_callgraph.clear();
+            for (const stack_entry_list &graph : callgraph)
+            {
+              persisted_callgraph.emplace_back();
+              for (const stack_entry &it : graph)
+                persisted_callgraph.back().push_back(persisted_stack_entry::from_stack_entry(it));
+            }
+          }
+
+          /// \brief Free persisted_callgraph, once the JSON serialization is done
+          void clear_persisted_callgraph()
+          {
+            persisted_callgraph.clear();
+            persisted_callgraph.shrink_to_fit();
+          }
+
+          /// \brief Whether or not the stash has been decoded (see load_stash())
+          bool is_loaded() const { return !lazy_source; }
+
         public: // attributes
           uint64_t launch_count = 1;
 
           mutex_type lock; // only used if global == this (else, the structure is per-thread, no need to lock)
           std::deque<call_info_struct> func_info; // protected by the mutex lock
+          std::unordered_map<uint64_t, uint64_t> func_index; // key_hash -> index in func_info (not serialized, protected by the mutex lock)
+
+          std::deque<stack_entry_list> callgraph; // only insertions &lookups are permitted, protected by the mutex lock
 
-          std::deque<std::deque<stack_entry>> callgraph; // only insertions &lookups are permitted, protected by the mutex lock
+          // the callgraph, with the cold part of the entries inline: only used for the JSON (de)serialization
+          std::deque<std::deque<persisted_stack_entry>> persisted_callgraph;
+
+          // call_info index -> (stack_index, self_index) of its callgraph entries (not serialized, protected by the mutex lock)
+          std::vector<std::vector<std::pair<uint64_t, uint64_t>>> stack_entry_index;
+          std::vector<uint64_t> indexed_entry_counts; // the number of entries of each stack that are in stack_entry_index
 
           // when stashed only //
           std::string name;
           int64_t timestamp;
 
+          // what has changed since the last journal record (not serialized, protected by the mutex lock)
+          std::set<uint64_t> changed_func_info;
+          std::set<std::pair<uint64_t, uint64_t>> changed_stack_entries; // (stack_index, self_index)
+
+          // when not decoded yet: only launch_count, name and timestamp are set (not serialized)
+          std::shared_ptr<const binary::mapped_file> lazy_source; // the file the stash is in
+          uint64_t lazy_index = 0; // the index of the stash in lazy_source
+
 #ifndef _MSC_VER
         private:
 #endif
@@ -80,6 +207,21 @@ namespace neam
           void post_deserialization()
           {
             new (&lock) mutex_type(); // placement new for lock
+            new (&func_index) std::unordered_map<uint64_t, uint64_t>();
+            new (&callgraph) std::deque<stack_entry_list>();
+            for (const std::deque<persisted_stack_entry> &graph : persisted_callgraph)
+            {
+              callgraph.emplace_back();
+              for (const persisted_stack_entry &it : graph)
+                callgraph.back().push_back(it.to_stack_entry());
+            }
+            clear_persisted_callgraph();
+            new (&stack_entry_index) std::vector<std::vector<std::pair<uint64_t, uint64_t>>>();
+            new (&indexed_entry_counts) std::vector<uint64_t>();
+            new (&changed_func_info) std::set<uint64_t>();
+            new (&changed_stack_entries) std::set<std::pair<uint64_t, uint64_t>>();
+            new (&lazy_source) std::shared_ptr<const binary::mapped_file>();
+            lazy_index = 0;
           }
 
         private:
@@ -87,22 +229,108 @@ namespace neam
       };
 
       /// \brief This is a purely thread local thing
+      /// It also holds the counters of the call_info_structs and the callgraph that the thread has not yet merged into the global data.
+      /// Those are merged at sync/introspect time (or when the thread exits), so that the global lock is never
+      /// taken on the hot path of function_call.
       struct thread_local_data
       {
         thread_local_data();
         ~thread_local_data();
 
-        function_call *top = nullptr;
+        /// \brief Set the global data the accumulators and the callgraph refer to (lock must be held)
+        /// \note If the global data has changed since the last call, everything is merged into the old one first
+        void use_global(data *global)
+        {
+          if (owner != global)
+          {
+            merge_to_global();
+            owner = global;
+          }
+        }
+
+        /// \brief Return the accumulator of the call_info_struct at index (lock must be held)
+        /// \see use_global()
+        call_info_accumulator &get_accumulator(data *global, size_t index)
+        {
+          use_global(global);
+          if (index >= accumulators.size())
+            accumulators.resize(index + 1);
+          return accumulators[index];
+        }
+
+        /// \brief Merge the accumulators into the global data they refer to, clear them and forget about that data (lock must be held)
+        void merge_to_global();
+
+        /// \brief Drop the accumulators and the callgraph counters without merging them (lock must be held)
+        void discard()
+        {
+          accumulators.clear();
+          graph.discard();
+          owner = nullptr;
+        }
+
+        basic_function_call *top = nullptr;
+
+        mutex_type lock; // only contended when another thread merges this thread data
+        data *owner = nullptr; // the data the accumulators and the callgraph refer to
+        std::vector<call_info_accumulator> accumulators; // indexed like data::func_info, protected by the mutex lock
+        thread_callgraph graph; // protected by the mutex lock
+
+        /// \brief A call of the current root call tree (see conf::exemplars)
+        struct exemplar_event
+        {
+          uint64_t call_structure_index;
+          uint64_t start; // in ticks
+          uint64_t duration; // in ticks
+          uint32_t depth;
+        };
+        std::vector<exemplar_event> exemplar_events; // the calls of the current root call tree (only used by the thread itself)
+        uint64_t exemplar_dropped_calls = 0; // the calls that didn't fit in exemplar_events
       };
 
       /// \brief Get the thread-local data
       thread_local_data *get_thread_data();
+      /// \brief Return the thread-local data of the current thread, or nullptr if it has not been created yet
+      /// \note Unlike get_thread_data(), this never constructs it (no lock, no allocation): it's used by the crash dump
+      thread_local_data *peek_thread_data();
       /// \brief Get the global data
       data *get_global_data();
 
+      /// \brief Return the global data (nullptr if not initialized) and its index in the stash list (-1 if unknown)
+      /// \note This neither initializes, locks nor allocates anything (it's used by the crash dump)
+      data *peek_global_data(long &index);
+
       /// \brief Return the local data from all threads
       std::set<thread_local_data *> &get_all_thread_data();
 
+      /// \brief Decode a stash that has been lazily loaded (does nothing if it already is)
+      /// \note Only the active stash is decoded by load_data_from_disk(), the others are decoded when they are needed
+      void load_stash(data &d);
+
+      /// \brief Merge the functions and the callgraph of older into d, by function identity (see func_descriptor::operator ==)
+      /// Counters are added, averages are weighted, and the fails / reports / progressions of older are put before those of d.
+      /// \param exact_average If true, averages are weighted by their sample counts. Else the samples of older are the past samples
+      ///                      of a sliding average (see conf::sliding_average)
+      /// \note Nothing of d is removed or moved (things are only appended): the indexes and the references to its call_info_structs
+      ///       and stack_entries stay valid, so d can be the global data threads are recording into. d.lock must be held.
+      void merge_data(data &d, const data &older, bool exact_average = false);
+
+      /// \brief Merge the pending per-thread counters of every thread into the global data
+      /// \note This is done by sync_data_to_disk(), get_data_as_json() and when creating introspect objects
+      void merge_thread_data();
+
+      /// \brief Update the exemplar thresholds every thread uses (see call_info_accumulator::exemplar_threshold) from the global data
+      /// \note Threads also update them when they are merged
+      void update_exemplar_thresholds();
+
+      /// \brief Ask the background flusher thread to sync the data to conf::out_file (the thread is started on the first call)
+      /// \note This is what the last function_call on the stack does at its destruction when conf::background_flush is true
+      void request_flush();
+
+      /// \brief Sync the data to file, unless the previous data is still being loaded (conf::async_load): the sync is then done by the loading thread once it is merged
+      /// \note This is what the last function_call on the stack does at its destruction when conf::background_flush is false: it never waits for the load
+      void sync_or_defer(const std::string &file);
+
       /// \brief Cleanup currently active function_calls.
       /// If you call it without exiting right after, you may crash or have corrupted
       /// data. (in fact, you will crash as soon as any active function_call will be destructed)
@@ -112,28 +340,29 @@ namespace neam
       /// \brief Do not use directly, please use get_call_info_struct() instead
       /// This version is the one that perform the search. get_call_info_struct() will look in a cache to see if the structure has already been found/created
       /// \see get_call_info_struct
-      call_info_struct &_get_call_info_struct(const func_descriptor &d, long int &index);
+      call_info_struct &_get_call_info_struct(const static_func_descriptor &d, long int &index);
       /// \brief Return the call_info_struct at a given index
       /// \see get_call_info_struct
       call_info_struct &get_call_info_struct_at_index(long index);
 
       /// \brief This function will not create the structure if nothing is found
-      call_info_struct *_get_call_info_struct_search_only(const func_descriptor &d, long &index);
+      call_info_struct *_get_call_info_struct_search_only(const static_func_descriptor &d, long &index);
 
       /// \brief Get (or create) the call_info_struct for a given hash/name + possibly set the pretty_name attribute
       /// \note we use some cache here, but it will work most probably work on a per-translation unit basis (except, probably, with some compiler flags to merge globals/statics)
       /// Nevertheless this will increase the speed a little, but will also increase the final executable size (of at least 8bit per monitored function)
       template<typename FuncType, FuncType Func>
-      call_info_struct &get_call_info_struct(const func_descriptor &d, size_t *_index = nullptr, bool search_only = false)
+      call_info_struct &get_call_info_struct(const static_func_descriptor &d, size_t *_index = nullptr, bool search_only = false)
       {
         static long index = -1; // This is an invalid index
 
-        if (index != -1)
+        if (index != -1 && index < long(get_global_data()->func_info.size())) // the global data may have changed (stash)
         {
           if (_index)
             *_index = index;
           call_info_struct &ret = get_call_info_struct_at_index(index);
-          if (ret.descr == d)
+          // the hash is enough, unless another function has the same (the key names are then compared)
+          if (d.key_hash ? ret.descr.key_hash == d.key_hash && (!ret.hash_collision || d.key_name == ret.descr.key_name) : ret.descr == d)
             return ret;
         }
         // Both perform the search-or-create and setup the index
@@ -155,16 +384,17 @@ namespace neam
       /// \note we use some cache here, but it will work most probably work on a per-translation unit basis (except, probably, with some compiler flags to merge globals/statics)
       /// Nevertheless this will increase the speed a little, but will also increase the final executable size (of at least 8bit per monitored function)
       template<typename FuncType>
-      call_info_struct &get_call_info_struct(const func_descriptor &d, size_t *_index = nullptr, bool search_only = false)
+      call_info_struct &get_call_info_struct(const static_func_descriptor &d, size_t *_index = nullptr, bool search_only = false)
       {
         static long index = -1; // This is an invalid index
 
-        if (index != -1)
+        if (index != -1 && index < long(get_global_data()->func_info.size())) // the global data may have changed (stash)
         {
           if (_index)
             *_index = index;
           call_info_struct &ret = get_call_info_struct_at_index(index);
-          if (ret.descr == d)
+          // the hash is enough, unless another function has the same (the key names are then compared)
+          if (d.key_hash ? ret.descr.key_hash == d.key_hash && (!ret.hash_collision || d.key_name == ret.descr.key_name) : ret.descr == d)
             return ret;
         }
 
@@ -185,14 +415,24 @@ namespace neam
     } // namespace internal
 
     /// \brief Write everything to the disk
+    /// \note When conf::use_journal is true, only what has changed since the last sync is appended to file + ".journal",
+    ///       and the journal is periodically compacted into the snapshot (file) by a background thread.
     void sync_data_to_disk(const std::string &file);
 
     /// \brief Return the data as a JSON string.
     std::string get_data_as_json();
 
     /// \brief Load from the disk
+    /// \note If they exist, the journals of file are replayed on top of it
     bool load_data_from_disk(const std::string &file);
 
+    /// \brief Load some files (in parallel) and write their aggregated data in out_file (the global data is not touched)
+    /// Stashes with the same name are merged together (the active one of out_file is the last one).
+    /// Functions are merged by descriptor, callgraphs by path, counters are added and averages are weighted by their sample counts.
+    /// \param[in] thread_count The number of loader threads (0: one per core)
+    /// \return the number of files that have been merged (nothing is written if none has)
+    size_t merge_data_files(const std::vector<std::string> &files, const std::string &out_file, size_t thread_count = 0);
+
     /// \brief Return the number of time the program has been launched
     static inline size_t get_launch_count()
     {
@@ -0,0 +1,282 @@
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef _WIN32
+# include <unistd.h>
+#endif
+
+#include "tools/logger/logger.hpp"
+#include "trace.hpp"
+#include "clock.hpp"
+#include "storage.hpp"
+#include "id_gen.hpp"
+#include "config.hpp"
+
+std::atomic<bool> neam::r::internal::trace::enabled(false);
+thread_local neam::r::internal::trace::ring_buffer *neam::r::internal::trace::thread_buffer = nullptr;
+
+namespace
+{
+  using neam::r::internal::trace::ring_buffer;
+
+  static std::mutex buffers_lock; // protects buffers, next_thread_id and measure_point_names
+  static std::vector<std::unique_ptr<ring_buffer>> buffers;
+  static uint64_t next_thread_id = 1;
+  static std::unordered_map<uint64_t, std::string> measure_point_names; // hash -> name (see intern_name(), never cleared)
+  static thread_local std::unordered_set<uint64_t> tl_interned_names; // the names this thread has already registered
+
+  static std::mutex trace_lock; // protects the trace file and everything the drain thread uses
+  static std::ofstream trace_stream;
+  static std::string trace_file;
+  static uint64_t base_ticks = 0;
+  static bool first_event = true;
+  static std::unordered_map<uint64_t, std::string> function_names; // key_hash -> name
+
+  static std::thread drain_thread;
+  static std::mutex drain_mutex;
+  static std::condition_variable drain_cv;
+  static bool drain_stop = false; // protected by drain_mutex
+  static bool atexit_registered = false; // protected by drain_mutex
+
+  /// \brief Mark the buffer of the thread as orphaned when the thread exits
+  static thread_local struct buffer_owner
+  {
+    ~buffer_owner()
+    {
+      if (buffer)
+      {
+        neam::r::internal::trace::thread_buffer = nullptr;
+        buffer->thread_exited.store(true, std::memory_order_release);
+      }
+    }
+    ring_buffer *buffer = nullptr;
+  } tl_owner;
+
+  static int64_t _get_pid()
+  {
+#ifndef _WIN32
+    return getpid();
+#else
+    return 0;
+#endif
+  }
+
+  static void _write_escaped(std::ostream &os, const char *str)
+  {
+    for (; *str; ++str)
+    {
+      if (*str == '"' || *str == '\\')
+        os << '\\' << *str;
+      else if (uint8_t(*str) < 0x20)
+        os << ' ';
+      else
+        os << *str;
+    }
+  }
+
+  /// \brief Return the name of a function from its hash. trace_lock must be held
+  static const std::string &_get_function_name(uint64_t key_hash)
+  {
+    auto it = function_names.find(key_hash);
+    if (it != function_names.end())
+      return it->second;
+
+    std::string name = "[unknown function]";
+    long index;
+    const neam::r::internal::call_info_struct *cis = neam::r::internal::_get_call_info_struct_search_only(neam::r::static_func_descriptor {{}, {}, {}, 0, {}, key_hash, 0}, index);
+    if (cis)
+      name = cis->descr.pretty_name.size() ? cis->descr.pretty_name : cis->descr.name;
+    return function_names.emplace(key_hash, name).first->second;
+  }
+
+  /// \brief Return the name of a measure point from its hash. trace_lock must be held
+  static std::string _get_measure_point_name(uint64_t hash)
+  {
+    std::lock_guard<std::mutex> _u0(buffers_lock);
+    auto it = measure_point_names.find(hash);
+    if (it != measure_point_names.end())
+      return it->second;
+    return "[unknown measure point]";
+  }
+
+  /// \brief Write the events of every buffer in the trace file. trace_lock must be held
+  static void _drain()
+  {
+    std::vector<ring_buffer *> to_drain;
+    {
+      std::lock_guard<std::mutex> _u0(buffers_lock);
+      for (auto &it : buffers)
+        to_drain.push_back(it.get());
+    }
+
+    const int64_t pid = _get_pid();
+    const double us_per_tick = neam::r::internal::clock::get_calibration().seconds_per_tick * 1e6;
+    for (ring_buffer *buffer : to_drain)
+    {
+      const bool exited = buffer->thread_exited.load(std::memory_order_acquire);
+      const uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+      const uint64_t head = buffer->head.load(std::memory_order_acquire);
+      for (uint64_t i = tail; i < head; ++i)
+      {
+        const neam::r::internal::trace::event &e = buffer->events[i & buffer->mask];
+        if (e.timestamp < base_ticks) // recorded before the trace has (re)started
+          continue;
+        if (trace_stream)
+        {
+          trace_stream << (first_event ? "\n" : ",\n") << "{\"name\":\"";
+          if (e.type == neam::r::internal::trace::event_type::call)
+            _write_escaped(trace_stream, _get_function_name(e.data).c_str());
+          else
+            _write_escaped(trace_stream, _get_measure_point_name(e.data).c_str());
+          trace_stream << "\",\"cat\":\"" << (e.type == neam::r::internal::trace::event_type::call ? "function" : "measure_point")
+                       << "\",\"ph\":\"X\",\"ts\":" << double(e.timestamp - base_ticks) * us_per_tick << ",\"dur\":" << double(e.duration) * us_per_tick
+                       << ",\"pid\":" << pid << ",\"tid\":" << buffer->thread_id << "}";
+          first_event = false;
+        }
+      }
+      buffer->tail.store(head, std::memory_order_release);
+
+      const uint64_t dropped = buffer->dropped.exchange(0, std::memory_order_relaxed);
+      if (dropped)
+        neam::cr::out.warning() << LOGGER_INFO << "trace: " << dropped << " events dropped on thread " << buffer->thread_id << " (see conf::trace_buffer_size)" << std::endl;
+
+      if (exited) // everything it has written has been drained
+      {
+        std::lock_guard<std::mutex> _u0(buffers_lock);
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+        {
+          if (it->get() == buffer)
+          {
+            buffers.erase(it);
+            break;
+          }
+        }
+      }
+    }
+    trace_stream.flush();
+  }
+
+  static void _drain_loop()
+  {
+    std::unique_lock<std::mutex> _u0(drain_mutex);
+    while (!drain_stop)
+    {
+      drain_cv.wait_for(_u0, std::chrono::milliseconds(std::max<size_t>(neam::r::conf::trace_drain_interval, 1)));
+      if (drain_stop)
+        break;
+
+      _u0.unlock();
+      {
+        std::lock_guard<std::mutex> _u1(trace_lock);
+        _drain();
+      }
+      _u0.lock();
+    }
+  }
+} // namespace
+
+neam::r::internal::trace::ring_buffer::ring_buffer(size_t capacity, uint64_t _thread_id)
+  : events(capacity), mask(capacity - 1), thread_id(_thread_id), head(0), tail(0), dropped(0), thread_exited(false)
+{
+}
+
+neam::r::internal::trace::ring_buffer *neam::r::internal::trace::create_thread_buffer()
+{
+  size_t capacity = 1;
+  while (capacity < std::max<size_t>(conf::trace_buffer_size, 2))
+    capacity *= 2;
+
+  std::lock_guard<std::mutex> _u0(buffers_lock);
+  buffers.emplace_back(new ring_buffer(capacity, next_thread_id++));
+  thread_buffer = buffers.back().get();
+  tl_owner.buffer = thread_buffer;
+  return thread_buffer;
+}
+
+uint64_t neam::r::internal::trace::intern_name(const char *name)
+{
+  const uint64_t hash = hash_from_str(name);
+  if (tl_interned_names.count(hash))
+    return hash;
+
+  {
+    std::lock_guard<std::mutex> _u0(buffers_lock);
+    measure_point_names.emplace(hash, name ? name : "");
+  }
+  tl_interned_names.insert(hash);
+  return hash;
+}
+
+bool neam::r::start_trace(const std::string &file)
+{
+  {
+    std::lock_guard<std::mutex> _u0(trace_lock);
+    if (trace_stream.is_open() && trace_file == file)
+      return true; // already tracing there
+  }
+  stop_trace();
+
+  {
+    std::lock_guard<std::mutex> _u0(trace_lock);
+    trace_stream.open(file, std::ios_base::trunc);
+    if (!trace_stream)
+    {
+      neam::cr::out.warning() << LOGGER_INFO << "Failed to create the trace file '" << file << "'" << std::endl;
+      trace_stream.close();
+      return false;
+    }
+    trace_file = file;
+    trace_stream.setf(std::ios_base::fixed, std::ios_base::floatfield);
+    trace_stream.precision(3); // timestamps are in microseconds
+    trace_stream << "[";
+    first_event = true;
+    function_names.clear();
+    base_ticks = internal::clock::get_ticks();
+    internal::trace::enabled = true;
+  }
+
+  {
+    std::lock_guard<std::mutex> _u0(drain_mutex);
+    drain_stop = false;
+    drain_thread = std::thread(_drain_loop);
+    if (!atexit_registered)
+    {
+      std::atexit([]() { neam::r::stop_trace(); });
+      atexit_registered = true;
+    }
+  }
+
+  neam::cr::out.debug() << LOGGER_INFO << "Tracing in '" << file << "'" << std::endl;
+  return true;
+}
+
+void neam::r::stop_trace()
+{
+  internal::trace::enabled = false;
+
+  {
+    std::lock_guard<std::mutex> _u0(drain_mutex);
+    drain_stop = true;
+    drain_cv.notify_one();
+  }
+  if (drain_thread.joinable())
+    drain_thread.join();
+
+  std::lock_guard<std::mutex> _u0(trace_lock);
+  if (!trace_stream.is_open())
+    return;
+  _drain();
+  trace_stream << "\n]\n";
+  trace_stream.close();
+  trace_file.clear();
+}
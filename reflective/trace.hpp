@@ -0,0 +1,133 @@
+//
+// file : trace.hpp
+// in : file:///home/tim/projects/reflective/reflective/trace.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 23:58:12
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_13439886800065605869_2048041312__TRACE_HPP__
+# define __N_13439886800065605869_2048041312__TRACE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+
+namespace neam
+{
+  namespace r
+  {
+    /// \brief Start recording the timeline of the function_calls and of the measure points in file
+    /// Each thread writes its events in its own lock-free ring buffer (see conf::trace_buffer_size), and a background thread
+    /// drains them every conf::trace_drain_interval milliseconds in file, in the Chrome trace event format (JSON array format)
+    /// that chrome://tracing and Perfetto (ui.perfetto.dev) can open.
+    /// \note This is done automatically when conf::trace_file is set when reflective is initialized
+    /// \note A call is recorded (as a complete event) when it ends: a call that has not ended when the trace stops is not in the trace.
+    ///       If a ring buffer is full, the events are dropped (and counted) instead of blocking the thread.
+    /// \note Measure point names are copied (once per name) when they are first traced: they can be dynamic strings
+    bool start_trace(const std::string &file);
+
+    /// \brief Drain the remaining events, terminate and close the trace file
+    void stop_trace();
+
+    namespace internal
+    {
+      namespace trace
+      {
+        enum class event_type : uint32_t
+        {
+          call = 0, ///< \brief data is the key_hash of the function
+          measure_point = 1, ///< \brief data is the hash of the name of the measure point (see intern_name())
+        };
+
+        /// \brief An event, as stored in the ring buffers
+        struct event
+        {
+          uint64_t timestamp; ///< \brief When it started (in clock ticks)
+          uint64_t duration; ///< \brief In clock ticks
+          uint64_t data; ///< \brief Depends on type
+          event_type type;
+          uint32_t _reserved;
+        };
+
+        /// \brief A single-producer (the thread) / single-consumer (the drain thread) ring buffer
+        struct ring_buffer
+        {
+          ring_buffer(size_t capacity, uint64_t _thread_id);
+
+          /// \brief Push an event (dropped if the buffer is full)
+          void push(uint64_t timestamp, uint64_t duration, uint64_t data, event_type type)
+          {
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) > mask)
+            {
+              dropped.fetch_add(1, std::memory_order_relaxed);
+              return;
+            }
+            event &e = events[h & mask];
+            e.timestamp = timestamp;
+            e.duration = duration;
+            e.data = data;
+            e.type = type;
+            head.store(h + 1, std::memory_order_release);
+          }
+
+          std::vector<event> events; // the size is a power of 2
+          const uint64_t mask;
+          const uint64_t thread_id;
+          std::atomic<uint64_t> head; // written by the thread
+          std::atomic<uint64_t> tail; // written by the drain thread
+          std::atomic<uint64_t> dropped;
+          std::atomic<bool> thread_exited; // the buffer is freed by the drain thread once it is empty
+        };
+
+        extern std::atomic<bool> enabled;
+        extern thread_local ring_buffer *thread_buffer;
+
+        /// \brief Whether or not the events are recorded
+        inline bool is_enabled()
+        {
+          return enabled.load(std::memory_order_relaxed);
+        }
+
+        /// \brief Create (and register) the buffer of the current thread
+        ring_buffer *create_thread_buffer();
+
+        /// \brief Return the hash of a measure point name, and register a copy of the name the first time it is seen
+        /// \note The name may be freed right after: the drain thread only uses the copy
+        uint64_t intern_name(const char *name);
+
+        /// \brief Record an event for the current thread
+        inline void record(uint64_t timestamp, uint64_t duration, uint64_t data, event_type type)
+        {
+          ring_buffer *buffer = thread_buffer;
+          if (!buffer)
+            buffer = create_thread_buffer();
+          buffer->push(timestamp, duration, data, type);
+        }
+      } // namespace trace
+    } // namespace internal
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_13439886800065605869_2048041312__TRACE_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
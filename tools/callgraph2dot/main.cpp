@@ -25,6 +25,7 @@ int main(int argc, char **argv)
   std::string output_file;
   bool weight_with_global_time;
   bool weight_with_callcount;
+  float percentile;
 
   // parse cmdline arguments
   boost::program_options::options_description desc("Allowed options");
@@ -45,6 +46,8 @@ int main(int argc, char **argv)
 
     ("min-call-count,c", boost::program_options::value<size_t>(&min_call_count)->default_value(10), "control the minimum call count for a function to be considered significant")
     ("min-global-time,g", boost::program_options::value<float>(&min_gbl_time)->default_value(0.001), "control the minimum global time for a function to be considered significant")
+
+    ("percentile,p", boost::program_options::value<float>(&percentile)->default_value(0.f), "use a percentile of the durations (like 99 or 99.9) instead of their averages for the labels, the weights and the significance (0 to use the averages)")
   ;
 
   boost::program_options::positional_options_description pod;
@@ -86,6 +89,7 @@ int main(int argc, char **argv)
   neam::r::callgraph_to_dot ctd;
 
   ctd.set_weight_properties(weight_with_global_time, weight_with_callcount);
+  ctd.use_percentile(percentile);
 
   if (vm.count("remove-insignificant-branch"))
     ctd.remove_insignificant_branch(true, min_call_count, min_gbl_time);
@@ -0,0 +1,131 @@
+
+#include <algorithm>
+#include <mutex>
+#include "callgraph_snapshot.hpp"
+
+void neam::r::callgraph_snapshot::build()
+{
+  roots.clear();
+  parents.clear();
+  depths.clear();
+  entries.clear();
+
+  internal::merge_thread_data();
+  internal::data *global = internal::get_global_data();
+
+  {
+    std::lock_guard<internal::mutex_type> _u0(global->lock);
+
+    // number the entries in pre-order (the callgraph can be very deep: no recursion)
+    struct frame
+    {
+      internal::stack_entry *entry;
+      size_t parent;
+      size_t depth;
+    };
+    std::vector<frame> to_walk;
+    for (auto &graph_it : global->callgraph)
+    {
+      if (graph_it.empty())
+        continue;
+      to_walk.push_back(frame {&graph_it[0], npos, 0});
+
+      while (!to_walk.empty())
+      {
+        const frame current = to_walk.back();
+        to_walk.pop_back();
+
+        const size_t node = entries.size();
+        if (current.parent == npos)
+          roots.push_back(node);
+        entries.push_back(current.entry);
+        parents.push_back(current.parent);
+        depths.push_back(current.depth);
+
+        const internal::children_list &callees = current.entry->children;
+        for (auto it = callees.rbegin(); it != callees.rend(); ++it)
+        {
+          if (*it < graph_it.size())
+            to_walk.push_back(frame {&graph_it[*it], node, current.depth + 1});
+        }
+      }
+    }
+
+    // the columns
+    const size_t count = entries.size();
+    call_info_indexes.resize(count);
+    hit_counts.resize(count);
+    fail_counts.resize(count);
+    self_times.resize(count);
+    self_time_counts.resize(count);
+    global_times.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      const internal::stack_entry &entry = *entries[i];
+      call_info_indexes[i] = entry.call_structure_index;
+      hit_counts[i] = entry.hit_count;
+      fail_counts[i] = entry.fail_count;
+      self_times[i] = entry.average_self_time;
+      self_time_counts[i] = entry.average_self_time_count;
+      global_times[i] = entry.average_global_time;
+    }
+  }
+
+  const size_t count = entries.size();
+  total_self_times.resize(count);
+  for (size_t i = 0; i < count; ++i)
+    total_self_times[i] = self_times[i] * double(hit_counts[i]);
+
+  // the callees (CSR): a caller is always before its callees, and the callees are numbered in order
+  children_offsets.assign(count + 1, 0);
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (parents[i] != npos)
+      ++children_offsets[parents[i] + 1];
+  }
+  for (size_t i = 0; i < count; ++i)
+    children_offsets[i + 1] += children_offsets[i];
+  children.resize(children_offsets[count]);
+  {
+    std::vector<size_t> fill(children_offsets.begin(), children_offsets.end() - 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (parents[i] != npos)
+        children[fill[parents[i]]++] = i;
+    }
+  }
+
+  // the sub-trees
+  subtree_ends.assign(count, 0);
+  for (size_t i = count; i-- > 0;)
+  {
+    subtree_ends[i] = std::max(subtree_ends[i], i + 1);
+    if (parents[i] != npos)
+      subtree_ends[parents[i]] = std::max(subtree_ends[parents[i]], subtree_ends[i]);
+  }
+}
+
+void neam::r::callgraph_snapshot::get_path(size_t node, std::vector<size_t> &path) const
+{
+  path.resize(depths[node] + 1);
+  for (size_t i = path.size(); i-- > 0; node = parents[node])
+    path[i] = node;
+}
+
+double neam::r::callgraph_snapshot::get_total_self_time(size_t first, size_t last) const
+{
+  last = std::min(last, size());
+  double ret = 0;
+  for (size_t i = first; i < last; ++i)
+    ret += total_self_times[i];
+  return ret;
+}
+
+uint64_t neam::r::callgraph_snapshot::get_total_fail_count(size_t first, size_t last) const
+{
+  last = std::min(last, size());
+  uint64_t ret = 0;
+  for (size_t i = first; i < last; ++i)
+    ret += fail_counts[i];
+  return ret;
+}
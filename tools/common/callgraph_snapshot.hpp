@@ -0,0 +1,159 @@
+//
+// file : callgraph_snapshot.hpp
+// in : file:///home/tim/projects/reflective/tools/common/callgraph_snapshot.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 17:21:09
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_3788360800804254833_519930650__CALLGRAPH_SNAPSHOT_HPP__
+# define __N_3788360800804254833_519930650__CALLGRAPH_SNAPSHOT_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <reflective/introspect.hpp>
+
+namespace neam
+{
+  namespace r
+  {
+    /// \brief A read-only, flattened copy of the callgraph of the active data, made for the analysis tools
+    /// The nodes (the callgraph entries) are numbered in pre-order, roots first: the sub-tree of a node is [node, get_subtree_end(node)[
+    /// and the parent of a node is always before it. The callees are stored as a compressed sparse row array and the counters
+    /// as columns (one vector per counter, indexed by node), so that reductions are simple loops over contiguous arrays.
+    /// \note The snapshot is built with a single lock of the global data, walking it never locks
+    ///       (but get_introspect() is there for everything that isn't in the columns: reasons, measure points, histograms, ...)
+    /// \note The snapshot is not updated: build() it again to see the new data (or after a stash has been loaded)
+    class callgraph_snapshot
+    {
+      public:
+        static constexpr size_t npos = ~size_t(0);
+
+        /// \brief A range of node indexes (the callees of a node)
+        struct node_range
+        {
+          const size_t *first;
+          const size_t *last;
+
+          const size_t *begin() const { return first; }
+          const size_t *end() const { return last; }
+          size_t size() const { return size_t(last - first); }
+          bool empty() const { return first == last; }
+        };
+
+      public:
+        /// \brief Build the snapshot of the active data
+        callgraph_snapshot() { build(); }
+
+        /// \brief (Re)build the snapshot from the active data
+        void build();
+
+        /// \brief Return the number of nodes
+        size_t size() const { return call_info_indexes.size(); }
+
+        /// \brief Return the root nodes
+        const std::vector<size_t> &get_roots() const { return roots; }
+
+        /// \brief Return the callees of a node
+        node_range get_callees(size_t node) const
+        {
+          return node_range {children.data() + children_offsets[node], children.data() + children_offsets[node + 1]};
+        }
+
+        /// \brief Return the caller of a node (npos for the roots)
+        size_t get_parent(size_t node) const { return parents[node]; }
+
+        /// \brief Return the depth of a node (0 for the roots)
+        size_t get_depth(size_t node) const { return depths[node]; }
+
+        /// \brief Return the end of the sub-tree of a node (the sub-tree is [node, get_subtree_end(node)[)
+        size_t get_subtree_end(size_t node) const { return subtree_ends[node]; }
+
+        /// \brief Fill path with the nodes from the root of node to node (included)
+        void get_path(size_t node, std::vector<size_t> &path) const;
+
+        /// \brief Return a contextualized introspect object for a node
+        introspect get_introspect(size_t node) const
+        {
+          return introspect::from_stack_entry(*entries[node]);
+        }
+
+        /// \brief Walk the whole callgraph, in pre-order
+        /// \param f A function/callable that has a similar signature: f(size_t node, const std::vector<size_t> &path)
+        ///          where path holds the nodes from the root to node (included)
+        template<typename Func>
+        void walk(Func &&f) const
+        {
+          std::vector<size_t> path;
+          for (size_t node = 0; node < size(); ++node)
+          {
+            path.resize(depths[node]);
+            path.push_back(node);
+            f(node, path);
+          }
+        }
+
+        // ---- // the columns (indexed by node) // ---- //
+
+        /// \brief The index of the call_info_struct of each node (see get_introspect())
+        const std::vector<uint64_t> &get_call_info_indexes() const { return call_info_indexes; }
+        /// \brief The hit count of each node
+        const std::vector<uint64_t> &get_hit_counts() const { return hit_counts; }
+        /// \brief The fail count of each node
+        const std::vector<uint64_t> &get_fail_counts() const { return fail_counts; }
+        /// \brief The average self time of each node, in seconds
+        const std::vector<double> &get_self_times() const { return self_times; }
+        /// \brief The number of time the self time has been monitored, for each node
+        const std::vector<uint64_t> &get_self_time_counts() const { return self_time_counts; }
+        /// \brief The average global time of each node, in seconds
+        const std::vector<double> &get_global_times() const { return global_times; }
+        /// \brief The self time times the hit count of each node, in seconds (the time spent in the function, at this place of the callgraph)
+        const std::vector<double> &get_total_self_times() const { return total_self_times; }
+
+        /// \brief Return the sum of the total self times of the nodes [first, last[ (use a sub-tree to get its cost)
+        double get_total_self_time(size_t first = 0, size_t last = npos) const;
+
+        /// \brief Return the sum of the fail counts of the nodes [first, last[
+        uint64_t get_total_fail_count(size_t first = 0, size_t last = npos) const;
+
+      private:
+        std::vector<size_t> roots;
+        std::vector<size_t> parents;
+        std::vector<size_t> depths;
+        std::vector<size_t> subtree_ends;
+        std::vector<size_t> children_offsets; // size() + 1 entries
+        std::vector<size_t> children;
+        std::vector<internal::stack_entry *> entries;
+
+        std::vector<uint64_t> call_info_indexes;
+        std::vector<uint64_t> hit_counts;
+        std::vector<uint64_t> fail_counts;
+        std::vector<double> self_times;
+        std::vector<uint64_t> self_time_counts;
+        std::vector<double> global_times;
+        std::vector<double> total_self_times;
+    };
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_3788360800804254833_519930650__CALLGRAPH_SNAPSHOT_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
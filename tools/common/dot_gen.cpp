@@ -3,6 +3,7 @@
 #include <iomanip>
 #include <iostream>
 #include <set>
+#include <sstream>
 #include <string>
 #include <cctype>
 #include <algorithm>
@@ -125,7 +126,7 @@ void neam::r::callgraph_to_dot::walk_get_max(neam::r::introspect &root)
   std::vector<neam::r::introspect> callees = root.get_callee_list();
 
   max_count = std::max(max_count, float(root.get_call_count()));
-  max_self += float(root.get_average_self_duration());
+  max_self += get_self_duration(root);
   max_self_count++;
 
   for (neam::r::introspect &callee : callees)
@@ -150,7 +151,7 @@ void neam::r::callgraph_to_dot::walk_root(std::ostream &os, neam::r::introspect
     float callee_call_count = float(callee.get_call_count());
     if (average_call_count)
       callee_call_count /= float(neam::r::get_launch_count() - 1); // remove the current launch count
-    if ((callee_call_count > min_call_count) || (callee.get_average_duration() > min_gbl_time))
+    if ((callee_call_count > min_call_count) || (get_duration(callee) > min_gbl_time))
       callee_insignificant = false;
 
     walk_root(os, callee, callee_error_factor, callee_insignificant);
@@ -160,20 +161,27 @@ void neam::r::callgraph_to_dot::walk_root(std::ostream &os, neam::r::introspect
       idx = get_idx_for_introspect(root);
       insignificant = false;
       size_t subidx = get_idx_for_introspect(callee);
-      std::pair<double, std::string> self_tm = get_time(callee.get_average_self_duration());
-      std::pair<double, std::string> gbl_tm = get_time(callee.get_average_duration());
+      std::pair<double, std::string> self_tm = get_time(get_self_duration(callee));
+      std::pair<double, std::string> gbl_tm = get_time(get_duration(callee));
+      std::string prefix;
+      if (percentile > 0.f)
+      {
+        std::ostringstream os;
+        os << "p" << percentile << " ";
+        prefix = os.str();
+      }
 
       // output the edge
       float weight = 0.f;
       if (weight_with_callcount)
         weight = std::max(float(callee.get_call_count()) / (max_count) * 3.5f, 0.45f);
       if (weight_with_global_time)
-        weight += std::max(float(callee.get_average_duration()) / (max_self) * 3.5f, 0.45f);
+        weight += std::max(get_duration(callee) / (max_self) * 3.5f, 0.45f);
       weight = std::min(weight, 6.f);
       os << "  N" << idx << " -> N" << subidx << " ["
          << "label=\" " << callee_call_count << "\\n"
-         << " self " << size_t(self_tm.first) << self_tm.second << "s\\n"
-         << " gbl " << size_t(gbl_tm.first) << gbl_tm.second << "s" << "\";"
+         << " " << prefix << "self " << size_t(self_tm.first) << self_tm.second << "s\\n"
+         << " " << prefix << "gbl " << size_t(gbl_tm.first) << gbl_tm.second << "s" << "\";"
 //         << "weight=" << weight * 600.f << ";"
          << "penwidth=" << weight << ";";
 
@@ -268,3 +276,16 @@ size_t neam::r::callgraph_to_dot::get_idx_for_introspect(const neam::r::introspe
   return idxs[itr.get_function_descriptor().key_name];
 }
 
+float neam::r::callgraph_to_dot::get_self_duration(const neam::r::introspect &itr) const
+{
+  if (percentile > 0.f)
+    return itr.get_self_duration_percentile(percentile);
+  return itr.get_average_self_duration();
+}
+
+float neam::r::callgraph_to_dot::get_duration(const neam::r::introspect &itr) const
+{
+  if (percentile > 0.f)
+    return itr.get_duration_percentile(percentile);
+  return itr.get_average_duration();
+}
@@ -93,11 +93,20 @@ namespace neam
           weight_with_callcount = with_callcount;
         }
 
+        /// \brief Use a percentile of the durations (like 99 or 99.9) instead of their averages
+        /// for the labels, the weights and the significance of the calls. 0 means averages (the default)
+        void use_percentile(float _percentile = 0.f)
+        {
+          percentile = _percentile;
+        }
+
       private:
         void walk_root(std::ostream &os, neam::r::introspect &root, float &error_factor, bool &insignificant);
         void walk_get_max(neam::r::introspect &root);
         void output_reason(std::ostream &os, size_t idx, neam::r::reason &r);
         size_t get_idx_for_introspect(const neam::r::introspect &itr, bool *added = nullptr);
+        float get_self_duration(const neam::r::introspect &itr) const;
+        float get_duration(const neam::r::introspect &itr) const;
 
       private:
         std::map<std::string, size_t> idxs;
@@ -116,6 +125,7 @@ namespace neam
         bool remove_insignificant = true;
         size_t min_call_count = 10;
         float min_gbl_time = 0.001; // 1ms
+        float percentile = 0.f; // 0: use the averages
     };
   } // namespace r
 } // namespace neam
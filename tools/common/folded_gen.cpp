@@ -0,0 +1,85 @@
+
+#include <vector>
+#include <string>
+#include "folded_gen.hpp"
+
+bool neam::r::callgraph_to_folded::write_to_stream(std::ostream &os, neam::r::introspect *root)
+{
+  if (root && !root->is_contextual())
+    return false;
+
+  stack_count = 0;
+  if (root)
+    walk_root(os, *root);
+  else
+  {
+    for (const neam::r::introspect &it : neam::r::introspect::get_root_function_list())
+      walk_root(os, it);
+  }
+  os.flush();
+  return true;
+}
+
+void neam::r::callgraph_to_folded::walk_root(std::ostream &os, const neam::r::introspect &root)
+{
+  // the callgraph can be very deep: walk it without recursing
+  struct frame
+  {
+    neam::r::introspect intr;
+    size_t path_size; // the size of the path of the caller
+  };
+  std::vector<frame> to_walk = {frame {root, 0}};
+  std::vector<neam::r::introspect> callees;
+  std::string path;
+
+  while (!to_walk.empty())
+  {
+    const frame current = to_walk.back();
+    to_walk.pop_back();
+
+    path.resize(current.path_size);
+    if (current.path_size)
+      path += ';';
+    path += get_frame_name(current.intr);
+
+    const uint64_t w = get_weight(current.intr);
+    if (w)
+    {
+      os << path << ' ' << w << '\n';
+      ++stack_count;
+    }
+
+    current.intr.get_callee_list(callees); // reuse the buffer
+    for (auto it = callees.rbegin(); it != callees.rend(); ++it)
+      to_walk.push_back(frame {*it, path.size()});
+  }
+}
+
+uint64_t neam::r::callgraph_to_folded::get_weight(const neam::r::introspect &itr) const
+{
+  switch (weight)
+  {
+    case weight_type::self_time:
+      if (!itr.get_average_self_duration_count())
+        return 0;
+      return uint64_t(double(itr.get_average_self_duration()) * double(itr.get_call_count()) * 1e9);
+    case weight_type::call_count:
+      return itr.get_call_count();
+    case weight_type::fail_count:
+      return itr.get_failure_count();
+  }
+  return 0;
+}
+
+std::string neam::r::callgraph_to_folded::get_frame_name(const neam::r::introspect &itr) const
+{
+  std::string name = pretty_names || itr.get_name().empty() ? itr.get_pretty_name() : itr.get_name();
+
+  // ';' separates the frames, a new line the stacks
+  for (char &c : name)
+  {
+    if (c == ';' || c == '\n')
+      c = '_';
+  }
+  return name;
+}
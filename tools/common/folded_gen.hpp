@@ -0,0 +1,92 @@
+//
+// file : folded_gen.hpp
+// in : file:///home/tim/projects/reflective/tools/common/folded_gen.hpp
+//
+// created by : Timothée Feuillet on linux-vnd3.site
+// date: 17/10/2026 16:02:41
+//
+//
+// Copyright (C) 2026 Timothée Feuillet
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __N_7172657563408803243_109875964__FOLDED_GEN_HPP__
+# define __N_7172657563408803243_109875964__FOLDED_GEN_HPP__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <reflective/introspect.hpp>
+
+namespace neam
+{
+  namespace r
+  {
+    /// \brief Export the callgraph as folded stacks ("root;callee;callee weight", one line per callgraph entry),
+    /// the input format of flamegraph.pl, inferno, speedscope, ... (they give flame graphs, and icicle graphs when inverted)
+    /// \note Unlike the dot graph, there's no layout to compute: this is a single walk of the callgraph
+    class callgraph_to_folded
+    {
+      public:
+        /// \brief What the weight of a stack is
+        enum class weight_type
+        {
+          self_time,  ///< \brief The self time times the hit count, in nanoseconds
+          call_count, ///< \brief The hit count
+          fail_count, ///< \brief The failure count
+        };
+
+        /// \brief Write the folded stacks of the callgraph to a stream
+        /// \param[in,out] os The stream where the stacks will be output
+        /// \param[in] root The root introspect object to use. MUST be a contextualized introspect object.
+        ///                 If not specified or nullptr, all roots are used
+        /// \note Stacks with a weight of 0 are not written
+        bool write_to_stream(std::ostream &os, neam::r::introspect *root = nullptr);
+
+        /// \brief Set the weight of the stacks (default is the self time)
+        void set_weight(weight_type _weight)
+        {
+          weight = _weight;
+        }
+
+        /// \brief Use the pretty names of the functions (like "void s::d()") instead of their names (like "s::d")
+        void use_pretty_names(bool do_use_them)
+        {
+          pretty_names = do_use_them;
+        }
+
+        /// \brief Return the number of stacks written by the last write_to_stream()
+        size_t get_stack_count() const
+        {
+          return stack_count;
+        }
+
+      private:
+        void walk_root(std::ostream &os, const neam::r::introspect &root);
+        uint64_t get_weight(const neam::r::introspect &itr) const;
+        std::string get_frame_name(const neam::r::introspect &itr) const;
+
+      private:
+        weight_type weight = weight_type::self_time;
+        bool pretty_names = false;
+        size_t stack_count = 0;
+    };
+  } // namespace r
+} // namespace neam
+
+#endif /*__N_7172657563408803243_109875964__FOLDED_GEN_HPP__*/
+
+// kate: indent-mode cstyle; indent-width 2; replace-tabs on;
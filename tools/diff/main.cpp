@@ -0,0 +1,407 @@
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <reflective/reflective.hpp> // The reflective header
+#include <tools/logger/logger.hpp>   // Just to set the logger in debug mode
+
+// first is the time, second the unit
+std::pair<double, const char *> get_time(double sec_time)
+{
+  double rtime = sec_time;
+
+  const char *tab[] = {"s", "ms", "us", "ns"};
+  size_t idx = 0;
+
+  for (; idx < (sizeof(tab) / sizeof(tab[0]) - 1) && rtime < 1.; ++idx)
+  {
+    rtime *= 1000;
+  }
+
+  return std::make_pair(rtime, tab[idx]);
+}
+
+struct options
+{
+  double threshold = 0.10; ///< \brief The minimum relative increase of a time (or of a failure ratio) for a regression
+  double min_z_score = 3.; ///< \brief The minimum z-score for a change to be significant
+  uint64_t min_samples = 30; ///< \brief The minimum number of samples on both sides for a change to be tested
+};
+
+/// \brief What is compared (a call_info_struct or a stack_entry)
+struct node_stats
+{
+  uint64_t calls;
+  uint64_t fails;
+  double self_time;
+  uint64_t self_time_count;
+  const neam::r::duration_histogram *self_histogram;
+  double global_time;
+  uint64_t global_time_count;
+  const neam::r::duration_histogram *global_histogram;
+};
+
+static node_stats get_stats(const neam::r::internal::call_info_struct &cis)
+{
+  return node_stats {cis.call_count, cis.fail_count, cis.average_self_time, cis.average_self_time_count, &cis.self_time_histogram,
+                     cis.average_global_time, cis.average_global_time_count, &cis.global_time_histogram};
+}
+
+static node_stats get_stats(const neam::r::internal::stack_entry &se)
+{
+  return node_stats {se.hit_count, se.fail_count, se.average_self_time, se.average_self_time_count, &se.self_time_histogram,
+                     se.average_global_time, se.average_global_time_count, &se.global_time_histogram};
+}
+
+/// \brief The comparison of a time
+struct time_delta
+{
+  double base = 0;
+  double current = 0;
+  double relative = 0; ///< \brief (current - base) / base
+  double z_score = 0; ///< \brief 0 if it could not be computed
+  int change = 0; ///< \brief 1 for a significant increase, -1 for a significant decrease
+};
+
+/// \brief Compare two times. When both sides have histograms, the means are the ones of the histograms (the averages may be sliding ones)
+/// and the significance is Welch's test on the histograms. Otherwise only the threshold is used.
+static time_delta compare_time(const options &opt, double base, uint64_t base_count, const neam::r::duration_histogram &base_histogram,
+                               double current, uint64_t current_count, const neam::r::duration_histogram &current_histogram)
+{
+  time_delta ret;
+  const bool use_histograms = base_histogram.count >= opt.min_samples && current_histogram.count >= opt.min_samples;
+  ret.base = use_histograms ? base_histogram.get_mean() : base;
+  ret.current = use_histograms ? current_histogram.get_mean() : current;
+  if ((!use_histograms && (base_count < opt.min_samples || current_count < opt.min_samples)) || ret.base <= 0)
+    return ret;
+
+  ret.relative = (ret.current - ret.base) / ret.base;
+  bool significant = true;
+  if (use_histograms)
+  {
+    const double se = std::sqrt(base_histogram.get_variance() / double(base_histogram.count)
+                                + current_histogram.get_variance() / double(current_histogram.count));
+    ret.z_score = se > 0 ? (ret.current - ret.base) / se : 0;
+    significant = se <= 0 || std::abs(ret.z_score) >= opt.min_z_score;
+  }
+  if (significant && std::abs(ret.relative) >= opt.threshold)
+    ret.change = ret.relative > 0 ? 1 : -1;
+  return ret;
+}
+
+/// \brief The comparison of a failure ratio (two-proportion z-test)
+static time_delta compare_failures(const options &opt, const node_stats &base, const node_stats &current)
+{
+  time_delta ret;
+  if (base.calls < opt.min_samples || current.calls < opt.min_samples)
+    return ret;
+
+  ret.base = double(base.fails) / double(base.calls);
+  ret.current = double(current.fails) / double(current.calls);
+  const double p = double(base.fails + current.fails) / double(base.calls + current.calls);
+  const double se = std::sqrt(p * (1 - p) * (1. / double(base.calls) + 1. / double(current.calls)));
+  if (se <= 0)
+    return ret;
+
+  ret.z_score = (ret.current - ret.base) / se;
+  ret.relative = ret.base > 0 ? (ret.current - ret.base) / ret.base : (ret.current > 0 ? 1. : 0.);
+  if (std::abs(ret.z_score) >= opt.min_z_score && std::abs(ret.relative) >= opt.threshold)
+    ret.change = ret.relative > 0 ? 1 : -1;
+  return ret;
+}
+
+/// \brief The comparison of two nodes
+struct node_delta
+{
+  std::string name;
+  uint64_t base_calls;
+  uint64_t current_calls;
+  time_delta self_time;
+  time_delta global_time;
+  time_delta failures;
+
+  bool is_regression() const { return self_time.change > 0 || global_time.change > 0 || failures.change > 0; }
+  bool is_improvement() const { return !is_regression() && (self_time.change < 0 || global_time.change < 0 || failures.change < 0); }
+  double get_severity() const { return std::max(std::max(self_time.z_score, global_time.z_score), failures.z_score); }
+};
+
+static node_delta compare(const options &opt, const std::string &name, const node_stats &base, const node_stats &current)
+{
+  node_delta ret;
+  ret.name = name;
+  ret.base_calls = base.calls;
+  ret.current_calls = current.calls;
+  ret.self_time = compare_time(opt, base.self_time, base.self_time_count, *base.self_histogram,
+                               current.self_time, current.self_time_count, *current.self_histogram);
+  ret.global_time = compare_time(opt, base.global_time, base.global_time_count, *base.global_histogram,
+                                 current.global_time, current.global_time_count, *current.global_histogram);
+  ret.failures = compare_failures(opt, base, current);
+  return ret;
+}
+
+static std::string get_name(const neam::r::internal::data &d, uint64_t index)
+{
+  if (index >= d.func_info.size())
+    return "[?]";
+  const neam::r::func_descriptor &descr = d.func_info[index].descr;
+  return descr.pretty_name.size() ? descr.pretty_name : descr.name;
+}
+
+/// \brief Find, in base, the function of current at index (by descriptor)
+static long find_function(const neam::r::internal::data &base, const neam::r::internal::data &current, uint64_t index)
+{
+  const neam::r::func_descriptor &descr = current.func_info[index].descr;
+  if (descr.key_hash)
+  {
+    auto it = base.func_index.find(descr.key_hash);
+    if (it != base.func_index.end() && base.func_info[it->second].descr == descr) // the key names are compared, in case of a collision
+      return long(it->second);
+  }
+  for (size_t i = 0; i < base.func_info.size(); ++i)
+  {
+    if (base.func_info[i].descr == descr)
+      return long(i);
+  }
+  return -1;
+}
+
+/// \brief What could not be compared (the names of the nodes that are only on one side)
+struct unmatched_nodes
+{
+  std::vector<std::string> base;
+  std::vector<std::string> current;
+};
+
+/// \brief Compare the callgraphs, by path
+/// \param[out] unmatched_roots The callgraph roots that are only in base or only in current
+static void compare_callgraphs(const options &opt, const neam::r::internal::data &base, const neam::r::internal::data &current,
+                               const std::vector<long> &func_map, std::vector<node_delta> &deltas, unmatched_nodes &unmatched_roots)
+{
+  std::vector<bool> base_matched(base.callgraph.size(), false);
+  for (const neam::r::internal::stack_entry_list &graph : current.callgraph)
+  {
+    if (graph.empty())
+      continue;
+    const neam::r::internal::stack_entry_list *base_graph = nullptr;
+    if (graph[0].call_structure_index < func_map.size() && func_map[graph[0].call_structure_index] >= 0)
+    {
+      const uint64_t root_func = uint64_t(func_map[graph[0].call_structure_index]);
+      for (size_t i = 0; i < base.callgraph.size(); ++i)
+      {
+        if (base.callgraph[i].size() && base.callgraph[i][0].call_structure_index == root_func)
+        {
+          base_graph = &base.callgraph[i];
+          base_matched[i] = true;
+        }
+      }
+    }
+    if (!base_graph)
+    {
+      unmatched_roots.current.push_back(get_name(current, graph[0].call_structure_index));
+      continue;
+    }
+
+    struct pending { uint64_t index; uint64_t base_index; std::string path; };
+    std::vector<pending> to_compare = {{0, 0, get_name(current, graph[0].call_structure_index)}};
+    while (!to_compare.empty())
+    {
+      const pending it = to_compare.back();
+      to_compare.pop_back();
+
+      deltas.push_back(compare(opt, it.path, get_stats((*base_graph)[it.base_index]), get_stats(graph[it.index])));
+
+      for (uint64_t child : graph[it.index].children)
+      {
+        if (child >= graph.size() || graph[child].call_structure_index >= func_map.size() || func_map[graph[child].call_structure_index] < 0)
+          continue;
+        const uint64_t func = uint64_t(func_map[graph[child].call_structure_index]);
+        for (uint64_t base_child : (*base_graph)[it.base_index].children)
+        {
+          if (base_child < base_graph->size() && (*base_graph)[base_child].call_structure_index == func)
+          {
+            to_compare.push_back({child, base_child, it.path + " > " + get_name(current, graph[child].call_structure_index)});
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < base.callgraph.size(); ++i)
+  {
+    if (!base_matched[i] && base.callgraph[i].size())
+      unmatched_roots.base.push_back(get_name(base, base.callgraph[i][0].call_structure_index));
+  }
+}
+
+static std::string format_time(const time_delta &delta)
+{
+  auto base = get_time(delta.base);
+  auto current = get_time(delta.current);
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "%+.1f%% (%.3g%s -> %.3g%s, z %.1f)", delta.relative * 100., base.first, base.second, current.first, current.second, delta.z_score);
+  return buffer;
+}
+
+static std::string format_failures(const time_delta &delta)
+{
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "%.3g%% -> %.3g%% (z %.1f)", delta.base * 100., delta.current * 100., delta.z_score);
+  return buffer;
+}
+
+static void print_delta(const node_delta &delta)
+{
+  neam::cr::out.log() << "  " << delta.name << neam::cr::newline
+                      << "    calls: " << delta.base_calls << " -> " << delta.current_calls << neam::cr::newline
+                      << "    self: " << format_time(delta.self_time) << (delta.self_time.change > 0 ? " [REGRESSION]" : "") << neam::cr::newline
+                      << "    global: " << format_time(delta.global_time) << (delta.global_time.change > 0 ? " [REGRESSION]" : "") << neam::cr::newline
+                      << "    fails: " << format_failures(delta.failures) << (delta.failures.change > 0 ? " [REGRESSION]" : "") << std::endl;
+}
+
+static size_t print_deltas(const char *title, std::vector<node_delta> &deltas)
+{
+  std::sort(deltas.begin(), deltas.end(), [](const node_delta &a, const node_delta &b) { return a.get_severity() > b.get_severity(); });
+
+  size_t regressions = 0;
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  neam::cr::out.log() << "REGRESSIONS (" << title << "): " << std::endl;
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  for (const node_delta &it : deltas)
+  {
+    if (it.is_regression())
+    {
+      print_delta(it);
+      ++regressions;
+    }
+  }
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  neam::cr::out.log() << "IMPROVEMENTS (" << title << "): " << std::endl;
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  for (auto it = deltas.rbegin(); it != deltas.rend(); ++it)
+  {
+    if (it->is_improvement())
+      print_delta(*it);
+  }
+  return regressions;
+}
+
+/// \brief Print what could not be compared, and return the number of nodes
+static size_t print_unmatched(const char *title, const unmatched_nodes &unmatched)
+{
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  neam::cr::out.log() << "NOT COMPARED (" << title << "): " << unmatched.base.size() << " only in base, " << unmatched.current.size() << " only in current" << std::endl;
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  for (const std::string &it : unmatched.base)
+    neam::cr::out.log() << "  [only in base] " << it << std::endl;
+  for (const std::string &it : unmatched.current)
+    neam::cr::out.log() << "  [only in current] " << it << std::endl;
+  return unmatched.base.size() + unmatched.current.size();
+}
+
+/// \brief Load file[@stash] and return a copy of the data
+static std::unique_ptr<neam::r::internal::data> load(const std::string &source)
+{
+  const size_t at = source.rfind('@');
+  const std::string file = at != std::string::npos ? source.substr(0, at) : source;
+  const std::string stash = at != std::string::npos ? source.substr(at + 1) : std::string();
+
+  if (!neam::r::load_data_from_disk(file))
+    return nullptr;
+  if (!stash.empty() && !neam::r::load_data_from_stash(stash == "[unnamed]" ? std::string() : stash))
+  {
+    neam::cr::out.error() << LOGGER_INFO << "Error: No stash named '" << stash << "' in '" << file << "'" << std::endl;
+    return nullptr;
+  }
+  return std::unique_ptr<neam::r::internal::data>(new neam::r::internal::data(*neam::r::internal::get_global_data()));
+}
+
+int main(int argc, char **argv)
+{
+  // Set the reflective configuration
+  neam::r::conf::disable_auto_save = true;
+  neam::r::conf::out_file = "";
+
+  options opt;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] && !argv[arg][2]; arg += 2)
+  {
+    switch (argv[arg][1])
+    {
+      case 't': opt.threshold = std::strtod(argv[arg + 1], nullptr) / 100.; break;
+      case 'z': opt.min_z_score = std::strtod(argv[arg + 1], nullptr); break;
+      case 'n': opt.min_samples = std::strtoull(argv[arg + 1], nullptr, 10); break;
+      default: argc = 0; break; // print the usage
+    }
+  }
+
+  if (argc - arg != 2)
+  {
+    neam::cr::out.log() << LOGGER_INFO << "Usage: " << argv[0] << " [-t threshold-percent] [-z min-z-score] [-n min-samples] [base] [current]" << neam::cr::newline
+                        << "  base and current are reflective files, optionally followed by @stash-name (the active stash is used otherwise)." << neam::cr::newline
+                        << "  Functions (by descriptor) and callgraph nodes (by path) are compared. A time or a failure ratio is a regression when it" << neam::cr::newline
+                        << "  has increased by more than threshold-percent (default: 10) and the change is significant: its z-score (Welch's test on the" << neam::cr::newline
+                        << "  duration histograms, two-proportion test for failures) is at least min-z-score (default: 3). Nothing is tested with less than" << neam::cr::newline
+                        << "  min-samples (default: 30) samples on a side. Without histograms, only the threshold is used." << neam::cr::newline
+                        << "  The functions and the callgraph roots that are only on one side (like a function that has moved to another line) are listed" << neam::cr::newline
+                        << "  and counted, as they could not be compared." << neam::cr::newline
+                        << "  The exit status is 3 if there is at least one regression." << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<neam::r::internal::data> base = load(argv[arg]);
+  if (!base)
+  {
+    neam::cr::out.error() << LOGGER_INFO << "Error: Unable to load '" << argv[arg] << "'." << std::endl;
+    return 2;
+  }
+  std::unique_ptr<neam::r::internal::data> current = load(argv[arg + 1]);
+  if (!current)
+  {
+    neam::cr::out.error() << LOGGER_INFO << "Error: Unable to load '" << argv[arg + 1] << "'." << std::endl;
+    return 2;
+  }
+
+  neam::cr::out.no_header = true;
+
+  // functions
+  std::vector<long> func_map(current->func_info.size());
+  std::vector<node_delta> function_deltas;
+  unmatched_nodes unmatched_functions;
+  std::vector<bool> base_matched(base->func_info.size(), false);
+  for (size_t i = 0; i < current->func_info.size(); ++i)
+  {
+    func_map[i] = find_function(*base, *current, i);
+    if (func_map[i] >= 0)
+    {
+      base_matched[func_map[i]] = true;
+      function_deltas.push_back(compare(opt, get_name(*current, i), get_stats(base->func_info[func_map[i]]), get_stats(current->func_info[i])));
+    }
+    else
+      unmatched_functions.current.push_back(get_name(*current, i));
+  }
+  for (size_t i = 0; i < base->func_info.size(); ++i)
+  {
+    if (!base_matched[i])
+      unmatched_functions.base.push_back(get_name(*base, i));
+  }
+
+  // callgraph
+  std::vector<node_delta> callgraph_deltas;
+  unmatched_nodes unmatched_roots;
+  compare_callgraphs(opt, *base, *current, func_map, callgraph_deltas, unmatched_roots);
+
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  neam::cr::out.log() << "diff of " << argv[arg] << " -> " << argv[arg + 1] << std::endl;
+  const size_t regressions = print_deltas("functions", function_deltas) + print_deltas("callgraph", callgraph_deltas);
+  const size_t unmatched_function_count = print_unmatched("functions", unmatched_functions);
+  const size_t unmatched_root_count = print_unmatched("callgraph roots", unmatched_roots);
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  neam::cr::out.log() << regressions << " regression(s), " << unmatched_function_count << " function(s) and " << unmatched_root_count << " callgraph root(s) not compared" << std::endl;
+
+  return regressions ? 3 : 0;
+}
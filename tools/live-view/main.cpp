@@ -0,0 +1,135 @@
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <reflective/reflective.hpp>     // The reflective header
+#include <reflective/binary_format.hpp>  // The images are walked in place
+#include <tools/logger/logger.hpp>       // Just to set the logger in debug mode
+
+// first is the time, second the unit
+std::pair<double, const char *> get_time(double sec_time)
+{
+  double rtime = sec_time;
+
+  const char *tab[] = {"s", "ms", "us", "ns"};
+  size_t idx = 0;
+
+  for (; idx < (sizeof(tab) / sizeof(tab[0]) - 1) && rtime < 1.; ++idx)
+  {
+    rtime *= 1000;
+  }
+
+  return std::make_pair(rtime, tab[idx]);
+}
+
+struct function_entry
+{
+  std::string name;
+  uint64_t call_count;
+  uint64_t fail_count;
+  double average_self_time;
+  double average_global_time;
+  double call_rate; ///< \brief calls per second since the previous sample (0 for the first one)
+};
+
+/// \brief Read the functions of the active data of an image (nothing is decoded: the image is walked in place)
+static bool get_functions(const std::string &image, std::vector<function_entry> &functions)
+{
+  neam::r::binary::view view(image.data(), image.size());
+  if (!view.is_valid() || !view.get_header().data_count)
+    return false;
+  const neam::r::binary::data_record *data = view.get_data(view.get_header().data_count - 1);
+  if (!data)
+    return false;
+
+  functions.clear();
+  for (size_t i = 0; i < data->func_info_count; ++i)
+  {
+    const neam::r::binary::call_info_record *cir = view.get_call_info(*data, i);
+    if (!cir)
+      return false;
+    const char *name = view.get_string(cir->pretty_name);
+    if (!name || !*name)
+      name = view.get_string(cir->name);
+    functions.push_back(function_entry {name ? name : "", cir->call_count, cir->fail_count, cir->average_self_time, cir->average_global_time, 0.});
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  // Set the reflective configuration
+  neam::r::conf::disable_auto_save = true;
+  neam::r::conf::out_file = "";
+
+  if (argc < 2 || argc > 4)
+  {
+    neam::cr::out.log() << LOGGER_INFO << "Usage: " << argv[0] << " [live-profile] [interval-ms] [count]" << neam::cr::newline
+                        << "  it will then print, every interval-ms milliseconds (default: 1000), the most called functions of the live profile" << neam::cr::newline
+                        << "  (see neam::r::conf::live_profile). count is the number of samples (default: 0, no limit)" << std::endl;
+    return 1;
+  }
+
+  const std::string name = argv[1];
+  const size_t interval = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+  const size_t count = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0;
+  const size_t max_lines = 20;
+
+  neam::cr::out.no_header = true;
+
+  std::unordered_map<std::string, uint64_t> previous_counts;
+  uint64_t previous_publish_count = 0;
+  std::chrono::steady_clock::time_point previous_time;
+
+  std::string image;
+  std::vector<function_entry> functions;
+  for (size_t sample = 0; !count || sample < count; ++sample)
+  {
+    if (sample)
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+
+    neam::r::live::live_header header;
+    if (!neam::r::internal::read_live_profile(name, image, &header) || !get_functions(image, functions))
+    {
+      neam::cr::out.error() << LOGGER_INFO << "Error: Unable to read the live profile '" << name << "'" << std::endl;
+      return 2;
+    }
+    if (header.publish_count == previous_publish_count)
+      continue; // nothing new
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - previous_time).count();
+    for (function_entry &it : functions)
+    {
+      auto prev = previous_counts.find(it.name);
+      if (prev != previous_counts.end() && elapsed > 0)
+        it.call_rate = double(it.call_count - prev->second) / elapsed;
+      previous_counts[it.name] = it.call_count;
+    }
+    previous_publish_count = header.publish_count;
+    previous_time = now;
+
+    std::sort(functions.begin(), functions.end(), [](const function_entry &a, const function_entry &b)
+    {
+      return a.call_rate > b.call_rate || (a.call_rate == b.call_rate && a.call_count > b.call_count);
+    });
+
+    neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+    neam::cr::out.log() << "live profile '" << name << "' [pid: " << header.pid << ", publication " << header.publish_count << "]" << std::endl;
+    neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+    for (size_t i = 0; i < functions.size() && i < max_lines; ++i)
+    {
+      const function_entry &it = functions[i];
+      auto self_time = get_time(it.average_self_time);
+      auto global_time = get_time(it.average_global_time);
+      neam::cr::out.log() << it.call_rate << " calls/s, " << it.call_count << " calls, " << it.fail_count << " fails, self "
+                          << self_time.first << self_time.second << ", global " << global_time.first << global_time.second << ": " << it.name << std::endl;
+    }
+  }
+
+  return 0;
+}
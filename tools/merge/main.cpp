@@ -0,0 +1,43 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <reflective/reflective.hpp> // The reflective header
+#include <tools/logger/logger.hpp>   // Just to set the logger in debug mode
+
+int main(int argc, char **argv)
+{
+  // Set the reflective configuration
+  neam::r::conf::disable_auto_save = true;
+  neam::r::conf::out_file = "";
+
+  int arg = 1;
+  size_t thread_count = 0;
+  if (argc > 2 && !strcmp(argv[1], "-j"))
+  {
+    thread_count = std::strtoul(argv[2], nullptr, 10);
+    arg = 3;
+  }
+
+  if (argc - arg < 2)
+  {
+    neam::cr::out.log() << LOGGER_INFO << "Usage: " << argv[0] << " [-j thread-count] [output-file] [reflective-file]..." << neam::cr::newline
+                        << "  it will then load the reflective files (in parallel) and write their aggregated data in output-file:" << neam::cr::newline
+                        << "  stashes with the same name are merged, functions are merged by descriptor and callgraphs by path" << std::endl;
+    return 1;
+  }
+
+  const std::string out_file = argv[arg];
+  const std::vector<std::string> files(argv + arg + 1, argv + argc);
+
+  const size_t merged = neam::r::merge_data_files(files, out_file, thread_count);
+  if (!merged)
+  {
+    neam::cr::out.error() << LOGGER_INFO << "Error: Unable to merge the files. No output produced." << std::endl;
+    return 2;
+  }
+
+  neam::cr::out.log() << LOGGER_INFO << "Merged " << merged << " of " << files.size() << " files in '" << out_file << "'" << std::endl;
+  return merged == files.size() ? 0 : 3;
+}
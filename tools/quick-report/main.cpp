@@ -1,11 +1,12 @@
 
 #include <fstream>
+#include <sstream>
 #include <map>
 
 #include <reflective/reflective.hpp> // The reflective header
 #include <tools/logger/logger.hpp>   // Just to set the logger in debug mode
 
-#include "graph_walker.hpp"
+#include "callgraph_snapshot.hpp"
 
 // first is the time, second the unit
 std::pair<double, const char *> get_time(double sec_time)
@@ -23,6 +24,21 @@ std::pair<double, const char *> get_time(double sec_time)
   return std::make_pair(rtime, tab[idx]);
 }
 
+// "p50 x / p90 x / p99 x / p99.9 x / max x"
+std::string get_percentiles(const neam::r::duration_histogram &histogram)
+{
+  std::ostringstream os;
+  const double percentiles[] = {50, 90, 99, 99.9};
+  for (double p : percentiles)
+  {
+    auto tm = get_time(histogram.get_percentile(p));
+    os << "p" << p << " " << tm.first << tm.second << " / ";
+  }
+  auto tm = get_time(histogram.max);
+  os << "max " << tm.first << tm.second;
+  return os.str();
+}
+
 void print_function(const neam::r::introspect &intr, size_t spc_count = 0)
 {
   std::string spcs;
@@ -32,45 +48,24 @@ void print_function(const neam::r::introspect &intr, size_t spc_count = 0)
   neam::cr::out.log() << spcs << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]:" << std::endl;
 }
 
-void print_callstack(const std::deque<neam::r::introspect> &stack, size_t spc_count = 2)
+void print_callstack(const neam::r::callgraph_snapshot &snapshot, const std::vector<size_t> &path, size_t spc_count = 2)
 {
   std::string spcs;
   for (size_t i = 0; i < spc_count; ++i)
     spcs += ' ';
 
   neam::cr::out.log() << spcs << "callstack (most recent call last) :" << std::endl;
-  for (const neam::r::introspect &it : stack)
+  for (size_t node : path)
   {
-    const auto &fd = it.get_function_descriptor();
+    const auto &fd = snapshot.get_introspect(node).get_function_descriptor();
     neam::cr::out.log() << spcs << "  " << fd.pretty_name << "  [" << fd.file << ": " << fd.line << "]" << std::endl;
   }
 }
 
-struct report_entry
-{
-  neam::r::reason report_reason;
-  std::deque<neam::r::introspect> stack;
-
-  bool operator < (const report_entry &other) const
-  {
-    return report_reason.initial_timestamp < other.report_reason.initial_timestamp
-           || stack < other.stack
-           || report_reason.line < other.report_reason.line
-           || report_reason.file < other.report_reason.file
-           || report_reason.type < other.report_reason.type
-           || report_reason.message < other.report_reason.message;
-  }
-
-  bool operator == (const report_entry &other) const
-  {
-    return other.report_reason == report_reason && stack == other.stack;
-  }
-};
-
 struct introspect_entry
 {
   neam::r::introspect intr;
-  std::deque<neam::r::introspect> stack;
+  size_t node; // npos for the global (not contextualized) entries
 };
 
 int main(int argc, char **argv)
@@ -81,24 +76,31 @@ int main(int argc, char **argv)
 
   if (argc != 2)
   {
-    neam::cr::out.log() << LOGGER_INFO << "Usage: " << argv[0] << " [reflective-file]" << neam::cr::newline
-                        << "  it will then create (if the file is valid) a [reflective-file].report that will contain the report" << std::endl;
+    neam::cr::out.log() << LOGGER_INFO << "Usage: " << argv[0] << " [reflective-file | live:live-profile]" << neam::cr::newline
+                        << "  it will then create (if the file is valid) a [reflective-file].report that will contain the report" << neam::cr::newline
+                        << "  (with live:name, the live profile 'name' of a running process is read and the report is name.report)" << std::endl;
     return 1;
   }
 
-  // load the file
-  if (!neam::r::load_data_from_disk(argv[1]))
+  // load the file (or the live profile)
+  const std::string source = argv[1];
+  const bool is_live = source.compare(0, 5, "live:") == 0;
+  if (is_live ? !neam::r::load_data_from_live_profile(source.substr(5)) : !neam::r::load_data_from_disk(source))
   {
-    neam::cr::out.error() << LOGGER_INFO << "Error: Unable to load the file '" << argv[1] << "'. No output produced." << std::endl;
+    neam::cr::out.error() << LOGGER_INFO << "Error: Unable to load '" << argv[1] << "'. No output produced." << std::endl;
     return 2;
   }
 
-  std::string out_file = std::string(argv[1]) + ".report";
+  std::string out_file = (is_live ? source.substr(5) : source) + ".report";
   neam::cr::out.add_stream(*(new std::ofstream(out_file, std::ios_base::trunc)), true);
   neam::cr::out.no_header = true;
 
   const size_t stash_index = neam::r::get_active_stash_index();
 
+  // every section walks the same snapshot (built once)
+  const neam::r::callgraph_snapshot snapshot;
+  std::vector<size_t> path;
+
   neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
   neam::cr::out.log() << "report for " << argv[1] << " [stash: '" << neam::r::get_stashes_name()[stash_index] << "']" << std::endl;
 
@@ -106,10 +108,11 @@ int main(int argc, char **argv)
   neam::cr::out.log() << "ERRORS (local): " << std::endl;
   neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
-  neam::rtools::graph_walker::walk([](const neam::r::introspect &current, const std::deque<neam::r::introspect> &stack)
+  snapshot.walk([&](size_t node, const std::vector<size_t> &stack)
   {
-    if (current.get_failure_count() > 0)
+    if (snapshot.get_fail_counts()[node] > 0)
     {
+      const neam::r::introspect current = snapshot.get_introspect(node);
       print_function(current);
       neam::cr::out.log() << "  list of errors:" << std::endl;
       for (const auto &r : current.get_failure_reasons(10))
@@ -121,7 +124,7 @@ int main(int argc, char **argv)
                             << "    |  from: " << std::put_time(std::localtime((const time_t *)&r.initial_timestamp), "%F %T") << neam::cr::newline
                             << "    |__to:   " << std::put_time(std::localtime((const time_t *)&r.last_timestamp), "%F %T") << std::endl;
       }
-      print_callstack(stack);
+      print_callstack(snapshot, stack);
       neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
     }
   });
@@ -131,19 +134,20 @@ int main(int argc, char **argv)
   neam::cr::out.log() << "MEASURE POINTS (local): " << std::endl;
   neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
-  neam::rtools::graph_walker::walk([](const neam::r::introspect &current, const std::deque<neam::r::introspect> &stack)
+  snapshot.walk([&](size_t node, const std::vector<size_t> &stack)
   {
-    auto mpm = current.get_measure_point_map();
-    if (mpm.size() > 0)
+    const neam::r::introspect current = snapshot.get_introspect(node);
+    auto mpm = current.get_measure_point_map_view();
+    if (mpm->size() > 0)
     {
       print_function(current);
       neam::cr::out.log() << "  list of measure points:" << std::endl;
-      for (const auto &m : mpm)
+      for (const auto &m : *mpm)
       {
         auto tm = get_time(m.second.value);
         neam::cr::out.log() << "   - " << m.first << ": " << tm.first << tm.second << " [hit " << m.second.hit_count << " time]" << std::endl;
       }
-      print_callstack(stack);
+      print_callstack(snapshot, stack);
 
       neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
     }
@@ -163,18 +167,39 @@ int main(int argc, char **argv)
     std::multimap<double, introspect_entry> intr_by_ttl_self_time_per_call;
     std::multimap<size_t, introspect_entry> intr_by_ttl_call_count;
 
-    // generate the global map
-    neam::rtools::graph_walker::walk([&](const neam::r::introspect &current, const std::deque<neam::r::introspect> &stack)
+    std::multimap<double, introspect_entry> intr_by_lcl_p99;
+    std::multimap<double, introspect_entry> intr_by_ttl_p99;
+
+    // generate the global map (the columns of the snapshot are enough for everything but the histograms)
+    const std::vector<uint64_t> &call_info_indexes = snapshot.get_call_info_indexes();
+    const std::vector<uint64_t> &hit_counts = snapshot.get_hit_counts();
+    const std::vector<double> &self_times = snapshot.get_self_times();
+    const std::vector<double> &total_self_times = snapshot.get_total_self_times();
+    std::vector<bool> has_global_entry;
+    for (size_t node = 0; node < snapshot.size(); ++node)
     {
-      intr_by_lcl_self_time.insert({current.get_average_self_duration() * double(current.get_call_count()), {current, stack}});
-      intr_by_lcl_call_count.insert({current.get_call_count(), {current, stack}});
-      intr_by_lcl_self_time_per_call.insert({current.get_average_self_duration(), {current, stack}});
+      const neam::r::introspect current = snapshot.get_introspect(node);
+      if (current.get_duration_histogram().count)
+        intr_by_lcl_p99.insert({current.get_duration_percentile(99), {current, node}});
+
+      intr_by_lcl_self_time.insert({total_self_times[node], {current, node}});
+      intr_by_lcl_call_count.insert({hit_counts[node], {current, node}});
+      intr_by_lcl_self_time_per_call.insert({self_times[node], {current, node}});
+
+      // the global entries are the same for every node of a function
+      if (call_info_indexes[node] >= has_global_entry.size())
+        has_global_entry.resize(call_info_indexes[node] + 1, false);
+      if (has_global_entry[call_info_indexes[node]])
+        continue;
+      has_global_entry[call_info_indexes[node]] = true;
 
       neam::r::introspect gbl = current.copy_without_context();
-      intr_by_ttl_self_time.insert({gbl.get_average_self_duration() * double(gbl.get_call_count()), {gbl, {}}});
-      intr_by_ttl_self_time_per_call.insert({gbl.get_average_self_duration(), {gbl, {}}});
-      intr_by_ttl_call_count.insert({gbl.get_call_count(), {gbl, {}}});
-    });
+      intr_by_ttl_self_time.insert({gbl.get_average_self_duration() * double(gbl.get_call_count()), {gbl, neam::r::callgraph_snapshot::npos}});
+      intr_by_ttl_self_time_per_call.insert({gbl.get_average_self_duration(), {gbl, neam::r::callgraph_snapshot::npos}});
+      intr_by_ttl_call_count.insert({gbl.get_call_count(), {gbl, neam::r::callgraph_snapshot::npos}});
+      if (gbl.get_duration_histogram().count)
+        intr_by_ttl_p99.insert({gbl.get_duration_percentile(99), {gbl, neam::r::callgraph_snapshot::npos}});
+    }
 
     neam::cr::out.log() << std::endl;
     neam::cr::out.log() << "TOP " << func_count << " functions (total time spent -- localized): " << std::endl;
@@ -191,7 +216,8 @@ int main(int argc, char **argv)
       auto avgtm = get_time(it->second.intr.get_average_self_duration());
       neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << tm.first << tm.second << " "
                           "[avg " << avgtm.first << avgtm.second << " / call, " << it->second.intr.get_call_count() << " calls]" << std::endl;
-      print_callstack(it->second.stack, 4);
+      snapshot.get_path(it->second.node, path);
+      print_callstack(snapshot, path, 4);
     }
 
     neam::cr::out.log() << std::endl;
@@ -199,14 +225,10 @@ int main(int argc, char **argv)
     neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
     i = 0;
-    neam::r::introspect *last = nullptr;
     for (auto it = intr_by_ttl_self_time.rbegin(); it != intr_by_ttl_self_time.rend(); ++it, ++i)
     {
       if (i >= func_count)
         break;
-      if (last && *last == it->second.intr)
-        continue;
-      last = &it->second.intr;
 
       const auto &fd = it->second.intr.get_function_descriptor();
       auto tm = get_time(it->first);
@@ -228,7 +250,8 @@ int main(int argc, char **argv)
       auto avgtm = get_time(it->second.intr.get_average_self_duration());
       neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << tm.first << tm.second << " "
                           "[avg " << avgtm.first << avgtm.second << " / call, " << it->second.intr.get_call_count() << " calls]" << std::endl;
-      print_callstack(it->second.stack, 4);
+      snapshot.get_path(it->second.node, path);
+      print_callstack(snapshot, path, 4);
     }
 
     neam::cr::out.log() << std::endl;
@@ -236,20 +259,50 @@ int main(int argc, char **argv)
     neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
     i = 0;
-    last = nullptr;
     for (auto it = intr_by_ttl_self_time_per_call.rbegin(); it != intr_by_ttl_self_time_per_call.rend(); ++it, ++i)
     {
       if (i >= func_count)
         break;
-      if (last && *last == it->second.intr)
-        continue;
-      last = &it->second.intr;
 
       const auto &fd = it->second.intr.get_function_descriptor();
       auto tm = get_time(it->first);
       neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << tm.first << tm.second << std::endl;
     }
 
+    neam::cr::out.log() << std::endl;
+    neam::cr::out.log() << "TOP " << func_count << " functions (p99 of the time spent per call, with its children -- localized): " << std::endl;
+    neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+
+    i = 0;
+    for (auto it = intr_by_lcl_p99.rbegin(); it != intr_by_lcl_p99.rend(); ++it, ++i)
+    {
+      if (i >= func_count)
+        break;
+
+      const auto &fd = it->second.intr.get_function_descriptor();
+      const neam::r::duration_histogram &histogram = it->second.intr.get_duration_histogram();
+      neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << get_percentiles(histogram)
+                          << " [" << histogram.count << " samples]" << std::endl;
+      snapshot.get_path(it->second.node, path);
+      print_callstack(snapshot, path, 4);
+    }
+
+    neam::cr::out.log() << std::endl;
+    neam::cr::out.log() << "TOP " << func_count << " functions (p99 of the time spent per call, with its children -- global): " << std::endl;
+    neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+
+    i = 0;
+    for (auto it = intr_by_ttl_p99.rbegin(); it != intr_by_ttl_p99.rend(); ++it, ++i)
+    {
+      if (i >= func_count)
+        break;
+
+      const auto &fd = it->second.intr.get_function_descriptor();
+      const neam::r::duration_histogram &histogram = it->second.intr.get_duration_histogram();
+      neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << get_percentiles(histogram)
+                          << " [" << histogram.count << " samples]" << std::endl;
+    }
+
     neam::cr::out.log() << std::endl;
     neam::cr::out.log() << "TOP " << func_count << " functions (call count -- localized): " << std::endl;
     neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
@@ -262,7 +315,8 @@ int main(int argc, char **argv)
 
       const auto &fd = it->second.intr.get_function_descriptor();
       neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << it->first << " calls" << std::endl;
-      print_callstack(it->second.stack, 4);
+      snapshot.get_path(it->second.node, path);
+      print_callstack(snapshot, path, 4);
     }
 
     neam::cr::out.log() << std::endl;
@@ -270,14 +324,10 @@ int main(int argc, char **argv)
     neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
     i = 0;
-    last = nullptr;
     for (auto it = intr_by_ttl_call_count.rbegin(); it != intr_by_ttl_call_count.rend(); ++it, ++i)
     {
       if (i >= func_count)
         break;
-      if (last && *last == it->second.intr)
-        continue;
-      last = &it->second.intr;
 
       const auto &fd = it->second.intr.get_function_descriptor();
       neam::cr::out.log() << "  " << fd.pretty_name << " [" << fd.file << ": " << fd.line << "]: " << it->first << " calls" << std::endl;
@@ -289,18 +339,48 @@ int main(int argc, char **argv)
 
   // probably huge things //
 
+  neam::cr::out.log() << std::endl;
+  neam::cr::out.log() << "EXEMPLARS (the slowest root calls, with their call tree): " << std::endl;
+  neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+
+  for (size_t root_node : snapshot.get_roots())
+  {
+    const neam::r::introspect root = snapshot.get_introspect(root_node);
+    const std::vector<neam::r::exemplar> exemplars = root.get_exemplars();
+    if (exemplars.empty())
+      continue;
+    print_function(root);
+    for (const neam::r::exemplar &ex : exemplars)
+    {
+      auto tm = get_time(ex.duration);
+      neam::cr::out.log() << "  - " << tm.first << tm.second << " at " << std::put_time(std::localtime((const time_t *)&ex.timestamp), "%F %T");
+      if (ex.dropped_calls)
+        neam::cr::out.log() << " [" << ex.dropped_calls << " calls not recorded]";
+      neam::cr::out.log() << std::endl;
+      for (const neam::r::exemplar_call &call : ex.calls)
+      {
+        auto start = get_time(call.start);
+        auto duration = get_time(call.duration);
+        neam::cr::out.log() << "    " << std::string(call.depth * 2, ' ') << root.get_exemplar_function(call).get_pretty_name()
+                            << ": " << duration.first << duration.second << " [+" << start.first << start.second << "]" << std::endl;
+      }
+    }
+    neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
+  }
+
   neam::cr::out.log() << std::endl;
   neam::cr::out.log() << "SEQUENCES (local): " << std::endl;
   neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
-  neam::rtools::graph_walker::walk([](const neam::r::introspect &current, const std::deque<neam::r::introspect> &stack)
+  snapshot.walk([&](size_t node, const std::vector<size_t> &stack)
   {
-    auto msq = current.get_sequences();
-    if (msq.size() > 0)
+    const neam::r::introspect current = snapshot.get_introspect(node);
+    auto msq = current.get_sequences_view();
+    if (msq->size() > 0)
     {
       print_function(current);
       neam::cr::out.log() << "  list of sequences:" << std::endl;
-      for (const auto &sq : msq)
+      for (const auto &sq : *msq)
       {
         neam::cr::out.log() << "   - " << sq.first << ": " << std::endl;
         for (const auto &en : sq.second.get_entries())
@@ -308,7 +388,7 @@ int main(int argc, char **argv)
           neam::cr::out.log() << "     - " << en.name << ": " << en.description << " [" << en.file << ": " << en.line << "]" << std::endl;
         }
       }
-      print_callstack(stack);
+      print_callstack(snapshot, stack);
 
       neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
     }
@@ -319,14 +399,15 @@ int main(int argc, char **argv)
   neam::cr::out.log() << "REPORTS (may be huge, but it's the last thing): " << std::endl;
   neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
 
-  neam::rtools::graph_walker::walk([](const neam::r::introspect &current, const std::deque<neam::r::introspect> &stack)
+  snapshot.walk([&](size_t node, const std::vector<size_t> &stack)
   {
-    auto rm = current.get_reports();
-    if (rm.size() > 0)
+    const neam::r::introspect current = snapshot.get_introspect(node);
+    auto rm = current.get_reports_view();
+    if (rm->size() > 0)
     {
       print_function(current);
       neam::cr::out.log() << "  list of reports:" << std::endl;
-      for (const auto &re : rm)
+      for (const auto &re : *rm)
       {
         neam::cr::out.log() << "  -" << re.first << ":"<< std::endl;
         for (const neam::r::reason &r : re.second)
@@ -339,7 +420,7 @@ int main(int argc, char **argv)
                               << "      |__to:   " << std::put_time(std::localtime((const time_t *)&r.last_timestamp), "%F %T") << std::endl;
         }
       }
-      print_callstack(stack);
+      print_callstack(snapshot, stack);
       neam::cr::out.log() << "---------------------------------------------------------------------------------------------" << std::endl;
     }
   });
@@ -0,0 +1,118 @@
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+#define N_R_XBUILD_COMPAT // I want a file that works across multiple builds / compilers
+
+#include <reflective/reflective.hpp>
+#include <tools/logger/logger.hpp>
+
+#include "folded_gen.hpp"
+
+int main(int argc, char **argv)
+{
+  // setup the conf
+  neam::r::conf::disable_auto_save = true;
+  neam::r::conf::out_file = "";
+
+  std::string input_file;
+  std::string output_file;
+  std::string weight;
+  std::string stash;
+
+  // parse cmdline arguments
+  boost::program_options::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "print this message and exit")
+    ("version,v", "print version and exit")
+
+    ("input,i", boost::program_options::value<std::string>(&input_file), "the input file to use (must be a reflective output file, or live:name for the live profile 'name' of a running process)")
+    ("output,o", boost::program_options::value<std::string>(&output_file)->default_value("-"), "the output file ( '-' for stdout)")
+
+    ("weight,w", boost::program_options::value<std::string>(&weight)->default_value("self"), "the weight of the stacks: 'self' (self time x hit count, in nanoseconds), 'calls' (hit count) or 'fails' (failure count)")
+    ("pretty-names,p", "use the pretty names of the functions (like 'void s::d()') instead of their names (like 's::d')")
+    ("stash,s", boost::program_options::value<std::string>(&stash), "use this stash instead of the active one")
+  ;
+
+  boost::program_options::positional_options_description pod;
+  pod.add("input", 1);
+
+  boost::program_options::variables_map vm;
+  try
+  {
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).positional(pod).run(), vm);
+    boost::program_options::notify(vm);
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  catch (...)
+  {
+    return 1;
+  }
+
+  // handle options
+  if (vm.count("help") || input_file.empty())
+  {
+    std::cout << "Usage: " << argv[0] << " [options] input-file" << std::endl;
+    std::cout << "  output the callgraph as folded stacks ('root;callee;callee weight'), for flamegraph.pl, inferno, speedscope, ..." << std::endl;
+    std::cout << desc << std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+  if (vm.count("version"))
+  {
+    std::cout << "reflective callgraph to folded stacks converter, using reflective " << _PROJ_VERSION_MAJOR << '.' << _PROJ_VERSION_MINOR << '.' << _PROJ_VERSION_SUPERMINOR << std::endl;
+    return 0;
+  }
+
+  neam::r::callgraph_to_folded ctf;
+  if (weight == "self")
+    ctf.set_weight(neam::r::callgraph_to_folded::weight_type::self_time);
+  else if (weight == "calls")
+    ctf.set_weight(neam::r::callgraph_to_folded::weight_type::call_count);
+  else if (weight == "fails")
+    ctf.set_weight(neam::r::callgraph_to_folded::weight_type::fail_count);
+  else
+  {
+    std::cerr << "unknown weight '" << weight << "' (expected 'self', 'calls' or 'fails')" << std::endl;
+    return 1;
+  }
+  ctf.use_pretty_names(vm.count("pretty-names"));
+
+  // load the file (or the live profile)
+  const bool is_live = input_file.compare(0, 5, "live:") == 0;
+  if (is_live ? !neam::r::load_data_from_live_profile(input_file.substr(5)) : !neam::r::load_data_from_disk(input_file))
+  {
+    neam::cr::out.error() << LOGGER_INFO << "Error: Unable to load '" << input_file << "'. No output produced." << std::endl;
+    return 2;
+  }
+  if (vm.count("stash") && !neam::r::load_data_from_stash(stash))
+  {
+    neam::cr::out.error() << LOGGER_INFO << "Error: No stash named '" << stash << "' in '" << input_file << "'. No output produced." << std::endl;
+    return 2;
+  }
+
+  // output the folded stacks
+  if (output_file != "-")
+  {
+    std::ofstream f(output_file, std::ios_base::trunc);
+    if (!f)
+    {
+      neam::cr::out.error() << LOGGER_INFO << "Error: Unable to create/truncate '" << output_file << "'. No output produced." << std::endl;
+      return 3;
+    }
+    ctf.write_to_stream(f);
+  }
+  else
+    ctf.write_to_stream(std::cout);
+
+  if (!ctf.get_stack_count() && weight == "self")
+    neam::cr::out.warning() << LOGGER_INFO << "Warning: No stack has a non-zero weight (was the self time monitored ? see neam::r::conf::monitor_self_time)" << std::endl;
+
+  return 0;
+}
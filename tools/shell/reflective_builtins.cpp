@@ -7,6 +7,8 @@
 
 #include <reflective.hpp>
 
+#include "folded_gen.hpp"
+
 // first is the time, second the unit
 std::pair<double, std::string> get_time(double sec_time);
 
@@ -27,6 +29,7 @@ namespace neam
       static void blt_info(shell &sh);
       static void blt_stash(shell &sh);
       static void blt_callgraph2dot(shell &sh);
+      static void blt_flamegraph(shell &sh);
 
       static enum class e_dir_mode
       {
@@ -50,12 +53,19 @@ void neam::r::shell::register_reflective_builtins(shell &sh, bool load_only)
     blt_info(sh);
     blt_stash(sh);
     blt_callgraph2dot(sh);
+    blt_flamegraph(sh);
   }
 }
 
 bool neam::r::shell::load_reflective_file(shell &sh, const std::string &filename)
 {
-  if (!neam::r::load_data_from_disk(filename))
+  // "live:name" is the live profile of a running process
+  if (filename.compare(0, 5, "live:") == 0)
+  {
+    if (!neam::r::load_data_from_live_profile(filename.substr(5)))
+      return false;
+  }
+  else if (!neam::r::load_data_from_disk(filename))
       return false;
 
   // create the manager
@@ -95,7 +105,7 @@ void neam::r::shell::blt_load(neam::r::shell::shell &sh)
 
     // die and leak the memory
     return 0;
-  }, "load a reflective save file", "reflective-file");
+  }, "load a reflective save file (or, with live:name, a snapshot of a live profile)", "reflective-file");
   blt.do_not_use_program_options();
   sh.get_builtin_manager().register_builtin("load", blt);
 }
@@ -395,38 +405,68 @@ void info_print_introspect_info(neam::r::introspect &info, bool full_listing, st
 
   if (full_listing)
   {
-    // time thing
-    std::deque<neam::r::duration_progression> sdp = info.get_self_duration_progression();
-    if (sdp.size())
+    // time thing (a view holds the global lock: only one view at a time)
     {
-      ios << "self duration progression:\n";
-      for (const neam::r::duration_progression &dp : sdp)
+      auto sdp = info.get_self_duration_progression_view();
+      if (sdp->size())
       {
-        auto dptm = get_time(dp.value);
-        ios << "  at " << std::put_time(std::localtime((long *)&dp.timestamp), "%F %T") << ": " << int(dptm.first) << dptm.second << "s\n";
+        ios << "self duration progression:\n";
+        for (const neam::r::duration_progression &dp : *sdp)
+        {
+          auto dptm = get_time(dp.value);
+          ios << "  at " << std::put_time(std::localtime((long *)&dp.timestamp), "%F %T") << ": " << int(dptm.first) << dptm.second << "s\n";
+        }
       }
     }
-    std::deque<neam::r::duration_progression> gdp = info.get_global_duration_progression();
-    if (gdp.size())
     {
-      ios << "global duration progression:\n";
-      for (const neam::r::duration_progression &dp : gdp)
+      auto gdp = info.get_global_duration_progression_view();
+      if (gdp->size())
       {
-        auto dptm = get_time(dp.value);
-        ios << "  at " << std::put_time(std::localtime((long *)&dp.timestamp), "%F %T") << ": " << int(dptm.first) << dptm.second << "s\n";
+        ios << "global duration progression:\n";
+        for (const neam::r::duration_progression &dp : *gdp)
+        {
+          auto dptm = get_time(dp.value);
+          ios << "  at " << std::put_time(std::localtime((long *)&dp.timestamp), "%F %T") << ": " << int(dptm.first) << dptm.second << "s\n";
+        }
       }
     }
   }
 
   // measure points
-  const auto &measure_point_map = info.get_measure_point_map();
-  if (measure_point_map.size())
   {
-    ios << "measure points:\n";
-    for (const auto & it : measure_point_map)
+    auto measure_point_map = info.get_measure_point_map_view();
+    if (measure_point_map->size())
     {
-      auto mpetm = get_time(it.second.value);
-      ios << "  " << it.first << ": " << mpetm.first << mpetm.second << "s\n";
+      ios << "measure points:\n";
+      for (const auto & it : *measure_point_map)
+      {
+        auto mpetm = get_time(it.second.value);
+        ios << "  " << it.first << ": " << mpetm.first << mpetm.second << "s\n";
+      }
+    }
+  }
+
+  // exemplars (only roots have some)
+  const std::vector<neam::r::exemplar> exemplars = info.get_exemplars();
+  if (exemplars.size())
+  {
+    ios << "exemplars (slowest calls):\n";
+    for (const neam::r::exemplar &ex : exemplars)
+    {
+      auto extm = get_time(ex.duration);
+      ios << "  " << extm.first << extm.second << "s at " << std::put_time(std::localtime((long *)&ex.timestamp), "%F %T");
+      if (ex.dropped_calls)
+        ios << " (" << ex.dropped_calls << " calls not recorded)";
+      ios << '\n';
+      if (!full_listing)
+        continue;
+      for (const neam::r::exemplar_call &call : ex.calls)
+      {
+        auto ctm = get_time(call.duration);
+        auto stm = get_time(call.start);
+        ios << "    " << std::string(call.depth * 2, ' ') << info.get_exemplar_function(call).get_pretty_name() << ": "
+            << ctm.first << ctm.second << "s [+" << stm.first << stm.second << "s]\n";
+      }
     }
   }
 
@@ -646,3 +686,38 @@ void neam::r::shell::blt_callgraph2dot(neam::r::shell::shell &)
   // TODO
 }
 
+void neam::r::shell::blt_flamegraph(neam::r::shell::shell &sh)
+{
+  builtin &blt = *new builtin([&](const std::string &name, variable_stack &, stream_pack &streamp, boost::program_options::variables_map &vm) -> int
+  {
+    neam::r::callgraph_to_folded ctf;
+
+    // gather options
+    const std::string weight = vm["weight"].as<std::string>();
+    if (weight == "self")
+      ctf.set_weight(neam::r::callgraph_to_folded::weight_type::self_time);
+    else if (weight == "calls")
+      ctf.set_weight(neam::r::callgraph_to_folded::weight_type::call_count);
+    else if (weight == "fails")
+      ctf.set_weight(neam::r::callgraph_to_folded::weight_type::fail_count);
+    else
+    {
+      streamp[stream::stderr] << name << ": unknown weight '" << weight << "' (expected 'self', 'calls' or 'fails')" << std::endl;
+      return 1;
+    }
+    ctf.use_pretty_names(vm.count("pretty-names"));
+
+    // in function mode, the stacks start at the current function
+    neam::r::introspect *root = nullptr;
+    if (dir_mode == e_dir_mode::functions && !vm.count("all"))
+      root = rmgr->get_top_introspect();
+
+    ctf.write_to_stream(streamp[stream::stdout], root);
+    return 0;
+  }, "print the callgraph as folded stacks ('root;callee;callee weight'), for flamegraph.pl, inferno, speedscope, ...", "[options]");
+  blt.add_options()("weight,w", boost::program_options::value<std::string>()->default_value("self"), "the weight of the stacks: 'self' (self time x hit count, in nanoseconds), 'calls' (hit count) or 'fails' (failure count)")
+                   ("pretty-names,p", "use the pretty names of the functions instead of their names")
+                   ("all,a", "in function mode, print the whole callgraph instead of the stacks of the current function");
+  blt.disallow_unknow_parameters();
+  sh.get_builtin_manager().register_builtin("flamegraph", blt);
+}